@@ -0,0 +1,1323 @@
+/**
+ * @file bench.cpp
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Benchmarks dos componentes do Marketplace
+ *
+ * Uso: ./bench [secao] [parametros...]
+ * Sem argumentos roda todas as seções com os tamanhos padrão.
+ *
+ * ./bench carga [chave=valor...] roda o gerador de carga (carga.h); além das chaves de
+ * ConfigCarga aceita saida=arquivo, que anexa o resultado ao arquivo como uma linha JSON.
+ *
+ * ./bench reproduzir arquivo.jsonl [velocidade] reproduz requisições gravadas
+ * (reproducao.h); velocidade 0 (padrão) é o mais rápido possível, 1 o ritmo original.
+ *
+ * ./bench servidor [requisicoes] [clientes] [profundidade] [threads] mede o Servidor
+ * (servidor.h) de ponta a ponta pelo socket Unix.
+ */
+
+#ifndef VERSAO_BENCH
+#define VERSAO_BENCH "desconhecida"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "marketplace.h"
+#include "carga.h"
+#include "reproducao.h"
+#include "servidor.h"
+#include "cliente.h"
+#include "particoes.h"
+
+using namespace std;
+
+static double segundos_desde(chrono::steady_clock::time_point inicio) {
+    return chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+}
+
+static Token token_aleatorio(mt19937_64 &rng) {
+    Token token;
+    uint64_t a = rng(), b = rng();
+    memcpy(token.data(), &a, 8);
+    memcpy(token.data() + 8, &b, 8);
+    return token;
+}
+
+/**
+ * Latência de ArmazemSessoes::verificar com 1k até max_sessoes sessões ativas.
+ * O esperado é que o tempo por verificação fique praticamente constante.
+ */
+void bench_sessoes(size_t max_sessoes) {
+    cout << "=~= sessoes: verificar (ns/op) =~=" << endl;
+    const size_t consultas = 2000000;
+    for (size_t n = 1000; n <= max_sessoes; n *= 10) {
+        mt19937_64 rng(n);
+        ArmazemSessoes sessoes;
+        sessoes.reservar(n);
+        vector<Token> tokens(n);
+        for (size_t i = 0; i < n; i++) {
+            tokens[i] = token_aleatorio(rng);
+            sessoes.inserir(tokens[i], i / 4 + 1);
+        }
+        // Ordem de consulta aleatória para não favorecer a cache
+        vector<uint32_t> ordem(consultas);
+        for (auto &o : ordem) {
+            o = rng() % n;
+        }
+        int64_t agora = ArmazemSessoes::agora_ms();
+        long long soma = 0;
+        auto inicio = chrono::steady_clock::now();
+        for (size_t i = 0; i < consultas; i++) {
+            soma += sessoes.verificar(tokens[ordem[i]], agora);
+        }
+        double acerto = segundos_desde(inicio);
+        inicio = chrono::steady_clock::now();
+        for (size_t i = 0; i < consultas; i++) {
+            soma += sessoes.verificar(token_aleatorio(rng), agora);
+        }
+        double erro = segundos_desde(inicio);
+        cout << "sessoes=" << n
+             << "\tacerto=" << acerto * 1e9 / consultas
+             << "\terro=" << erro * 1e9 / consultas
+             << "\t(checksum " << soma << ")" << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * Busca de usuários por id e por email com n usuários cadastrados,
+ * comparada com a varredura antiga (cópia de cada par do map por email).
+ */
+void bench_usuarios(size_t n) {
+    cout << "=~= usuarios: busca com " << n << " cadastrados (ns/op) =~=" << endl;
+    TabelaUsuarios usuarios;
+    usuarios.reservar(n);
+    map<string, Usuario> antigo;
+    vector<string> emails(n);
+    HashSenha hash{};
+    for (size_t i = 0; i < n; i++) {
+        emails[i] = "usuario" + to_string(i) + "@gmail.com";
+        int id = usuarios.cadastrar("Usuario " + to_string(i), emails[i], hash);
+        antigo.insert(make_pair(emails[i], usuarios.por_id(id)));
+    }
+
+    mt19937_64 rng(n);
+    const size_t consultas = 2000000;
+    vector<uint32_t> ordem(consultas);
+    for (auto &o : ordem) {
+        o = rng() % n;
+    }
+    long long soma = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (size_t i = 0; i < consultas; i++) {
+        soma += usuarios.por_id(ordem[i] + 1).id;
+    }
+    double por_id = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    for (size_t i = 0; i < consultas; i++) {
+        soma += usuarios.por_email(emails[ordem[i]]).id;
+    }
+    double por_email = segundos_desde(inicio);
+
+    // Varredura antiga: poucas consultas bastam
+    const size_t consultas_antigo = 20;
+    inicio = chrono::steady_clock::now();
+    for (size_t i = 0; i < consultas_antigo; i++) {
+        int id = ordem[i] + 1;
+        for (auto it : antigo) {
+            if (it.second.id == id) {
+                soma += it.second.id;
+                break;
+            }
+        }
+    }
+    double varredura = segundos_desde(inicio);
+
+    cout << "por_id=" << por_id * 1e9 / consultas
+         << "\tpor_email=" << por_email * 1e9 / consultas
+         << "\tvarredura_antiga=" << varredura * 1e9 / consultas_antigo
+         << "\t(checksum " << soma << ")" << endl << endl;
+}
+
+/**
+ * Dono de n_lojas lojas com produtos_por_loja produtos cada, todos com estoque_inicial.
+ * As mensagens de cadastro do Marketplace são descartadas.
+ */
+static string popular_marketplace(Marketplace &marketplace, int n_lojas, int produtos_por_loja,
+                                  int estoque_inicial, vector<int> &produtos) {
+    cout.setstate(ios::failbit);
+    marketplace.me_cadastrar("Dono", "dono@gmail.com", "123456");
+    string token = marketplace.login("dono@gmail.com", "123456");
+    for (int l = 0; l < n_lojas; l++) {
+        int loja_id = marketplace.criar_loja(token, "Loja " + to_string(l));
+        for (int p = 0; p < produtos_por_loja; p++) {
+            int produto_id = marketplace.adicionar_produto(token, loja_id, "Produto " + to_string(l) + "-" + to_string(p), 1.5);
+            marketplace.adicionar_estoque(token, loja_id, produto_id, estoque_inicial);
+            produtos.push_back(produto_id);
+        }
+    }
+    cout.clear();
+    return token;
+}
+
+class ResultadoCarga {
+    public:
+    double ops_por_segundo;
+    long long vendas;
+    long long estoque;
+    bool consistente;
+};
+
+/**
+ * n_threads threads comprando, repondo estoque e buscando ao mesmo tempo num marketplace
+ * criado por popular_marketplace. No fim confere que estoque final == inicial + reposto - vendido
+ * e que cada compra bem sucedida gerou uma Venda.
+ */
+static ResultadoCarga carga_mista(Marketplace &marketplace, const string &token, const vector<int> &produtos,
+                                  int produtos_por_loja, int estoque_inicial, int n_threads, long long operacoes) {
+    vector<long long> repostos(n_threads, 0), comprados(n_threads, 0), compras(n_threads, 0);
+    vector<thread> threads;
+    auto inicio = chrono::steady_clock::now();
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t]() {
+            mt19937 rng(t + 1);
+            for (long long i = 0; i < operacoes / n_threads; i++) {
+                int indice = rng() % produtos.size();
+                int produto_id = produtos[indice];
+                int sorteio = rng() % 10;
+                if (sorteio < 5) {
+                    int quantidade = 1 + rng() % 3;
+                    if (marketplace.comprar_produto(token, produto_id, quantidade) != -1) {
+                        comprados[t] += quantidade;
+                        compras[t]++;
+                    }
+                } else if (sorteio < 9) {
+                    int loja_id = indice / produtos_por_loja + 1;
+                    if (marketplace.adicionar_estoque(token, loja_id, produto_id, 1) != -1) {
+                        repostos[t]++;
+                    }
+                } else {
+                    marketplace.buscar_produtos("Produto " + to_string(indice / produtos_por_loja) + "-1",
+                                                indice / produtos_por_loja + 1);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    double tempo = segundos_desde(inicio);
+
+    ResultadoCarga resultado;
+    long long total_repostos = 0, total_comprados = 0;
+    resultado.estoque = 0;
+    resultado.vendas = 0;
+    for (auto &loja : marketplace.listar_lojas()) {
+        for (auto &produto : loja.produtos) {
+            resultado.estoque += produto.quantidade;
+        }
+    }
+    for (int t = 0; t < n_threads; t++) {
+        total_repostos += repostos[t];
+        total_comprados += comprados[t];
+        resultado.vendas += compras[t];
+    }
+    long long esperado = (long long)produtos.size() * estoque_inicial + total_repostos - total_comprados;
+    resultado.consistente = resultado.estoque == esperado
+        && (long long)marketplace.quantidade_vendas() == resultado.vendas;
+    resultado.ops_por_segundo = (operacoes / n_threads) * n_threads / tempo;
+    return resultado;
+}
+
+/**
+ * carga_mista com 1 até max_threads threads.
+ */
+void bench_concorrencia(int max_threads) {
+    cout << "=~= concorrencia: compras, reposição e buscas =~=" << endl;
+    const int n_lojas = 64, produtos_por_loja = 100, estoque_inicial = 50;
+    const long long operacoes = 400000;
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        Marketplace marketplace;
+        vector<int> produtos;
+        string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, estoque_inicial, produtos);
+        ResultadoCarga r = carga_mista(marketplace, token, produtos, produtos_por_loja, estoque_inicial,
+                                       n_threads, operacoes);
+        cout << "threads=" << n_threads
+             << "\tops/s=" << (long long)r.ops_por_segundo
+             << "\tvendas=" << r.vendas
+             << "\testoque=" << r.estoque
+             << "\t" << (r.consistente ? "consistente" : "INCONSISTENTE") << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * carga_mista sem leitor, com uma thread copiando o catálogo com listar_lojas em laço e
+ * com uma thread lendo o catálogo inteiro numa VistaCatalogo em laço. Cada leitura da vista
+ * percorre os produtos duas vezes e confere que viu o mesmo estoque total nas duas.
+ */
+void bench_vistas(int n_threads) {
+    cout << "=~= vistas: carga mista com " << n_threads << " threads e um leitor do catálogo inteiro =~=" << endl;
+    const int n_lojas = 1000, produtos_por_loja = 100, estoque_inicial = 50;
+    const long long operacoes = 1000000;
+    const char *leitores[] = {"nenhum", "listar_lojas", "vista"};
+    for (int leitor = 0; leitor < 3; leitor++) {
+        Marketplace marketplace;
+        vector<int> produtos;
+        string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, estoque_inicial, produtos);
+        atomic<bool> parar{false};
+        long long leituras = 0;
+        bool estavel = true;
+        thread leitura;
+        if (leitor > 0) {
+            leitura = thread([&]() {
+                while (!parar.load(memory_order_relaxed)) {
+                    if (leitor == 1) {
+                        marketplace.listar_lojas();
+                    } else {
+                        VistaCatalogo vista = marketplace.vista();
+                        long long totais[2] = {0, 0};
+                        for (long long &total : totais) {
+                            vista.para_cada_produto([&](const Produto &produto, int) { total += produto.quantidade; });
+                        }
+                        estavel = estavel && totais[0] == totais[1];
+                    }
+                    leituras++;
+                }
+            });
+        }
+        ResultadoCarga r = carga_mista(marketplace, token, produtos, produtos_por_loja, estoque_inicial,
+                                       n_threads, operacoes);
+        parar = true;
+        if (leitura.joinable()) {
+            leitura.join();
+        }
+        cout << "leitor=" << leitores[leitor]
+             << "	ops/s=" << (long long)r.ops_por_segundo
+             << "	leituras=" << leituras
+             << "	" << (r.consistente && estavel ? "consistente" : "INCONSISTENTE") << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * carga_mista sem assinante e com uma thread recebendo os eventos (em cada PoliticaEventos)
+ * e mantendo uma cópia do estoque, iniciada de uma vista. No fim a cópia tem que ser igual
+ * ao estoque do Marketplace, a menos que eventos tenham sido perdidos.
+ */
+void bench_eventos(int n_threads) {
+    cout << "=~= eventos: carga mista com " << n_threads << " threads e uma cópia do estoque pelos eventos =~=" << endl;
+    const int n_lojas = 64, produtos_por_loja = 100, estoque_inicial = 50;
+    const long long operacoes = 1000000;
+    const char *modos[] = {"sem assinante", "descartar", "esperar"};
+    for (int modo = 0; modo < 3; modo++) {
+        Marketplace marketplace;
+        vector<int> produtos;
+        string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, estoque_inicial, produtos);
+        unique_ptr<AssinaturaEventos> assinatura;
+        vector<long long> copia(produtos.size());
+        if (modo > 0) {
+            assinatura = marketplace.assinar_eventos(modo == 1 ? 1 << 16 : 1024,
+                                                     modo == 1 ? PoliticaEventos::DESCARTAR_ANTIGOS : PoliticaEventos::ESPERAR);
+            marketplace.vista().para_cada_produto([&](const Produto &produto, int) { copia[produto.id] = produto.quantidade; });
+        }
+        atomic<bool> parar{false};
+        long long recebidos = 0, lotes = 0;
+        thread consumidor;
+        if (assinatura) {
+            consumidor = thread([&]() {
+                vector<Evento> lote;
+                for (;;) {
+                    bool fim = parar.load(memory_order_acquire);
+                    if (assinatura->receber(lote, 1024) == 0) {
+                        if (fim) break;
+                        this_thread::yield();
+                        continue;
+                    }
+                    for (auto &evento : lote) {
+                        if (evento.tipo == TipoEvento::ESTOQUE_ALTERADO) copia[evento.produto_id] += evento.quantidade;
+                        if (evento.tipo == TipoEvento::VENDA_CRIADA) copia[evento.produto_id] -= evento.quantidade;
+                    }
+                    recebidos += lote.size();
+                    lotes++;
+                }
+            });
+        }
+        ResultadoCarga r = carga_mista(marketplace, token, produtos, produtos_por_loja, estoque_inicial,
+                                       n_threads, operacoes);
+        parar = true;
+        bool igual = true;
+        if (consumidor.joinable()) {
+            consumidor.join();
+            marketplace.vista().para_cada_produto([&](const Produto &produto, int) {
+                igual = igual && copia[produto.id] == produto.quantidade;
+            });
+        }
+        uint64_t perdidos = assinatura ? assinatura->perdidos() : 0;
+        cout << modos[modo]
+             << "	ops/s=" << (long long)r.ops_por_segundo
+             << "	eventos=" << recebidos
+             << "	por lote=" << (lotes ? recebidos / lotes : 0)
+             << "	perdidos=" << perdidos
+             << "	" << (r.consistente && (igual || perdidos > 0) ? "consistente" : "INCONSISTENTE") << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * carga_mista só em memória e com o log de escrita em cada PoliticaFsync,
+ * conferindo também que reabrir o log reconstrói o mesmo estoque.
+ */
+void bench_wal(int n_threads) {
+    cout << "=~= wal: carga mista com " << n_threads << " threads =~=" << endl;
+    const int n_lojas = 64, produtos_por_loja = 100, estoque_inicial = 50;
+    const long long operacoes = 400000;
+    const string caminho = "bench_wal.log";
+    const char *nomes[] = {"memoria", "NUNCA", "PERIODICA", "SEMPRE"};
+    const PoliticaFsync politicas[] = {PoliticaFsync::NUNCA, PoliticaFsync::NUNCA,
+                                       PoliticaFsync::PERIODICA, PoliticaFsync::SEMPRE};
+    double base = 0;
+    for (int i = 0; i < 4; i++) {
+        remove(caminho.c_str());
+        ResultadoCarga r;
+        bool reconstruido = true;
+        {
+            unique_ptr<Marketplace> marketplace(i == 0 ? new Marketplace() : new Marketplace(caminho, politicas[i]));
+            vector<int> produtos;
+            string token = popular_marketplace(*marketplace, n_lojas, produtos_por_loja, estoque_inicial, produtos);
+            r = carga_mista(*marketplace, token, produtos, produtos_por_loja, estoque_inicial, n_threads, operacoes);
+        }
+        if (i == 0) {
+            base = r.ops_por_segundo;
+        } else {
+            Marketplace reaberto(caminho);
+            long long estoque = 0;
+            for (auto &loja : reaberto.listar_lojas()) {
+                for (auto &produto : loja.produtos) {
+                    estoque += produto.quantidade;
+                }
+            }
+            reconstruido = estoque == r.estoque && (long long)reaberto.quantidade_vendas() == r.vendas;
+        }
+        cout << nomes[i]
+             << "\tops/s=" << (long long)r.ops_por_segundo
+             << "\t" << (int)(100 * r.ops_por_segundo / base) << "% da memória"
+             << "\t" << (r.consistente && reconstruido ? "reconstruído" : "INCONSISTENTE") << endl;
+    }
+    remove(caminho.c_str());
+    cout << endl;
+}
+
+/**
+ * Promoção relâmpago: n_threads threads comprando o mesmo produto até o estoque acabar.
+ * Confere que o total vendido é exatamente o estoque e que cada compra gerou uma Venda.
+ */
+void bench_promocao(int n_threads) {
+    cout << "=~= promocao: " << n_threads << " threads em um único produto =~=" << endl;
+    const int estoque = 100000;
+    Marketplace marketplace;
+    vector<int> produtos;
+    string token = popular_marketplace(marketplace, 1, 1, estoque, produtos);
+    int produto_id = produtos[0];
+
+    vector<long long> vendidos(n_threads, 0), compras(n_threads, 0);
+    atomic<bool> largada{false};
+    vector<thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t]() {
+            while (!largada.load()) {
+                this_thread::yield();
+            }
+            int quantidade = 1 + t % 3;
+            while (marketplace.comprar_produto(token, produto_id, quantidade) != -1) {
+                vendidos[t] += quantidade;
+                compras[t]++;
+            }
+            // Sobrou menos que quantidade: tenta levar de um em um
+            while (marketplace.comprar_produto(token, produto_id, 1) != -1) {
+                vendidos[t]++;
+                compras[t]++;
+            }
+        });
+    }
+    auto inicio = chrono::steady_clock::now();
+    largada.store(true);
+    for (auto &th : threads) {
+        th.join();
+    }
+    double tempo = segundos_desde(inicio);
+
+    long long total_vendido = 0, total_compras = 0;
+    for (int t = 0; t < n_threads; t++) {
+        total_vendido += vendidos[t];
+        total_compras += compras[t];
+    }
+    int restante = marketplace.buscar_produtos("Produto 0-0")[0].quantidade;
+    bool ok = total_vendido == estoque && restante == 0
+        && (long long)marketplace.quantidade_vendas() == total_compras;
+    cout << "compras/s=" << (long long)(total_compras / tempo)
+         << "\tvendido=" << total_vendido << "/" << estoque
+         << "\tvendas=" << total_compras
+         << "\t" << (ok ? "sem venda a mais" : "ERRO: estoque inconsistente") << endl << endl;
+}
+
+/**
+ * Carrinho de itens_por_carrinho itens: comprar_carrinho contra uma chamada de
+ * comprar_produto por item.
+ */
+void bench_carrinho(int itens_por_carrinho) {
+    cout << "=~= carrinho: " << itens_por_carrinho << " itens (us/carrinho) =~=" << endl;
+    const int carrinhos = 20000;
+    Marketplace marketplace;
+    vector<int> produtos;
+    string token = popular_marketplace(marketplace, 100, 100, 1000000, produtos);
+    mt19937 rng(1);
+    vector<vector<pair<int, int>>> pedidos(carrinhos);
+    for (auto &pedido : pedidos) {
+        for (int i = 0; i < itens_por_carrinho; i++) {
+            pedido.push_back(make_pair(produtos[rng() % produtos.size()], 1));
+        }
+    }
+
+    auto inicio = chrono::steady_clock::now();
+    for (auto &pedido : pedidos) {
+        for (auto &item : pedido) {
+            marketplace.comprar_produto(token, item.first, item.second);
+        }
+    }
+    double item_a_item = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    for (auto &pedido : pedidos) {
+        marketplace.comprar_carrinho(token, pedido);
+    }
+    double carrinho = segundos_desde(inicio);
+    cout << "item_a_item=" << item_a_item * 1e6 / carrinhos
+         << "\tcomprar_carrinho=" << carrinho * 1e6 / carrinhos
+         << "\tvendas=" << marketplace.quantidade_vendas() << endl << endl;
+}
+
+void bench_snapshot(int n_produtos) {
+    cout << "=~= snapshot: partida a frio com " << n_produtos << " produtos =~=" << endl;
+    const string caminho_log = "bench_snapshot.log", caminho_snapshot = "bench_snapshot.img";
+    const int n_lojas = 1000, produtos_por_loja = max(1, n_produtos / n_lojas);
+    remove(caminho_log.c_str());
+    remove(caminho_snapshot.c_str());
+    long long vendas;
+    {
+        Marketplace marketplace(caminho_log, PoliticaFsync::NUNCA);
+        vector<int> produtos;
+        string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, 10, produtos);
+        mt19937 rng(1);
+        for (int i = 0; i < n_produtos / 10; i++) {
+            marketplace.comprar_produto(token, produtos[rng() % produtos.size()], 1);
+        }
+        auto inicio = chrono::steady_clock::now();
+        marketplace.salvar_snapshot(caminho_snapshot);
+        cout << "salvar_snapshot=" << segundos_desde(inicio) << "s" << endl;
+        // Operações depois do snapshot, que a partida a frio precisa reaplicar do log
+        for (int i = 0; i < 1000; i++) {
+            marketplace.comprar_produto(token, produtos[rng() % produtos.size()], 1);
+        }
+        vendas = marketplace.quantidade_vendas();
+    }
+
+    auto inicio = chrono::steady_clock::now();
+    size_t encontrados_log, lojas_log;
+    {
+        Marketplace marketplace(caminho_log);
+        encontrados_log = marketplace.buscar_produtos("Produto 7-").size();
+        lojas_log = marketplace.listar_lojas().size();
+        cout << "log inteiro=" << segundos_desde(inicio) << "s";
+        cout << (marketplace.quantidade_vendas() == (size_t)vendas ? "" : " (INCONSISTENTE)") << endl;
+    }
+
+    inicio = chrono::steady_clock::now();
+    {
+        Marketplace marketplace(caminho_snapshot, caminho_log);
+        bool igual = marketplace.buscar_produtos("Produto 7-").size() == encontrados_log
+            && marketplace.listar_lojas().size() == lojas_log
+            && marketplace.quantidade_vendas() == (size_t)vendas;
+        cout << "snapshot + fim do log=" << segundos_desde(inicio) << "s" << (igual ? "" : " (INCONSISTENTE)") << endl;
+    }
+
+    inicio = chrono::steady_clock::now();
+    ImagemSnapshot imagem;
+    imagem.abrir(caminho_snapshot);
+    size_t encontrados = imagem.buscar_produtos("Produto 7-").size();
+    double primeira = segundos_desde(inicio);
+    bool igual = encontrados == encontrados_log && imagem.listar_lojas().size() == lojas_log;
+    cout << "mmap até a primeira busca=" << primeira * 1e3 << "ms" << (igual ? "" : " (INCONSISTENTE)") << endl;
+
+    remove(caminho_log.c_str());
+    remove(caminho_snapshot.c_str());
+    cout << endl;
+}
+
+/**
+ * Cadastro de n_produtos (com estoque) chamada a chamada e por importar_produtos de um CSV,
+ * com 1, 2 e uma thread por núcleo; e a reprodução do log de uma importação.
+ */
+void bench_importacao(int n_produtos) {
+    cout << "=~= importacao: " << n_produtos << " produtos de um CSV =~=" << endl;
+    const string caminho = "bench_importacao.csv", caminho_log = "bench_importacao.log";
+    const int n_lojas = 1000, produtos_por_loja = max(1, n_produtos / n_lojas);
+    {
+        ofstream csv(caminho);
+        csv << "loja,nome,preco,quantidade\n";
+        for (int l = 0; l < n_lojas; l++) {
+            for (int p = 0; p < produtos_por_loja; p++) {
+                csv << l + 1 << ",Produto " << l << "-" << p << ",1.5,10\n";
+            }
+        }
+    }
+    size_t encontrados;
+    {
+        Marketplace marketplace;
+        vector<int> produtos;
+        auto inicio = chrono::steady_clock::now();
+        popular_marketplace(marketplace, n_lojas, produtos_por_loja, 10, produtos);
+        double segundos = segundos_desde(inicio);
+        encontrados = marketplace.buscar_produtos("Produto 7-").size();
+        cout << "chamada a chamada\tprodutos/s=" << (long long)(produtos.size() / segundos) << endl;
+    }
+    unsigned nucleos = max(1u, thread::hardware_concurrency());
+    for (unsigned n_threads : {1u, 2u, nucleos}) {
+        Marketplace marketplace;
+        vector<int> nenhum;
+        string token = popular_marketplace(marketplace, n_lojas, 0, 0, nenhum);
+        ResultadoImportacao r = marketplace.importar_produtos(token, caminho, n_threads);
+        bool igual = r.importados == (long long)n_lojas * produtos_por_loja
+            && marketplace.buscar_produtos("Produto 7-").size() == encontrados;
+        cout << "importar_produtos\tthreads=" << n_threads
+             << "\tprodutos/s=" << (long long)(r.importados / r.segundos)
+             << "\t" << (igual ? "consistente" : "INCONSISTENTE") << endl;
+    }
+    remove(caminho_log.c_str());
+    {
+        Marketplace marketplace(caminho_log, PoliticaFsync::NUNCA);
+        vector<int> nenhum;
+        string token = popular_marketplace(marketplace, n_lojas, 0, 0, nenhum);
+        marketplace.importar_produtos(token, caminho);
+    }
+    auto inicio = chrono::steady_clock::now();
+    {
+        Marketplace marketplace(caminho_log);
+        vector<Produto> produtos = marketplace.buscar_produtos("Produto 7-");
+        bool igual = produtos.size() == encontrados && produtos[0].quantidade == 10;
+        cout << "reprodução do log=" << segundos_desde(inicio) << "s" << (igual ? "" : " (INCONSISTENTE)") << endl;
+    }
+    remove(caminho.c_str());
+    remove(caminho_log.c_str());
+    cout << endl;
+}
+
+void bench_colunas(int n_produtos) {
+    cout << "=~= colunas: faixa de preço em " << n_produtos << " produtos (ms/varredura) =~=" << endl;
+    const int n_lojas = 1000, repeticoes = 10;
+    const float minimo = 10, maximo = 12; // ~2% dos produtos
+    mt19937 rng(1);
+    uniform_real_distribution<float> precos(0, 100);
+    ColunasProdutos colunas;
+    PoolNomes textos;
+    vector<Produto> produtos(n_produtos); // Mesmo catálogo como em Loja::produtos
+    vector<int> lojas(n_produtos);
+    for (int id = 0; id < n_produtos; id++) {
+        Produto &produto = produtos[id];
+        produto.id = id;
+        produto.nome = textos.guardar("Produto " + to_string(id));
+        produto.preco = precos(rng);
+        produto.quantidade = rng() % 10 == 0 ? 0 : 1 + rng() % 50;
+        lojas[id] = 1 + rng() % n_lojas;
+        colunas.adicionar(id, lojas[id], produto.preco);
+        colunas.somar_quantidade(id, produto.quantidade);
+    }
+
+    vector<int> esperado;
+    auto inicio = chrono::steady_clock::now();
+    for (int r = 0; r < repeticoes; r++) {
+        esperado.clear();
+        for (auto &produto : produtos) {
+            if (produto.preco >= minimo && produto.preco <= maximo && produto.quantidade > 0) {
+                esperado.push_back(produto.id);
+            }
+        }
+    }
+    double base = segundos_desde(inicio) / repeticoes;
+    cout << "Loja::produtos\t" << base * 1e3 << "\tencontrados=" << esperado.size() << endl;
+
+    const char *nomes[] = {"escalar", "sse", "avx2"};
+    const ColunasProdutos::Kernel kernels[] = {ColunasProdutos::ESCALAR, ColunasProdutos::SSE, ColunasProdutos::AVX2};
+    for (int k = 0; k <= (int)ColunasProdutos::kernel_disponivel(); k++) {
+        vector<int> ids, na_loja;
+        inicio = chrono::steady_clock::now();
+        for (int r = 0; r < repeticoes; r++) {
+            ids.clear();
+            colunas.filtrar_preco(minimo, maximo, 0, 0, n_produtos, ids, kernels[k]);
+        }
+        double t = segundos_desde(inicio) / repeticoes;
+        colunas.filtrar_preco(minimo, maximo, 7, 0, n_produtos, na_loja, kernels[k]);
+        bool igual = ids == esperado;
+        for (int id : na_loja) {
+            igual = igual && lojas[id] == 7;
+        }
+        cout << nomes[k] << "\t" << t * 1e3 << "\t" << base / t << "x" << (igual ? "" : "\tINCONSISTENTE") << endl;
+    }
+    cout << endl;
+}
+
+// Memória residente do processo, em MB
+static double rss_mb() {
+    long paginas = 0, residentes = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &paginas, &residentes) != 2) residentes = 0;
+        fclose(f);
+    }
+    return residentes * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+void bench_memoria(int n_lojas, int n_produtos) {
+    cout << "=~= memoria: RSS com " << n_lojas << " lojas e " << n_produtos << " produtos =~=" << endl;
+    const char *itens[] = {"Arroz Parboilizado", "Feijão Carioca", "Café Torrado e Moído", "Leite Integral UHT",
+                           "Açúcar Refinado", "Óleo de Soja", "Macarrão Espaguete", "Farinha de Trigo",
+                           "Biscoito Recheado", "Sabão em Pó", "Detergente Neutro", "Papel Higiênico"};
+    const char *marcas[] = {"Camil", "Tio João", "Kicaldo", "Pilão", "Melitta", "Piracanjuba", "Italac",
+                            "União", "Liza", "Renata", "Dona Benta", "Nestlé", "Omo", "Ypê", "Neve"};
+    const char *medidas[] = {"1kg", "5kg", "500g", "250g", "1L", "900ml", "12 rolos", "30 unidades"};
+    const int n_donos = 1000;
+    double antes = rss_mb();
+    Marketplace marketplace;
+    cout.setstate(ios::failbit);
+    vector<string> tokens;
+    for (int d = 0; d < n_donos; d++) {
+        string email = "dono" + to_string(d) + "@gmail.com";
+        marketplace.me_cadastrar("Dono da Loja " + to_string(d), email, "123456");
+        tokens.push_back(marketplace.login(email, "123456"));
+    }
+    mt19937 rng(1);
+    int produtos_por_loja = n_produtos / n_lojas;
+    for (int l = 0; l < n_lojas; l++) {
+        const string &token = tokens[l % n_donos];
+        int loja_id = marketplace.criar_loja(token, "Mercadinho São José " + to_string(l));
+        for (int p = 0; p < produtos_por_loja; p++) {
+            string nome = string(itens[rng() % 12]) + " " + marcas[rng() % 15] + " " + medidas[rng() % 8];
+            marketplace.adicionar_produto(token, loja_id, nome, 1 + rng() % 100);
+        }
+    }
+    cout.clear();
+    double depois = rss_mb();
+    cout << "RSS=" << (long)(depois - antes) << "MB\t"
+         << (depois - antes) * (1 << 20) / n_produtos << " bytes/produto" << endl << endl;
+}
+
+void bench_hashes(int n) {
+    cout << "=~= hashes: " << n << " senhas (hashes/s) =~=" << endl;
+    vector<string> senhas(n);
+    for (int i = 0; i < n; i++) {
+        senhas[i] = "senha-" + to_string(i * 7919);
+    }
+    long long soma = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (auto &senha : senhas) {
+        soma += picosha2::hash256_hex_string(senha)[0];
+    }
+    double hex = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    for (auto &senha : senhas) {
+        soma += geraHash(senha)[0];
+    }
+    double binario = segundos_desde(inicio);
+    vector<picosha2::byte_t> escalar(n * picosha2::k_digest_size);
+    inicio = chrono::steady_clock::now();
+    picosha2::detail::hash256_batch_scalar(senhas.data(), n, escalar.data());
+    double lote_escalar = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    vector<HashSenha> lote = geraHashes(senhas);
+    double lote_simd = segundos_desde(inicio);
+    bool igual = memcmp(escalar.data(), lote[0].data(), escalar.size()) == 0 && lote[n - 1] == geraHash(senhas[n - 1]);
+    cout << "hex_string=" << (long long)(n / hex)
+         << "\tgeraHash=" << (long long)(n / binario)
+         << "\tlote_escalar=" << (long long)(n / lote_escalar)
+         << "\tlote_simd=" << (long long)(n / lote_simd)
+         << (igual ? "" : "\tINCONSISTENTE") << "\t(checksum " << soma << ")" << endl;
+
+    // Importação de usuários: um me_cadastrar por usuário contra o lote
+    vector<Cadastro> cadastros(n);
+    for (int i = 0; i < n; i++) {
+        cadastros[i] = Cadastro{"Usuario " + to_string(i), "usuario" + to_string(i) + "@gmail.com", senhas[i]};
+    }
+    double um_a_um, em_lote;
+    {
+        Marketplace marketplace;
+        inicio = chrono::steady_clock::now();
+        for (auto &cadastro : cadastros) {
+            marketplace.me_cadastrar(cadastro.nome, cadastro.email, cadastro.senha);
+        }
+        um_a_um = segundos_desde(inicio);
+    }
+    Marketplace marketplace;
+    inicio = chrono::steady_clock::now();
+    marketplace.me_cadastrar(cadastros);
+    em_lote = segundos_desde(inicio);
+    bool entra = marketplace.login(cadastros[n / 2].email, cadastros[n / 2].senha) != "invalid";
+    cout << "me_cadastrar um_a_um=" << (long long)(n / um_a_um) << "/s\tem_lote=" << (long long)(n / em_lote)
+         << "/s\t" << um_a_um / em_lote << "x" << (entra ? "" : "\tINCONSISTENTE") << endl << endl;
+}
+
+void bench_tokens(int n_threads) {
+    cout << "=~= tokens: geração de tokens de 128 bits (tokens/s) =~=" << endl;
+    const int n = 2000000;
+    long long soma = 0;
+    // Como era antes: rand() byte a byte (global, previsível) e string caractere a caractere
+    auto inicio = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        Token token;
+        for (auto &byte : token) {
+            byte = rand() & 0xff;
+        }
+        soma += token[0];
+    }
+    double antigo = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    for (int i = 0; i < n / 10; i++) {
+        string str;
+        for (int c = 0; c < 32; c++) {
+            str += alphanum[rand() % stringLength];
+        }
+        soma += str[0];
+    }
+    double antigo_string = segundos_desde(inicio) * 10;
+    inicio = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        soma += genRandomToken()[0];
+    }
+    double novo = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    for (int i = 0; i < n / 10; i++) {
+        soma += genRandomString(32)[0];
+    }
+    double novo_string = segundos_desde(inicio) * 10;
+
+    // Várias threads, cada uma com o seu buffer
+    vector<thread> threads;
+    vector<vector<Token>> gerados(n_threads);
+    inicio = chrono::steady_clock::now();
+    for (int t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t] {
+            gerados[t].resize(n / n_threads);
+            for (auto &token : gerados[t]) {
+                token = genRandomToken();
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    double paralelo = segundos_desde(inicio);
+    ArmazemSessoes sessoes(24LL * 60 * 60 * 1000, 0);
+    sessoes.reservar(n);
+    size_t colisoes = 0;
+    for (auto &lista : gerados) {
+        for (auto &token : lista) {
+            colisoes += !sessoes.inserir(token, 1);
+        }
+    }
+    cout << "rand_token=" << (long long)(n / antigo)
+         << "\trand_string32=" << (long long)(n / antigo_string)
+         << "\tgenRandomToken=" << (long long)(n / novo)
+         << "\tgenRandomString32=" << (long long)(n / novo_string) << endl;
+    cout << n_threads << " threads=" << (long long)(n / n_threads * n_threads / paralelo)
+         << "\tpor_core=" << (long long)(n / n_threads * n_threads / paralelo / min<unsigned>(n_threads, max(1u, thread::hardware_concurrency())))
+         << "\tcolisoes=" << colisoes << "\t(checksum " << soma << ")" << endl << endl;
+}
+
+void bench_relatorios(int n_vendas) {
+    cout << "=~= relatorios: totais com " << n_vendas << " vendas =~=" << endl;
+    const int n_lojas = 1000, n_produtos = 100000, n_compradores = 50000;
+    RegistroVendas vendas;
+    mt19937 rng(1);
+    int64_t agora = instante_atual_ms();
+    vector<Venda> geradas(n_vendas);
+    for (auto &venda : geradas) {
+        venda.produto_id = rng() % n_produtos;
+        venda.loja_id = 1 + venda.produto_id % n_lojas;
+        venda.comprador_id = 1 + rng() % n_compradores;
+        venda.quantidade = 1 + rng() % 3;
+        venda.preco_unitario = 0.5f * (1 + rng() % 200);
+        venda.instante = agora - (int64_t)(rng() % (30 * 24)) * AgregadosVendas::MS_POR_HORA; // Últimos 30 dias
+    }
+    auto inicio = chrono::steady_clock::now();
+    for (auto &venda : geradas) {
+        vendas.anexar(venda);
+    }
+    double anexar = segundos_desde(inicio);
+
+    // Relatório de uma loja e de 30 dias por hora: varrendo as vendas contra os totais
+    const int loja = 7;
+    inicio = chrono::steady_clock::now();
+    long long receita = 0;
+    map<int64_t, long long> por_hora;
+    vendas.para_cada([&](const Venda &venda) {
+        if (venda.loja_id == loja) {
+            receita += llround((double)venda.preco_unitario * 100) * venda.quantidade;
+        }
+        por_hora[venda.instante / AgregadosVendas::MS_POR_HORA] += venda.quantidade;
+    });
+    double varredura = segundos_desde(inicio);
+    inicio = chrono::steady_clock::now();
+    ResumoVendas resumo = vendas.agregados().por_loja(loja);
+    auto horas = vendas.agregados().por_hora(agora - 31 * 24 * AgregadosVendas::MS_POR_HORA, agora + 1);
+    double agregados = segundos_desde(inicio);
+    bool igual = resumo.receita_centavos == receita && horas.size() == por_hora.size();
+    for (auto &hora : horas) {
+        igual = igual && por_hora[hora.first / AgregadosVendas::MS_POR_HORA] == hora.second.unidades;
+    }
+    cout << "anexar=" << anexar * 1e9 / n_vendas << "ns/venda"
+         << "\tvarredura=" << varredura * 1e3 << "ms"
+         << "\tagregados=" << agregados * 1e6 << "us (" << horas.size() << " horas)"
+         << (igual ? "" : "\tINCONSISTENTE") << endl << endl;
+}
+
+void bench_ranking(int n_vendas) {
+    cout << "=~= ranking: mais vendidos com " << n_vendas << " vendas (Zipf s=1.1, 1M produtos) =~=" << endl;
+    const int n_produtos = 1000000, k = 100;
+    // Popularidade Zipf: o produto de posição r vende proporcionalmente a 1/r^s
+    Zipf popularidade(n_produtos, 1.1);
+    mt19937_64 rng(1);
+    vector<int> produtos(n_vendas);
+    vector<long long> exato(n_produtos + 1, 0);
+    for (auto &produto : produtos) {
+        produto = 1 + popularidade(rng);
+        exato[produto]++;
+    }
+    vector<int> top(n_produtos);
+    iota(top.begin(), top.end(), 1);
+    partial_sort(top.begin(), top.begin() + k, top.end(), [&](int a, int b) { return exato[a] > exato[b]; });
+    int64_t agora = instante_atual_ms();
+
+    for (size_t capacidade : {256, 1024, 4096, 16384}) {
+        RankingVendas ranking(capacidade, 60);
+        auto inicio = chrono::steady_clock::now();
+        for (int i = 0; i < n_vendas; i++) {
+            ranking.registrar(produtos[i], 1, agora - (int64_t)(n_vendas - i) * 3600000 / n_vendas);
+        }
+        double registrar = segundos_desde(inicio);
+        inicio = chrono::steady_clock::now();
+        auto aproximado = ranking.mais_vendidos(k);
+        double consulta = segundos_desde(inicio);
+        int acertos = 0;
+        double erro_maximo = 0;
+        for (auto &item : aproximado) {
+            acertos += find(top.begin(), top.begin() + k, item.produto_id) != top.begin() + k;
+            erro_maximo = max(erro_maximo, (double)(item.unidades - exato[item.produto_id]) / exato[item.produto_id]);
+        }
+        cout << "capacidade=" << capacidade
+             << "	registrar=" << registrar * 1e9 / n_vendas << "ns/venda"
+             << "	consulta=" << consulta * 1e6 << "us"
+             << "	top" << k << "=" << acertos << "%"
+             << "	erro_max=" << erro_maximo * 100 << "%"
+             << "	contadores<=" << capacidade * 61 << endl;
+    }
+    // Referência: contar tudo exatamente e ordenar na consulta
+    vector<long long> contagem(n_produtos + 1, 0);
+    auto inicio = chrono::steady_clock::now();
+    for (int produto : produtos) {
+        contagem[produto]++;
+    }
+    vector<int> ordem(n_produtos);
+    iota(ordem.begin(), ordem.end(), 1);
+    partial_sort(ordem.begin(), ordem.begin() + k, ordem.end(), [&](int a, int b) { return contagem[a] > contagem[b]; });
+    cout << "exato: " << segundos_desde(inicio) * 1e3 << "ms, " << (n_produtos + 1) * sizeof(long long) / (1 << 20)
+         << "MB de contadores (sem janela)" << endl << endl;
+}
+
+/**
+ * Vazão com as métricas ligadas; compare com um bench compilado com
+ * CXXFLAGS=-DMARKETPLACE_SEM_METRICAS para ver o custo da medição.
+ */
+void bench_metricas(int rodadas) {
+#ifdef MARKETPLACE_SEM_METRICAS
+    cout << "=~= metricas: desligadas =~=" << endl;
+#else
+    cout << "=~= metricas: ligadas =~=" << endl;
+#endif
+    const int n_lojas = 64, produtos_por_loja = 100, estoque_inicial = 50;
+    double melhor_carga = 0, melhor_verificacao = 0;
+    for (int r = 0; r < rodadas; r++) {
+        Marketplace marketplace;
+        vector<int> produtos;
+        string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, estoque_inicial, produtos);
+        ResultadoCarga carga = carga_mista(marketplace, token, produtos, produtos_por_loja, estoque_inicial, 1, 400000);
+        melhor_carga = max(melhor_carga, carga.ops_por_segundo);
+        const int n = 2000000;
+        long long soma = 0;
+        auto inicio = chrono::steady_clock::now();
+        for (int i = 0; i < n; i++) {
+            soma += marketplace.token_verify(token);
+        }
+        melhor_verificacao = max(melhor_verificacao, n / segundos_desde(inicio));
+        if (soma != (long long)n * marketplace.token_verify(token)) {
+            cout << "INCONSISTENTE" << endl;
+        }
+    }
+    cout << "carga_mista ops/s=" << (long long)melhor_carga
+         << "\ttoken_verify/s=" << (long long)melhor_verificacao << endl;
+    cout << Metricas::texto() << endl;
+}
+
+/**
+ * Tráfego sintético no formato de reproducao.h: cadastros, lojas e produtos, e depois
+ * n_requisicoes entre buscas, compras e reposições. Grava em arquivo para medir a
+ * leitura do JSONL sozinha (sem aplicar) e a reprodução completa via mmap.
+ */
+void bench_reproducao(int n_requisicoes) {
+    cout << "=~= reproducao: " << n_requisicoes << " requisicoes JSONL =~=" << endl;
+    const int n_usuarios = 1000, n_lojas = 100, produtos_por_loja = 100;
+    const string caminho = "bench_reproducao.jsonl";
+    {
+        ofstream arquivo(caminho, ios::trunc);
+        long long t = 1600000000000LL;
+        for (int u = 0; u < n_usuarios; u++) {
+            arquivo << "{\"t\": " << t++ << ", \"op\": \"cadastro\", \"nome\": \"Usu\\u00e1rio " << u
+                    << "\", \"email\": \"u" << u << "@gmail.com\", \"senha\": \"s" << u << "\"}\n";
+            arquivo << "{\"t\": " << t++ << ", \"op\": \"login\", \"email\": \"u" << u << "@gmail.com\", \"senha\": \"s" << u
+                    << "\", \"sessao\": \"sessao-" << u << "\"}\n";
+        }
+        for (int l = 0; l < n_lojas; l++) {
+            arquivo << "{\"t\": " << t++ << ", \"op\": \"criar_loja\", \"sessao\": \"sessao-" << l
+                    << "\", \"nome\": \"Loja " << l << "\", \"loja\": " << 1000 + l << "}\n";
+            for (int p = 0; p < produtos_por_loja; p++) {
+                int produto = l * produtos_por_loja + p;
+                arquivo << "{\"t\": " << t++ << ", \"op\": \"adicionar_produto\", \"sessao\": \"sessao-" << l
+                        << "\", \"loja\": " << 1000 + l << ", \"nome\": \"Produto " << l << "-" << p
+                        << "\", \"preco\": " << 1 + p % 50 << ".5, \"produto\": " << 50000 + produto << "}\n";
+                arquivo << "{\"t\": " << t++ << ", \"op\": \"adicionar_estoque\", \"sessao\": \"sessao-" << l
+                        << "\", \"loja\": " << 1000 + l << ", \"produto\": " << 50000 + produto << ", \"quantidade\": 100}\n";
+            }
+        }
+        Zipf popularidade(n_lojas * produtos_por_loja, 1.0);
+        mt19937_64 rng(1);
+        for (int i = 0; i < n_requisicoes; i++) {
+            int produto = popularidade(rng), l = produto / produtos_por_loja, sorteio = rng() % 10;
+            arquivo << "{\"t\": " << t++;
+            if (sorteio < 5) {
+                arquivo << ", \"op\": \"buscar_produtos\", \"nome\": \"Produto " << l << "-" << produto % produtos_por_loja << "\"}\n";
+            } else if (sorteio < 8) {
+                arquivo << ", \"op\": \"comprar_produto\", \"sessao\": \"sessao-" << rng() % n_usuarios
+                        << "\", \"produto\": " << 50000 + produto << ", \"quantidade\": 1}\n";
+            } else {
+                arquivo << ", \"op\": \"adicionar_estoque\", \"sessao\": \"sessao-" << l << "\", \"loja\": " << 1000 + l
+                        << ", \"produto\": " << 50000 + produto << ", \"quantidade\": 1}\n";
+            }
+        }
+    }
+    string conteudo;
+    {
+        ifstream arquivo(caminho);
+        conteudo.assign(istreambuf_iterator<char>(arquivo), istreambuf_iterator<char>());
+    }
+    // Só a leitura do JSON: linhas, campos e números
+    ObjetoJson requisicao;
+    long long linhas = 0, soma = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (size_t p = 0; p < conteudo.size();) {
+        size_t quebra = conteudo.find('\n', p);
+        if (quebra == string::npos) quebra = conteudo.size();
+        if (requisicao.ler(string_view(conteudo.data() + p, quebra - p))) {
+            soma += requisicao.inteiro("t") + requisicao.texto("op").size();
+            linhas++;
+        }
+        p = quebra + 1;
+    }
+    double leitura = segundos_desde(inicio);
+
+    Marketplace marketplace;
+    ReprodutorRequisicoes reprodutor(marketplace);
+    cout.setstate(ios::failbit);
+    ResultadoReproducao resultado = reprodutor.reproduzir_arquivo(caminho);
+    cout.clear();
+    cout << "leitura=" << linhas / leitura / 1e6 << "M linhas/s (" << conteudo.size() / leitura / (1 << 20) << " MB/s)"
+         << "\treproducao=" << (long long)(resultado.operacoes / resultado.segundos) << " ops/s"
+         << "\toperacoes=" << resultado.operacoes << "\tfalhas=" << resultado.falhas
+         << "\tinvalidas=" << resultado.invalidas << "\t(checksum " << soma << ")" << endl << endl;
+    remove(caminho.c_str());
+}
+
+/**
+ * Servidor num socket Unix com n_clientes conexões, cada uma com até profundidade
+ * requisições em voo (pipelining; repõe quando cai à metade, num envio só): 60%
+ * token_verify, 30% página de busca de produtos e 10% compras. A latência é medida no
+ * cliente, do envio até a resposta, e inclui a espera atrás das outras requisições da
+ * mesma conexão.
+ */
+void bench_servidor(int n_requisicoes, int n_clientes, int profundidade, int n_threads) {
+    cout << "=~= servidor: " << n_clientes << " clientes, " << profundidade << " em voo cada, "
+         << n_threads << " threads no servidor =~=" << endl;
+    const int n_lojas = 100, produtos_por_loja = 100;
+    const string caminho = "bench_servidor.sock";
+    Marketplace marketplace;
+    vector<int> produtos;
+    string token = popular_marketplace(marketplace, n_lojas, produtos_por_loja, 1000000, produtos);
+    Servidor servidor(marketplace, caminho, n_threads);
+
+    vector<vector<uint32_t>> latencias(n_clientes); // Nanossegundos
+    vector<long long> falhas(n_clientes, 0);
+    vector<thread> clientes;
+    auto inicio = chrono::steady_clock::now();
+    for (int c = 0; c < n_clientes; c++) {
+        clientes.emplace_back([&, c]() {
+            ClienteMarketplace cliente(caminho);
+            mt19937 rng(c + 1);
+            vector<chrono::steady_clock::time_point> envios(profundidade); // Posição: id % profundidade
+            long long total = n_requisicoes / n_clientes, mandadas = 0, recebidas = 0;
+            latencias[c].reserve(total);
+            auto mandar = [&]() {
+                int indice = rng() % produtos.size(), sorteio = rng() % 10;
+                if (sorteio < 6) {
+                    cliente.iniciar(OperacaoRemota::VERIFICA_TOKEN).str(token);
+                } else if (sorteio < 9) {
+                    cliente.iniciar(OperacaoRemota::BUSCAR_PRODUTOS_PAGINA)
+                        .str("Produto " + to_string(indice / produtos_por_loja) + "-1").i32(0).i32(0).i32(10);
+                } else {
+                    cliente.iniciar(OperacaoRemota::COMPRAR_PRODUTO).str(token).i32(produtos[indice]).i32(1);
+                }
+                envios[cliente.terminar() % profundidade] = chrono::steady_clock::now();
+                mandadas++;
+            };
+            while (recebidas < total) {
+                if (mandadas - recebidas <= profundidade / 2 && mandadas < total) {
+                    while (mandadas - recebidas < profundidade && mandadas < total) {
+                        mandar();
+                    }
+                    cliente.enviar();
+                }
+                RespostaRemota resposta = cliente.receber();
+                auto agora = chrono::steady_clock::now();
+                latencias[c].push_back(chrono::duration_cast<chrono::nanoseconds>(
+                    agora - envios[resposta.id % profundidade]).count());
+                if (resposta.status != StatusResposta::OK) {
+                    falhas[c]++;
+                }
+                recebidas++;
+            }
+        });
+    }
+    for (auto &th : clientes) {
+        th.join();
+    }
+    double tempo = segundos_desde(inicio);
+    vector<uint32_t> todas;
+    for (auto &l : latencias) {
+        todas.insert(todas.end(), l.begin(), l.end());
+    }
+    sort(todas.begin(), todas.end());
+    auto percentil = [&](double p) { return todas[min(todas.size() - 1, (size_t)(p * todas.size()))] / 1000.0; };
+    long long total_falhas = accumulate(falhas.begin(), falhas.end(), 0LL);
+    cout << "req/s=" << (long long)(todas.size() / tempo) << "\tp50=" << percentil(0.5) << "us\tp99=" << percentil(0.99)
+         << "us\tp99.9=" << percentil(0.999) << "us\tmax=" << todas.back() / 1000.0 << "us"
+         << "\tinvalidas=" << total_falhas
+         << (servidor.requisicoes() == todas.size() ? "" : "\tINCONSISTENTE") << endl << endl;
+}
+
+/**
+ * Reposições de estoque (escritas locais a uma loja) com 1 até max_particoes partições e
+ * uma thread cliente por partição: uma mensagem por reposição, em lotes de 64 (uma
+ * mensagem por partição envolvida) e, para comparar, o Marketplace de uma trava com as
+ * mesmas threads. No fim confere o estoque total. Só escala com núcleos livres para as
+ * partições e para os clientes.
+ */
+void bench_particoes(int max_particoes) {
+    cout << "=~= particoes: reposicao de estoque, uma thread cliente por particao =~=" << endl;
+    const int n_lojas = 256, produtos_por_loja = 20, operacoes = 400000, tamanho_lote = 64;
+    double base = 0, base_lote = 0;
+    for (int n = 1; n <= max_particoes; n *= 2) {
+        MarketplaceParticionado particionado(n);
+        particionado.me_cadastrar("Dono", "dono@gmail.com", "123456");
+        string token = particionado.login("dono@gmail.com", "123456");
+        vector<Reposicao> produtos;
+        for (int l = 0; l < n_lojas; l++) {
+            int loja_id = particionado.criar_loja(token, "Loja " + to_string(l));
+            for (int p = 0; p < produtos_por_loja; p++) {
+                produtos.push_back({loja_id, particionado.adicionar_produto(token, loja_id, "Produto " + to_string(p), 1.5), 1});
+            }
+        }
+        Marketplace marketplace;
+        vector<int> ids;
+        string token_marketplace = popular_marketplace(marketplace, n_lojas, produtos_por_loja, 0, ids);
+
+        // Cada thread faz operacoes / n reposições de produtos sorteados (posições em produtos), de lote em lote
+        auto medir = [&](int lote, auto repor) {
+            vector<thread> threads;
+            auto inicio = chrono::steady_clock::now();
+            for (int t = 0; t < n; t++) {
+                threads.emplace_back([&, t]() {
+                    mt19937 rng(t + 1);
+                    vector<int> sorteados;
+                    vector<Reposicao> itens;
+                    for (int i = 0; i < operacoes / n; i += lote) {
+                        sorteados.clear();
+                        for (int j = i; j < min(i + lote, operacoes / n); j++) {
+                            sorteados.push_back(rng() % produtos.size());
+                        }
+                        repor(sorteados, itens);
+                    }
+                });
+            }
+            for (auto &th : threads) {
+                th.join();
+            }
+            return (operacoes / n) * n / segundos_desde(inicio);
+        };
+        double uma_a_uma = medir(1, [&](const vector<int> &sorteados, vector<Reposicao> &) {
+            const Reposicao &item = produtos[sorteados[0]];
+            particionado.adicionar_estoque(token, item.loja_id, item.produto_id, item.quantidade);
+        });
+        double em_lote = medir(tamanho_lote, [&](const vector<int> &sorteados, vector<Reposicao> &itens) {
+            itens.clear();
+            for (int i : sorteados) {
+                itens.push_back(produtos[i]);
+            }
+            particionado.adicionar_estoque(token, itens);
+        });
+        double uma_trava = medir(1, [&](const vector<int> &sorteados, vector<Reposicao> &) {
+            marketplace.adicionar_estoque(token_marketplace, sorteados[0] / produtos_por_loja + 1, ids[sorteados[0]], 1);
+        });
+        long long estoque = 0;
+        for (auto &loja : particionado.buscar_lojas("")) {
+            for (auto &produto : loja.produtos) {
+                estoque += produto.quantidade;
+            }
+        }
+        if (n == 1) {
+            base = uma_a_uma;
+            base_lote = em_lote;
+        }
+        cout << "particoes=" << n << "\tuma_a_uma ops/s=" << (long long)uma_a_uma << " (" << uma_a_uma / base
+             << "x)\tlote ops/s=" << (long long)em_lote << " (" << em_lote / base_lote << "x)"
+             << "\tmarketplace_uma_trava ops/s=" << (long long)uma_trava
+             << (estoque == 2LL * (operacoes / n) * n ? "" : "\tINCONSISTENTE") << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * Gerador de carga com os parâmetros da linha de comando ("chave=valor").
+ * @return false se algum parâmetro é inválido
+ */
+bool bench_carga(const vector<string> &parametros) {
+    ConfigCarga config;
+    string saida;
+    for (auto &parametro : parametros) {
+        if (parametro.rfind("saida=", 0) == 0) {
+            saida = parametro.substr(6);
+        } else if (!config.ler(parametro)) {
+            cerr << "parametro invalido: " << parametro << endl;
+            return false;
+        }
+    }
+    cout << "=~= carga: " << config.json() << " =~=" << endl;
+    ResultadoBench resultado = GeradorCarga(config).executar();
+    cout << resultado.texto() << endl;
+    if (!saida.empty()) {
+        ofstream arquivo(saida, ios::app);
+        arquivo << resultado.json(VERSAO_BENCH) << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    string secao = argc > 1 ? argv[1] : "todas";
+    if (secao == "carga") {
+        return bench_carga(vector<string>(argv + 2, argv + argc)) ? 0 : 1;
+    }
+    if (secao == "reproduzir" && argc > 2) {
+        Marketplace marketplace;
+        ReprodutorRequisicoes reprodutor(marketplace);
+        ResultadoReproducao r = reprodutor.reproduzir_arquivo(argv[2], argc > 3 ? atof(argv[3]) : 0);
+        cout << "linhas=" << r.linhas << "\toperacoes=" << r.operacoes << "\tfalhas=" << r.falhas
+             << "\tinvalidas=" << r.invalidas << "\tsegundos=" << r.segundos
+             << "\tops/s=" << (long long)(r.operacoes / r.segundos) << endl;
+        cout << Metricas::texto();
+        return 0;
+    }
+    if (secao == "sessoes" || secao == "todas") {
+        bench_sessoes(argc > 2 && secao != "todas" ? atoll(argv[2]) : 1000000);
+    }
+    if (secao == "usuarios" || secao == "todas") {
+        bench_usuarios(argc > 2 && secao != "todas" ? atoll(argv[2]) : 1000000);
+    }
+    if (secao == "hashes" || secao == "todas") {
+        bench_hashes(argc > 2 && secao != "todas" ? atoi(argv[2]) : 200000);
+    }
+    if (secao == "tokens" || secao == "todas") {
+        bench_tokens(argc > 2 && secao != "todas" ? atoi(argv[2]) : 4);
+    }
+    if (secao == "relatorios" || secao == "todas") {
+        bench_relatorios(argc > 2 && secao != "todas" ? atoi(argv[2]) : 5000000);
+    }
+    if (secao == "concorrencia" || secao == "todas") {
+        bench_concorrencia(argc > 2 && secao != "todas" ? atoi(argv[2]) : 32);
+    }
+    if (secao == "vistas" || secao == "todas") {
+        bench_vistas(argc > 2 && secao != "todas" ? atoi(argv[2]) : 2);
+    }
+    if (secao == "eventos" || secao == "todas") {
+        bench_eventos(argc > 2 && secao != "todas" ? atoi(argv[2]) : 2);
+    }
+    if (secao == "promocao" || secao == "todas") {
+        bench_promocao(argc > 2 && secao != "todas" ? atoi(argv[2]) : 2000);
+    }
+    if (secao == "carrinho" || secao == "todas") {
+        bench_carrinho(argc > 2 && secao != "todas" ? atoi(argv[2]) : 30);
+    }
+    if (secao == "wal" || secao == "todas") {
+        bench_wal(argc > 2 && secao != "todas" ? atoi(argv[2]) : 4);
+    }
+    if (secao == "snapshot" || secao == "todas") {
+        bench_snapshot(argc > 2 && secao != "todas" ? atoi(argv[2]) : 1000000);
+    }
+    if (secao == "importacao" || secao == "todas") {
+        bench_importacao(argc > 2 && secao != "todas" ? atoi(argv[2]) : 1000000);
+    }
+    if (secao == "memoria" || secao == "todas") {
+        bench_memoria(argc > 2 && secao != "todas" ? atoi(argv[2]) : 1000000,
+                      argc > 3 && secao != "todas" ? atoi(argv[3]) : 10000000);
+    }
+    if (secao == "colunas" || secao == "todas") {
+        bench_colunas(argc > 2 && secao != "todas" ? atoi(argv[2]) : 10000000);
+    }
+    if (secao == "ranking" || secao == "todas") {
+        bench_ranking(argc > 2 && secao != "todas" ? atoi(argv[2]) : 5000000);
+    }
+    if (secao == "reproducao" || secao == "todas") {
+        bench_reproducao(argc > 2 && secao != "todas" ? atoi(argv[2]) : 1000000);
+    }
+    if (secao == "servidor" || secao == "todas") {
+        bool proprios = secao != "todas";
+        bench_servidor(argc > 2 && proprios ? atoi(argv[2]) : 1000000, argc > 3 && proprios ? atoi(argv[3]) : 4,
+                       argc > 4 && proprios ? atoi(argv[4]) : 32, argc > 5 && proprios ? atoi(argv[5]) : 2);
+    }
+    if (secao == "particoes" || secao == "todas") {
+        bench_particoes(argc > 2 && secao != "todas" ? atoi(argv[2]) : 8);
+    }
+    if (secao == "metricas" || secao == "todas") {
+        bench_metricas(argc > 2 && secao != "todas" ? atoi(argv[2]) : 5);
+    }
+    return 0;
+}
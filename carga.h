@@ -0,0 +1,348 @@
+/**
+ * @file carga.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Gerador de carga sintética para o Marketplace (usado pelo bench)
+ *
+ * Popula um Marketplace com usuários, lojas, produtos e sessões, e roda uma mistura
+ * de leituras e escritas em várias threads, com popularidade dos produtos Zipf.
+ * O resultado tem vazão e percentis de latência por operação, em texto ou JSON.
+ */
+
+#ifndef CARGA_H
+#define CARGA_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "marketplace.h"
+
+using namespace std;
+
+/**
+ * Sorteia posições em [0, n) com probabilidade proporcional a 1/(posição+1)^s.
+ * s = 0 é uniforme; quanto maior s, mais concentrado nas primeiras posições.
+ */
+class Zipf {
+    private:
+    vector<double> acumulada;
+
+    public:
+    Zipf(size_t n, double s) : acumulada(max<size_t>(n, 1)) {
+        double soma = 0;
+        for (size_t r = 0; r < acumulada.size(); r++) {
+            soma += 1 / pow(r + 1, s);
+            acumulada[r] = soma;
+        }
+    }
+
+    template <typename Gerador>
+    size_t operator()(Gerador &rng) const {
+        double x = uniform_real_distribution<double>(0, acumulada.back())(rng);
+        return min<size_t>(lower_bound(acumulada.begin(), acumulada.end(), x) - acumulada.begin(),
+                           acumulada.size() - 1);
+    }
+};
+
+/**
+ * Parâmetros da carga. Cada um pode ser trocado com "chave=valor" (ver ler).
+ */
+class ConfigCarga {
+    public:
+    int usuarios = 10000;
+    int lojas = 1000;
+    int produtos_por_loja = 100;
+    int sessoes = 1000; // Compradores logados; cada operação usa uma sessão sorteada
+    int threads = 4;
+    long long operacoes = 1000000;
+    double zipf = 1.0; // Expoente da popularidade dos produtos
+    int leitura = 80; // Porcentagem de leituras (buscas, token_verify, mais vendidos)
+    int estoque_inicial = 1000;
+    unsigned semente = 1;
+
+    /**
+     * Aplica um argumento "chave=valor".
+     * @return false se a chave não existe ou o formato é inválido
+     */
+    bool ler(const string &argumento) {
+        size_t igual = argumento.find('=');
+        if (igual == string::npos) {
+            return false;
+        }
+        string chave = argumento.substr(0, igual);
+        const char *valor = argumento.c_str() + igual + 1;
+        if (chave == "usuarios") usuarios = max(1, atoi(valor));
+        else if (chave == "lojas") lojas = max(1, atoi(valor));
+        else if (chave == "produtos_por_loja") produtos_por_loja = max(1, atoi(valor));
+        else if (chave == "sessoes") sessoes = max(1, atoi(valor));
+        else if (chave == "threads") threads = max(1, atoi(valor));
+        else if (chave == "operacoes") operacoes = max(1LL, atoll(valor));
+        else if (chave == "zipf") zipf = max(0.0, atof(valor));
+        else if (chave == "leitura") leitura = min(100, max(0, atoi(valor)));
+        else if (chave == "estoque_inicial") estoque_inicial = max(1, atoi(valor));
+        else if (chave == "semente") semente = strtoul(valor, nullptr, 10);
+        else return false;
+        return true;
+    }
+
+    string json() const {
+        ostringstream saida;
+        saida << "{\"usuarios\": " << usuarios << ", \"lojas\": " << lojas
+              << ", \"produtos_por_loja\": " << produtos_por_loja << ", \"sessoes\": " << sessoes
+              << ", \"threads\": " << threads << ", \"operacoes\": " << operacoes
+              << ", \"zipf\": " << zipf << ", \"leitura\": " << leitura
+              << ", \"estoque_inicial\": " << estoque_inicial << ", \"semente\": " << semente << "}";
+        return saida.str();
+    }
+};
+
+/**
+ * Vazão e latências de uma execução. Tempos em nanossegundos.
+ */
+class ResultadoBench {
+    public:
+    class PorOperacao {
+        public:
+        long long chamadas = 0;
+        long long falhas = 0; // Retornos de erro (sem estoque, carrinho recusado...)
+        double p50_ns = 0, p99_ns = 0, p999_ns = 0, maximo_ns = 0;
+    };
+
+    ConfigCarga config;
+    double segundos_populando = 0;
+    double segundos = 0;
+    double ops_por_segundo = 0;
+    map<string, PorOperacao> operacoes;
+
+    string texto() const {
+        ostringstream saida;
+        saida.setf(ios::fixed);
+        saida.precision(2);
+        saida << "populando=" << segundos_populando << "s\tcarga=" << segundos << "s\tops/s=" << (long long)ops_por_segundo << "\n";
+        for (auto &o : operacoes) {
+            saida << o.first << "\tchamadas=" << o.second.chamadas << "\tfalhas=" << o.second.falhas
+                  << "\tp50=" << o.second.p50_ns / 1e3 << "us"
+                  << "\tp99=" << o.second.p99_ns / 1e3 << "us"
+                  << "\tp999=" << o.second.p999_ns / 1e3 << "us"
+                  << "\tmax=" << o.second.maximo_ns / 1e3 << "us\n";
+        }
+        return saida.str();
+    }
+
+    /**
+     * Uma linha JSON, para anexar a um arquivo e comparar entre commits.
+     * @param versao Identifica o código medido (por exemplo o commit)
+     */
+    string json(const string &versao) const {
+        ostringstream saida;
+        saida.setf(ios::fixed);
+        saida.precision(3);
+        saida << "{\"versao\": \"" << versao << "\", \"instante_ms\": " << instante_atual_ms()
+              << ", \"config\": " << config.json()
+              << ", \"segundos\": " << segundos
+              << ", \"ops_por_segundo\": " << (long long)ops_por_segundo << ", \"operacoes\": {";
+        bool primeira = true;
+        for (auto &o : operacoes) {
+            saida << (primeira ? "" : ", ") << "\"" << o.first << "\": {\"chamadas\": " << o.second.chamadas
+                  << ", \"falhas\": " << o.second.falhas
+                  << ", \"p50_ns\": " << (long long)o.second.p50_ns << ", \"p99_ns\": " << (long long)o.second.p99_ns
+                  << ", \"p999_ns\": " << (long long)o.second.p999_ns << ", \"max_ns\": " << (long long)o.second.maximo_ns << "}";
+            primeira = false;
+        }
+        saida << "}}";
+        return saida.str();
+    }
+};
+
+/**
+ * Roda a carga descrita em ConfigCarga num Marketplace novo.
+ *
+ * Escritas: 60% comprar_produto, 30% adicionar_estoque (pelo dono da loja) e 10%
+ * comprar_carrinho com 3 produtos. Leituras: 40% token_verify, 40% buscar_produtos
+ * pelo nome de um produto, 10% ler_pagina_preco e 10% mais_vendidos.
+ * Os produtos são sorteados pela popularidade Zipf (o produto 0 é o mais popular).
+ */
+class GeradorCarga {
+    private:
+    enum Tipo { COMPRA, ESTOQUE, CARRINHO, TOKEN, BUSCA, BUSCA_PRECO, MAIS_VENDIDOS, N_TIPOS };
+
+    static const char *nome(int tipo) {
+        static const char *nomes[] = {"comprar_produto", "adicionar_estoque", "comprar_carrinho", "token_verify",
+                                      "buscar_produtos", "buscar_produtos_preco", "mais_vendidos"};
+        return nomes[tipo];
+    }
+
+    ConfigCarga config;
+    Marketplace marketplace;
+    vector<string> tokens_compradores;
+    vector<string> tokens_donos; // Posição: loja_id - 1
+    vector<int> produtos; // Posição: popularidade
+    vector<int> lojas_dos_produtos;
+    vector<string> nomes_produtos;
+
+    static string nome_produto(int loja, int produto) {
+        return "Produto " + to_string(loja) + "-" + to_string(produto);
+    }
+
+    void popular() {
+        cout.setstate(ios::failbit);
+        vector<Cadastro> cadastros;
+        for (int u = 0; u < config.usuarios; u++) {
+            cadastros.push_back(Cadastro{"Usuario " + to_string(u), "usuario" + to_string(u) + "@gmail.com", "senha" + to_string(u)});
+        }
+        marketplace.me_cadastrar(cadastros);
+        // A loja l é do usuário l % usuarios; cada dono loga uma vez
+        vector<string> token_do_usuario(min(config.usuarios, config.lojas));
+        for (size_t u = 0; u < token_do_usuario.size(); u++) {
+            token_do_usuario[u] = marketplace.login(cadastros[u].email, cadastros[u].senha);
+        }
+        mt19937_64 rng(config.semente);
+        vector<tuple<int, int, string>> catalogo;
+        for (int l = 0; l < config.lojas; l++) {
+            const string &token = token_do_usuario[l % token_do_usuario.size()];
+            int loja_id = marketplace.criar_loja(token, "Loja " + to_string(l));
+            tokens_donos.push_back(token);
+            for (int p = 0; p < config.produtos_por_loja; p++) {
+                float preco = 0.5f * (1 + rng() % 200);
+                int produto_id = marketplace.adicionar_produto(token, loja_id, nome_produto(l, p), preco);
+                marketplace.adicionar_estoque(token, loja_id, produto_id, config.estoque_inicial);
+                catalogo.emplace_back(produto_id, loja_id, nome_produto(l, p));
+            }
+        }
+        // A popularidade não segue a ordem de criação
+        shuffle(catalogo.begin(), catalogo.end(), rng);
+        for (auto &c : catalogo) {
+            produtos.push_back(get<0>(c));
+            lojas_dos_produtos.push_back(get<1>(c));
+            nomes_produtos.push_back(get<2>(c));
+        }
+        for (int s = 0; s < config.sessoes; s++) {
+            const Cadastro &cadastro = cadastros[s % cadastros.size()];
+            tokens_compradores.push_back(marketplace.login(cadastro.email, cadastro.senha));
+        }
+        cout.clear();
+    }
+
+    public:
+    explicit GeradorCarga(const ConfigCarga &config) : config(config) {
+    }
+
+    ResultadoBench executar() {
+        ResultadoBench resultado;
+        resultado.config = config;
+        auto inicio = chrono::steady_clock::now();
+        popular();
+        resultado.segundos_populando = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+        Zipf popularidade(produtos.size(), config.zipf);
+        int n_threads = config.threads;
+        // Por thread: histograma de ciclos (FaixasLatencia) e falhas de cada tipo
+        vector<vector<vector<uint64_t>>> histogramas(n_threads, vector<vector<uint64_t>>(N_TIPOS, vector<uint64_t>(FaixasLatencia::N_FAIXAS, 0)));
+        vector<vector<long long>> falhas(n_threads, vector<long long>(N_TIPOS, 0));
+        vector<thread> threads;
+        uint64_t ciclos_inicio = Metricas::ciclos();
+        inicio = chrono::steady_clock::now();
+        for (int t = 0; t < n_threads; t++) {
+            threads.emplace_back([&, t]() {
+                mt19937_64 rng(config.semente * 7919 + t + 1);
+                long long n = config.operacoes / n_threads + (t < config.operacoes % n_threads);
+                for (long long i = 0; i < n; i++) {
+                    size_t popular = popularidade(rng);
+                    int produto_id = produtos[popular];
+                    const string &token = tokens_compradores[rng() % tokens_compradores.size()];
+                    bool escrita = (int)(rng() % 100) >= config.leitura;
+                    int sorteio = rng() % 10;
+                    int tipo = escrita ? (sorteio < 6 ? COMPRA : sorteio < 9 ? ESTOQUE : CARRINHO)
+                                       : (sorteio < 4 ? TOKEN : sorteio < 8 ? BUSCA : sorteio < 9 ? BUSCA_PRECO : MAIS_VENDIDOS);
+                    string texto;
+                    vector<pair<int, int>> itens;
+                    if (tipo == BUSCA) {
+                        texto = nomes_produtos[popular];
+                    }
+                    if (tipo == CARRINHO) {
+                        itens = {{produto_id, 1}, {produtos[popularidade(rng)], 1}, {produtos[popularidade(rng)], 1}};
+                    }
+                    bool falhou = false;
+                    uint64_t comeco = Metricas::ciclos();
+                    switch (tipo) {
+                        case COMPRA:
+                            falhou = marketplace.comprar_produto(token, produto_id, 1) == -1;
+                            break;
+                        case ESTOQUE: {
+                            int loja_id = lojas_dos_produtos[popular];
+                            falhou = marketplace.adicionar_estoque(tokens_donos[loja_id - 1], loja_id, produto_id, 1) == -1;
+                            break;
+                        }
+                        case CARRINHO:
+                            falhou = marketplace.comprar_carrinho(token, itens).empty();
+                            break;
+                        case TOKEN:
+                            falhou = marketplace.token_verify(token) == 0;
+                            break;
+                        case BUSCA:
+                            falhou = marketplace.buscar_produtos(texto).empty();
+                            break;
+                        case BUSCA_PRECO: {
+                            float minimo = 0.5f * (1 + rng() % 190);
+                            marketplace.ler_pagina_preco(minimo, minimo + 5, 0, 0, 20, [](const Pagina<Produto> &) {});
+                            break;
+                        }
+                        default:
+                            falhou = marketplace.mais_vendidos(10).empty();
+                    }
+                    histogramas[t][tipo][FaixasLatencia::faixa(Metricas::ciclos() - comeco)]++;
+                    falhas[t][tipo] += falhou;
+                }
+            });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        resultado.segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        uint64_t ciclos = Metricas::ciclos() - ciclos_inicio;
+        double ns_por_ciclo = ciclos ? resultado.segundos * 1e9 / ciclos : 1;
+        resultado.ops_por_segundo = config.operacoes / resultado.segundos;
+
+        for (int tipo = 0; tipo < N_TIPOS; tipo++) {
+            vector<uint64_t> soma(FaixasLatencia::N_FAIXAS, 0);
+            ResultadoBench::PorOperacao por_operacao;
+            for (int t = 0; t < n_threads; t++) {
+                for (int f = 0; f < FaixasLatencia::N_FAIXAS; f++) {
+                    soma[f] += histogramas[t][tipo][f];
+                    por_operacao.chamadas += histogramas[t][tipo][f];
+                }
+                por_operacao.falhas += falhas[t][tipo];
+            }
+            if (por_operacao.chamadas == 0) {
+                continue;
+            }
+            double *percentis[] = {&por_operacao.p50_ns, &por_operacao.p99_ns, &por_operacao.p999_ns, &por_operacao.maximo_ns};
+            double fracoes[] = {0.5, 0.99, 0.999, 1.0};
+            uint64_t acumulado = 0;
+            int p = 0;
+            for (int f = 0; f < FaixasLatencia::N_FAIXAS && p < 4; f++) {
+                acumulado += soma[f];
+                while (p < 4 && acumulado >= fracoes[p] * por_operacao.chamadas) {
+                    // O máximo é o fim da última faixa ocupada; os percentis, o meio da faixa
+                    double valor = p == 3 ? FaixasLatencia::fim(f) : (FaixasLatencia::inicio(f) + FaixasLatencia::fim(f)) / 2.0;
+                    *percentis[p++] = valor * ns_por_ciclo;
+                }
+            }
+            resultado.operacoes[nome(tipo)] = por_operacao;
+        }
+        return resultado;
+    }
+};
+
+#endif
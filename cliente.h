@@ -0,0 +1,233 @@
+/**
+ * @file cliente.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Cliente bloqueante do Servidor do Marketplace (protocolo.h)
+ *
+ * As chamadas síncronas (login, comprar_produto, ...) mandam uma requisição e esperam a
+ * resposta. Para mandar várias sem esperar (pipelining): iniciar() e os campos, terminar()
+ * para cada requisição, enviar() e depois receber() uma resposta por requisição, na ordem.
+ */
+
+#ifndef CLIENTE_H
+#define CLIENTE_H
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "protocolo.h"
+
+using namespace std;
+
+// Produto recebido do servidor
+class ProdutoRemoto {
+    public:
+    int id;
+    string nome;
+    float preco;
+    int quantidade;
+};
+
+class RespostaRemota {
+    public:
+    uint32_t id;
+    StatusResposta status;
+    LeitorMensagem campos; // Aponta para o buffer do cliente: válido até o próximo receber()
+};
+
+class ClienteMarketplace {
+    private:
+    int fd = -1;
+    uint32_t proximo_id = 1;
+    size_t inicio_requisicao = 0; // Onde começa, em saida, a requisição sendo montada
+    string saida;
+    string entrada;
+    size_t consumido = 0; // Quanto de entrada já foi entregue por receber()
+
+    void falhar(const string &etapa) {
+        throw runtime_error(etapa + ": " + strerror(errno));
+    }
+
+    RespostaRemota chamar() {
+        terminar();
+        enviar();
+        return receber();
+    }
+
+    public:
+    /**
+     * Conecta ao socket do servidor.
+     * @throws runtime_error se não conseguir conectar
+     */
+    explicit ClienteMarketplace(const string &caminho) {
+        sockaddr_un endereco{};
+        endereco.sun_family = AF_UNIX;
+        if (caminho.size() >= sizeof endereco.sun_path) {
+            errno = ENAMETOOLONG;
+            falhar("caminho do socket " + caminho);
+        }
+        memcpy(endereco.sun_path, caminho.c_str(), caminho.size() + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            falhar("socket");
+        }
+        if (connect(fd, (sockaddr *)&endereco, sizeof endereco) < 0) {
+            close(fd);
+            falhar("connect " + caminho);
+        }
+    }
+
+    ~ClienteMarketplace() {
+        close(fd);
+    }
+
+    ClienteMarketplace(const ClienteMarketplace &) = delete;
+    ClienteMarketplace &operator=(const ClienteMarketplace &) = delete;
+
+    /**
+     * Começa uma requisição; os campos são escritos no EscritorMensagem retornado.
+     */
+    EscritorMensagem iniciar(OperacaoRemota operacao) {
+        inicio_requisicao = saida.size();
+        EscritorMensagem e(saida);
+        e.i32(0).i32(proximo_id).u8((uint8_t)operacao);
+        return e;
+    }
+
+    /**
+     * Fecha a requisição começada em iniciar (ainda não manda).
+     * @return O id da requisição, que volta na resposta
+     */
+    uint32_t terminar() {
+        uint32_t tamanho = saida.size() - inicio_requisicao - 4;
+        memcpy(&saida[inicio_requisicao], &tamanho, 4);
+        return proximo_id++;
+    }
+
+    /**
+     * Manda as requisições terminadas.
+     * @throws runtime_error se a conexão caiu
+     */
+    void enviar() {
+        size_t enviado = 0;
+        while (enviado < saida.size()) {
+            ssize_t n = send(fd, saida.data() + enviado, saida.size() - enviado, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                falhar("send");
+            }
+            enviado += n;
+        }
+        saida.clear();
+    }
+
+    /**
+     * Espera a próxima resposta.
+     * @throws runtime_error se a conexão caiu
+     */
+    RespostaRemota receber() {
+        if (consumido > 0 && consumido == entrada.size()) {
+            entrada.clear();
+            consumido = 0;
+        }
+        for (;;) {
+            size_t disponivel = entrada.size() - consumido;
+            uint32_t tamanho = 0;
+            if (disponivel >= 4) {
+                memcpy(&tamanho, entrada.data() + consumido, 4);
+                if (tamanho < 5 || tamanho > MAX_MENSAGEM) {
+                    errno = EPROTO;
+                    falhar("resposta");
+                }
+                if (disponivel - 4 >= tamanho) {
+                    const char *p = entrada.data() + consumido;
+                    RespostaRemota resposta{0, (StatusResposta)p[8], LeitorMensagem(p + 9, tamanho - 5)};
+                    memcpy(&resposta.id, p + 4, 4);
+                    consumido += 4 + tamanho;
+                    return resposta;
+                }
+            }
+            if (consumido > 0) {
+                entrada.erase(0, consumido);
+                consumido = 0;
+            }
+            size_t antes = entrada.size(), bloco = max<size_t>(64 << 10, tamanho + 4 - disponivel);
+            entrada.resize(antes + bloco);
+            ssize_t n = recv(fd, &entrada[antes], bloco, 0);
+            entrada.resize(antes + max<ssize_t>(n, 0));
+            if (n == 0) {
+                errno = ECONNRESET;
+                falhar("recv");
+            }
+            if (n < 0 && errno != EINTR) {
+                falhar("recv");
+            }
+        }
+    }
+
+    bool me_cadastrar(const string &nome, const string &email, const string &senha) {
+        iniciar(OperacaoRemota::CADASTRO).str(nome).str(email).str(senha);
+        return chamar().campos.i32();
+    }
+
+    string login(const string &email, const string &senha) {
+        iniciar(OperacaoRemota::LOGIN).str(email).str(senha);
+        return string(chamar().campos.str());
+    }
+
+    int token_verify(const string &token) {
+        iniciar(OperacaoRemota::VERIFICA_TOKEN).str(token);
+        return chamar().campos.i32();
+    }
+
+    int criar_loja(const string &token, const string &nome) {
+        iniciar(OperacaoRemota::CRIAR_LOJA).str(token).str(nome);
+        return chamar().campos.i32();
+    }
+
+    int adicionar_produto(const string &token, int loja_id, const string &nome, float preco) {
+        iniciar(OperacaoRemota::ADICIONAR_PRODUTO).str(token).i32(loja_id).str(nome).f32(preco);
+        return chamar().campos.i32();
+    }
+
+    int adicionar_estoque(const string &token, int loja_id, int produto_id, int quantidade) {
+        iniciar(OperacaoRemota::ADICIONAR_ESTOQUE).str(token).i32(loja_id).i32(produto_id).i32(quantidade);
+        return chamar().campos.i32();
+    }
+
+    vector<ProdutoRemoto> buscar_produtos(const string &nome_parcial, int loja_id = 0) {
+        iniciar(OperacaoRemota::BUSCAR_PRODUTOS).str(nome_parcial).i32(loja_id);
+        LeitorMensagem r = chamar().campos;
+        vector<ProdutoRemoto> produtos(max(0, r.i32()));
+        for (auto &produto : produtos) {
+            produto.id = r.i32();
+            produto.nome = string(r.str());
+            produto.preco = r.f32();
+            produto.quantidade = r.i32();
+        }
+        return produtos;
+    }
+
+    int comprar_produto(const string &token, int produto_id, int quantidade) {
+        iniciar(OperacaoRemota::COMPRAR_PRODUTO).str(token).i32(produto_id).i32(quantidade);
+        return chamar().campos.i32();
+    }
+
+    long long quantidade_vendas() {
+        iniciar(OperacaoRemota::QUANTIDADE_VENDAS);
+        return chamar().campos.i64();
+    }
+
+    string metricas() {
+        iniciar(OperacaoRemota::METRICAS);
+        return string(chamar().campos.str());
+    }
+};
+
+#endif
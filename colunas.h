@@ -0,0 +1,408 @@
+/**
+ * @file colunas.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Catálogo de produtos em colunas, para varreduras por preço e estoque e para
+ * leituras sem trava de uma versão fixada (ver versoes.h)
+ *
+ */
+
+#ifndef COLUNAS_H
+#define COLUNAS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "nomes.h"
+#include "versoes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLUNAS_X86
+#endif
+
+using namespace std;
+
+/**
+ * Os campos numéricos dos produtos guardados em vetores separados (estrutura de
+ * vetores), indexados pelo id do produto. Uma varredura por preço lê só as colunas
+ * de preço, estoque e loja, 12 bytes por produto, em vez de passar por Loja::produtos
+ * e pelas strings dos nomes.
+ *
+ * A coluna de quantidade acompanha o Estoque de cada Produto: recebe as mesmas
+ * variações com incrementos atômicos. Uma varredura concorrente com compras pode ver
+ * o estoque de cada produto um pouco antes ou depois da compra, nunca um valor inventado.
+ *
+ * As colunas ficam em blocos que nunca mudam de lugar, então uma leitura fixada (fixar)
+ * lê sem trava enquanto o catálogo cresce. Loja e quantidade são versionadas: cada
+ * produto tem a época da última escrita e, havendo leituras fixadas, a primeira escrita
+ * depois da fixação guarda o estado anterior no HistoricoVersoes. Nome e preço não
+ * mudam depois de adicionar.
+ */
+class ColunasProdutos {
+    private:
+    static const size_t TAMANHO_BLOCO = 4096;
+    static const size_t MAX_BLOCOS = 1 << 16; // Até ~268 milhões de produtos
+    static const uint32_t RESERVADA = 1u << 31; // Época sendo trocada: o estado anterior está sendo guardado
+
+    struct Bloco {
+        int loja_id[TAMANHO_BLOCO] = {}; // 0: id sem produto
+        float preco[TAMANHO_BLOCO] = {};
+        int quantidade[TAMANHO_BLOCO] = {}; // Alterada com __atomic_*: leitores concorrentes não usam trava
+        uint32_t epoca[TAMANHO_BLOCO] = {}; // Época da última escrita em loja_id ou quantidade
+        Nome nome[TAMANHO_BLOCO];
+    };
+
+    Bloco **blocos; // Criados com a trava exclusiva do catálogo
+    size_t tamanho = 0;
+    EpocasLeitura epocas;
+    HistoricoVersoes historico;
+
+    /**
+     * Chamado antes de escrever loja ou quantidade: se há leituras fixadas e o produto
+     * ainda não foi escrito nesta época, guarda o estado atual com a época antiga. Entre
+     * escritas concorrentes do mesmo produto, só quem reserva a época guarda; as outras
+     * esperam a troca terminar.
+     */
+    void versionar(Bloco *b, size_t i, int produto_id) {
+        if (!epocas.ha_leitores()) {
+            return;
+        }
+        uint32_t g = epocas.epoca();
+        uint32_t atual = __atomic_load_n(&b->epoca[i], __ATOMIC_ACQUIRE);
+        while (atual != g) {
+            if (atual & RESERVADA) {
+                this_thread::yield();
+                atual = __atomic_load_n(&b->epoca[i], __ATOMIC_ACQUIRE);
+            } else if (__atomic_compare_exchange_n(&b->epoca[i], &atual, atual | RESERVADA, false,
+                                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                historico.guardar(produto_id, __atomic_load_n(&b->loja_id[i], __ATOMIC_RELAXED),
+                                  __atomic_load_n(&b->quantidade[i], __ATOMIC_RELAXED), atual);
+                __atomic_store_n(&b->epoca[i], g, __ATOMIC_RELEASE);
+                return;
+            }
+        }
+    }
+
+    // Filtra [inicio, fim) sem SIMD; também termina o que sobra das versões vetorizadas
+    static size_t filtrar_escalar(const float *preco, const int *quantidade, const int *loja,
+                                  float minimo, float maximo, int loja_id,
+                                  size_t inicio, size_t fim, int *saida) {
+        size_t n = 0;
+        for (size_t i = inicio; i < fim; i++) {
+            int q = __atomic_load_n(&quantidade[i], __ATOMIC_RELAXED);
+            if (preco[i] >= minimo && preco[i] <= maximo && q > 0
+                && (loja_id == 0 ? loja[i] != 0 : loja[i] == loja_id)) {
+                saida[n++] = i;
+            }
+        }
+        return n;
+    }
+
+#ifdef COLUNAS_X86
+    // Grava os índices dos bits ligados de mascara (8 pistas a partir de base)
+    static size_t escrever_bits(unsigned mascara, size_t base, int *saida) {
+        size_t n = 0;
+        while (mascara) {
+            saida[n++] = base + __builtin_ctz(mascara);
+            mascara &= mascara - 1;
+        }
+        return n;
+    }
+
+    static size_t filtrar_sse(const float *preco, const int *quantidade, const int *loja,
+                              float minimo, float maximo, int loja_id,
+                              size_t inicio, size_t fim, int *saida) {
+        const __m128 vmin = _mm_set1_ps(minimo), vmax = _mm_set1_ps(maximo);
+        const __m128i zero = _mm_setzero_si128(), vloja = _mm_set1_epi32(loja_id);
+        size_t n = 0, i = inicio;
+        for (; i + 4 <= fim; i += 4) {
+            __m128 p = _mm_loadu_ps(preco + i);
+            __m128 m = _mm_and_ps(_mm_cmpge_ps(p, vmin), _mm_cmple_ps(p, vmax));
+            if (_mm_movemask_ps(m) == 0) {
+                continue;
+            }
+            __m128i q = _mm_loadu_si128((const __m128i *)(quantidade + i));
+            __m128i l = _mm_loadu_si128((const __m128i *)(loja + i));
+            __m128i ml = loja_id == 0 ? _mm_xor_si128(_mm_cmpeq_epi32(l, zero), _mm_set1_epi32(-1))
+                                      : _mm_cmpeq_epi32(l, vloja);
+            m = _mm_and_ps(m, _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(q, zero), ml)));
+            n += escrever_bits(_mm_movemask_ps(m), i, saida + n);
+        }
+        return n + filtrar_escalar(preco, quantidade, loja, minimo, maximo, loja_id, i, fim, saida + n);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t filtrar_avx2(const float *preco, const int *quantidade, const int *loja,
+                               float minimo, float maximo, int loja_id,
+                               size_t inicio, size_t fim, int *saida) {
+        const __m256 vmin = _mm256_set1_ps(minimo), vmax = _mm256_set1_ps(maximo);
+        const __m256i zero = _mm256_setzero_si256(), vloja = _mm256_set1_epi32(loja_id);
+        size_t n = 0, i = inicio;
+        for (; i + 8 <= fim; i += 8) {
+            __m256 p = _mm256_loadu_ps(preco + i);
+            __m256 m = _mm256_and_ps(_mm256_cmp_ps(p, vmin, _CMP_GE_OQ), _mm256_cmp_ps(p, vmax, _CMP_LE_OQ));
+            if (_mm256_testz_ps(m, m)) {
+                continue; // Nenhum preço na faixa: não precisa ler estoque e loja
+            }
+            __m256i q = _mm256_loadu_si256((const __m256i *)(quantidade + i));
+            __m256i l = _mm256_loadu_si256((const __m256i *)(loja + i));
+            __m256i ml = loja_id == 0 ? _mm256_xor_si256(_mm256_cmpeq_epi32(l, zero), _mm256_set1_epi32(-1))
+                                      : _mm256_cmpeq_epi32(l, vloja);
+            m = _mm256_and_ps(m, _mm256_castsi256_ps(_mm256_and_si256(_mm256_cmpgt_epi32(q, zero), ml)));
+            n += escrever_bits(_mm256_movemask_ps(m), i, saida + n);
+        }
+        return n + filtrar_escalar(preco, quantidade, loja, minimo, maximo, loja_id, i, fim, saida + n);
+    }
+#endif
+
+    public:
+    static const size_t MAX_PRODUTOS = TAMANHO_BLOCO * MAX_BLOCOS;
+
+    enum Kernel { ESCALAR, SSE, AVX2 };
+
+    /**
+     * O melhor kernel disponível na máquina (decidido uma vez, em tempo de execução).
+     */
+    static Kernel kernel_disponivel() {
+#ifdef COLUNAS_X86
+        static const Kernel melhor = __builtin_cpu_supports("avx2") ? AVX2 : SSE;
+        return melhor;
+#else
+        return ESCALAR;
+#endif
+    }
+
+    ColunasProdutos() : blocos(new Bloco *[MAX_BLOCOS]()) {
+    }
+
+    ColunasProdutos(const ColunasProdutos &) = delete;
+    ColunasProdutos &operator=(const ColunasProdutos &) = delete;
+
+    ~ColunasProdutos() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            delete blocos[b];
+        }
+        delete[] blocos;
+    }
+
+    /**
+     * Cria as posições até produto_id (inclusive). Só com a trava exclusiva do catálogo.
+     * @return false (e nada muda) se produto_id está fora de [0, MAX_PRODUTOS)
+     */
+    bool adicionar(int produto_id, int loja, float valor, Nome nome = Nome()) {
+        if (produto_id < 0 || (size_t)produto_id >= MAX_PRODUTOS) {
+            return false;
+        }
+        Bloco *&b = blocos[produto_id / TAMANHO_BLOCO];
+        if (b == nullptr) {
+            b = new Bloco();
+        }
+        size_t i = produto_id % TAMANHO_BLOCO;
+        b->loja_id[i] = loja;
+        b->preco[i] = valor;
+        b->nome[i] = nome;
+        b->epoca[i] = epocas.epoca();
+        tamanho = max(tamanho, (size_t)produto_id + 1);
+        return true;
+    }
+
+    // Só com a trava exclusiva do catálogo
+    void mover(int produto_id, int loja) {
+        Bloco *b = blocos[produto_id / TAMANHO_BLOCO];
+        size_t i = produto_id % TAMANHO_BLOCO;
+        versionar(b, i, produto_id);
+        __atomic_store_n(&b->loja_id[i], loja, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Soma delta (que pode ser negativo) à quantidade. Pode ser chamado por várias threads.
+     */
+    void somar_quantidade(int produto_id, int delta) {
+        Bloco *b = blocos[produto_id / TAMANHO_BLOCO];
+        size_t i = produto_id % TAMANHO_BLOCO;
+        versionar(b, i, produto_id);
+        // release: quem lê a quantidade nova com acquire vê também a época nova (ver ler)
+        __atomic_fetch_add(&b->quantidade[i], delta, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Ids dos produtos com preço em [minimo, maximo] e quantidade > 0, em ordem crescente,
+     * procurando a partir do id inicio e parando quando a saída tiver limite ids.
+     * @param loja_id Restringe a essa loja; 0 para todas
+     * @return O id onde a varredura parou (continuar dele na próxima chamada),
+     * ou o tamanho do catálogo se chegou ao fim
+     */
+    size_t filtrar_preco(float minimo, float maximo, int loja_id, size_t inicio, size_t limite,
+                         vector<int> &saida, Kernel kernel = kernel_disponivel()) const {
+        // Varre bloco a bloco para não passar do limite nem alocar a saída para o catálogo inteiro
+        size_t fim_catalogo = tamanho;
+        vector<int> bloco(TAMANHO_BLOCO);
+        while (inicio < fim_catalogo && saida.size() < limite) {
+            const Bloco *b = blocos[inicio / TAMANHO_BLOCO];
+            size_t base = inicio - inicio % TAMANHO_BLOCO;
+            size_t de = inicio - base, ate = min(fim_catalogo - base, (size_t)TAMANHO_BLOCO);
+            size_t n;
+            switch (kernel) {
+#ifdef COLUNAS_X86
+                case AVX2:
+                    n = filtrar_avx2(b->preco, b->quantidade, b->loja_id, minimo, maximo, loja_id,
+                                     de, ate, bloco.data());
+                    break;
+                case SSE:
+                    n = filtrar_sse(b->preco, b->quantidade, b->loja_id, minimo, maximo, loja_id,
+                                    de, ate, bloco.data());
+                    break;
+#endif
+                default:
+                    n = filtrar_escalar(b->preco, b->quantidade, b->loja_id, minimo, maximo, loja_id,
+                                        de, ate, bloco.data());
+            }
+            for (size_t k = 0; k < n; k++) {
+                bloco[k] += base;
+            }
+            if (saida.size() + n > limite) {
+                n = limite - saida.size();
+                saida.insert(saida.end(), bloco.begin(), bloco.begin() + n);
+                return bloco[n - 1] + 1;
+            }
+            saida.insert(saida.end(), bloco.begin(), bloco.begin() + n);
+            inicio = base + ate;
+        }
+        return inicio;
+    }
+
+    size_t size() const {
+        return tamanho;
+    }
+
+    /**
+     * Fixa uma versão do catálogo para leitura sem trava (ver ler). Pega a trava exclusiva
+     * do catálogo por um instante, esperando as escritas em andamento, e chama junto()
+     * com ela presa (para ler outros tamanhos na mesma versão). Cada fixação precisa
+     * de um soltar.
+     * @return A época fixada
+     */
+    template <typename F>
+    uint32_t fixar(shared_mutex &trava_catalogo, F junto) {
+        lock_guard<mutex> trava(epocas.trava);
+        unique_lock<shared_mutex> trava_c(trava_catalogo);
+        junto();
+        return epocas.fixar();
+    }
+
+    /**
+     * Solta a época fixada e libera as versões que ficaram sem leitores.
+     */
+    void soltar(uint32_t epoca) {
+        lock_guard<mutex> trava(epocas.trava);
+        epocas.soltar(epoca);
+        historico.coletar(epocas.menor());
+    }
+
+    /**
+     * Loja e quantidade do produto na época fixada, sem trava. Só para ids menores que o
+     * size() lido ao fixar.
+     * @return false se o id não tinha produto
+     */
+    bool ler(int produto_id, uint32_t epoca, int &loja_id, int &quantidade) const {
+        const Bloco *b = blocos[produto_id / TAMANHO_BLOCO];
+        size_t i = produto_id % TAMANHO_BLOCO;
+        for (;;) {
+            uint32_t e = __atomic_load_n(&b->epoca[i], __ATOMIC_ACQUIRE);
+            if (e & RESERVADA) {
+                this_thread::yield();
+                continue;
+            }
+            if (e > epoca) {
+                historico.ler(produto_id, epoca, loja_id, quantidade);
+                break;
+            }
+            loja_id = __atomic_load_n(&b->loja_id[i], __ATOMIC_ACQUIRE);
+            quantidade = __atomic_load_n(&b->quantidade[i], __ATOMIC_ACQUIRE);
+            // Se a época não mudou no meio, nenhuma escrita depois da fixação foi vista
+            if (__atomic_load_n(&b->epoca[i], __ATOMIC_ACQUIRE) == e) {
+                break;
+            }
+        }
+        return loja_id != 0;
+    }
+
+    Nome nome(int produto_id) const {
+        return blocos[produto_id / TAMANHO_BLOCO]->nome[produto_id % TAMANHO_BLOCO];
+    }
+
+    float preco(int produto_id) const {
+        return blocos[produto_id / TAMANHO_BLOCO]->preco[produto_id % TAMANHO_BLOCO];
+    }
+};
+
+/**
+ * Nome e dono das lojas por id, em blocos que não mudam de lugar (nada muda depois de
+ * criar a loja): uma leitura fixada lê as lojas com id menor que o size() lido ao fixar.
+ */
+class ColunasLojas {
+    private:
+    static const size_t TAMANHO_BLOCO = 1024;
+    static const size_t MAX_BLOCOS = 1 << 16;
+
+    struct Bloco {
+        Nome nome[TAMANHO_BLOCO];
+        int proprietario_id[TAMANHO_BLOCO] = {}; // 0: id sem loja
+    };
+
+    Bloco **blocos;
+    size_t tamanho = 0;
+
+    public:
+    static const size_t MAX_LOJAS = TAMANHO_BLOCO * MAX_BLOCOS;
+
+    ColunasLojas() : blocos(new Bloco *[MAX_BLOCOS]()) {
+    }
+
+    ColunasLojas(const ColunasLojas &) = delete;
+    ColunasLojas &operator=(const ColunasLojas &) = delete;
+
+    ~ColunasLojas() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            delete blocos[b];
+        }
+        delete[] blocos;
+    }
+
+    // Só com a trava exclusiva do catálogo. False (e nada muda) se loja_id está fora de [0, MAX_LOJAS)
+    bool adicionar(int loja_id, int proprietario_id, Nome nome) {
+        if (loja_id < 0 || (size_t)loja_id >= MAX_LOJAS) {
+            return false;
+        }
+        Bloco *&b = blocos[loja_id / TAMANHO_BLOCO];
+        if (b == nullptr) {
+            b = new Bloco();
+        }
+        b->nome[loja_id % TAMANHO_BLOCO] = nome;
+        b->proprietario_id[loja_id % TAMANHO_BLOCO] = proprietario_id;
+        tamanho = max(tamanho, (size_t)loja_id + 1);
+        return true;
+    }
+
+    // 0 se o id não tem loja
+    int proprietario(int loja_id) const {
+        const Bloco *b = blocos[loja_id / TAMANHO_BLOCO];
+        return b ? b->proprietario_id[loja_id % TAMANHO_BLOCO] : 0;
+    }
+
+    Nome nome(int loja_id) const {
+        return blocos[loja_id / TAMANHO_BLOCO]->nome[loja_id % TAMANHO_BLOCO];
+    }
+
+    size_t size() const {
+        return tamanho;
+    }
+};
+
+#endif
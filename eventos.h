@@ -0,0 +1,257 @@
+/**
+ * @file eventos.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Fluxo de eventos das alterações do catálogo (lojas, produtos, estoque e vendas)
+ * para quem mantém uma cópia fora do Marketplace
+ *
+ * Cada assinante tem a sua fila circular limitada, sem trava. Os eventos tem um número de
+ * sequência global e contínuo: o assinante percebe o que perdeu pelos buracos na sequência
+ * e retoma de uma VistaCatalogo (que diz até que sequência já está incluída).
+ */
+
+#ifndef EVENTOS_H
+#define EVENTOS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "nomes.h"
+
+using namespace std;
+
+enum class TipoEvento : uint8_t {
+    LOJA_CRIADA,
+    PRODUTO_ADICIONADO,
+    ESTOQUE_ALTERADO, // adicionar_estoque
+    PRODUTO_TRANSFERIDO,
+    VENDA_CRIADA, // comprar_produto e comprar_carrinho (o estoque cai em quantidade)
+};
+
+class Evento {
+    public:
+    uint64_t sequencia = 0;
+    TipoEvento tipo = TipoEvento::LOJA_CRIADA;
+    int loja_id = 0; // Loja do produto; na transferência, a de destino
+    int produto_id = -1; // -1 em LOJA_CRIADA
+    int loja_origem_id = 0; // PRODUTO_TRANSFERIDO
+    int usuario_id = 0; // Dono em LOJA_CRIADA, comprador em VENDA_CRIADA
+    int venda_id = -1; // VENDA_CRIADA
+    int quantidade = 0; // Unidades repostas (ESTOQUE_ALTERADO) ou vendidas (VENDA_CRIADA)
+    int estoque = 0; // ESTOQUE_ALTERADO: o estoque logo depois da reposição
+    float preco = 0; // Preço do produto adicionado, ou preço unitário da venda
+    int64_t instante = 0; // VENDA_CRIADA
+    Nome nome; // LOJA_CRIADA e PRODUTO_ADICIONADO (texto no PoolNomes do Marketplace)
+};
+
+/**
+ * O que fazer quando a fila de um assinante enche.
+ */
+enum class PoliticaEventos {
+    // Os eventos mais antigos são sobrescritos: as escritas nunca esperam, e o assinante
+    // atrasado vê um buraco na sequência (e perdidos() cresce)
+    DESCARTAR_ANTIGOS,
+    // As escritas esperam o assinante abrir espaço. O assinante não pode depender de
+    // escritas no Marketplace (nem de vista()) para esvaziar a fila, ou todos travam
+    ESPERAR,
+};
+
+class CanalEventos;
+
+/**
+ * A fila de um assinante, criada por CanalEventos::assinar. Recebe os eventos com
+ * sequência a partir da assinatura. Só uma thread deve chamar receber.
+ */
+class AssinaturaEventos {
+    private:
+    // Marca de uma posição sendo escrita (as outras marcas são a posição relativa + 1)
+    static const uint64_t ESCREVENDO = UINT64_MAX;
+
+    struct Posicao {
+        atomic<uint64_t> marca{0}; // 0: nunca escrita
+        Evento evento;
+    };
+
+    CanalEventos *canal;
+    const PoliticaEventos politica;
+    const uint64_t base; // Sequência do primeiro evento da assinatura
+    const size_t capacidade;
+    unique_ptr<Posicao[]> posicoes;
+    atomic<uint64_t> lidos{0}; // Posição relativa do próximo evento a entregar
+    atomic<uint64_t> perdidos_{0};
+    atomic<bool> cancelada{false};
+
+    friend class CanalEventos;
+
+    AssinaturaEventos(CanalEventos *canal, PoliticaEventos politica, uint64_t base, size_t capacidade)
+        : canal(canal), politica(politica), base(base), capacidade(capacidade),
+          posicoes(new Posicao[capacidade]) {
+    }
+
+    // Chamado pelas escritas, com a trava do catálogo (compartilhada ou exclusiva)
+    void escrever(const Evento &evento) {
+        uint64_t r = evento.sequencia - base;
+        Posicao &p = posicoes[r & (capacidade - 1)];
+        if (politica == PoliticaEventos::ESPERAR) {
+            while (r >= lidos.load(memory_order_acquire) + capacidade) {
+                if (cancelada.load(memory_order_relaxed)) return;
+                this_thread::yield();
+            }
+        }
+        // A escrita da volta anterior nessa posição precisa ter terminado
+        uint64_t anterior = r >= capacidade ? r - capacidade + 1 : 0;
+        while (p.marca.load(memory_order_acquire) != anterior) {
+            this_thread::yield();
+        }
+        p.marca.store(ESCREVENDO, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy((void *)&p.evento, &evento, sizeof evento);
+        p.marca.store(r + 1, memory_order_release);
+    }
+
+    public:
+    ~AssinaturaEventos();
+
+    AssinaturaEventos(const AssinaturaEventos &) = delete;
+    AssinaturaEventos &operator=(const AssinaturaEventos &) = delete;
+
+    /**
+     * Tira até maximo eventos da fila, em ordem de sequência, sem esperar.
+     * Com DESCARTAR_ANTIGOS, os eventos sobrescritos são pulados (ver perdidos).
+     * @return Quantos eventos foram colocados em lote (que é limpo antes)
+     */
+    size_t receber(vector<Evento> &lote, size_t maximo) {
+        lote.clear();
+        uint64_t r = lidos.load(memory_order_relaxed);
+        while (lote.size() < maximo) {
+            Posicao &p = posicoes[r & (capacidade - 1)];
+            uint64_t marca = p.marca.load(memory_order_acquire);
+            if (marca == r + 1) {
+                Evento evento;
+                memcpy((void *)&evento, (const void *)&p.evento, sizeof evento);
+                atomic_thread_fence(memory_order_acquire);
+                if (p.marca.load(memory_order_relaxed) == r + 1) {
+                    lote.push_back(evento);
+                    r++;
+                }
+                // Senão foi sobrescrito durante a cópia: a próxima volta pula
+            } else if (marca != ESCREVENDO && marca > r + 1) {
+                // Sobrescrito: continua do mais antigo que ainda pode estar na fila
+                uint64_t novo = marca - capacidade;
+                perdidos_.fetch_add(novo - r, memory_order_relaxed);
+                r = novo;
+            } else {
+                break; // Ainda não escrito
+            }
+        }
+        lidos.store(r, memory_order_release);
+        return lote.size();
+    }
+
+    /**
+     * Sequência do próximo evento que receber vai entregar.
+     */
+    uint64_t proxima_sequencia() const {
+        return base + lidos.load(memory_order_relaxed);
+    }
+
+    /**
+     * Eventos sobrescritos antes de serem recebidos (só com DESCARTAR_ANTIGOS).
+     */
+    uint64_t perdidos() const {
+        return perdidos_.load(memory_order_relaxed);
+    }
+};
+
+/**
+ * Distribui os eventos para as assinaturas. As escritas publicam com a trava do catálogo
+ * (compartilhada ou exclusiva), e assinar e cancelar pegam a trava exclusiva: a lista de
+ * assinantes não muda durante uma publicação. Sem assinantes, publicar não faz nada e a
+ * sequência não avança.
+ *
+ * A sequência segue a ordem em que as escritas publicam. Reposições e vendas de threads
+ * diferentes podem publicar numa ordem diferente da que alteraram o estoque; aplicadas
+ * pelas quantidades (que comutam), a cópia chega ao mesmo estoque.
+ */
+class CanalEventos {
+    private:
+    shared_mutex &trava_catalogo;
+    vector<AssinaturaEventos *> assinantes;
+    atomic<uint64_t> proxima{0};
+
+    public:
+    explicit CanalEventos(shared_mutex &trava_catalogo) : trava_catalogo(trava_catalogo) {
+    }
+
+    CanalEventos(const CanalEventos &) = delete;
+    CanalEventos &operator=(const CanalEventos &) = delete;
+
+    /**
+     * Cria uma assinatura que recebe os eventos publicados a partir de agora.
+     * @param capacidade Tamanho da fila (arredondado para potência de 2)
+     */
+    unique_ptr<AssinaturaEventos> assinar(size_t capacidade, PoliticaEventos politica) {
+        size_t potencia = 1;
+        while (potencia < capacidade) {
+            potencia *= 2;
+        }
+        unique_lock<shared_mutex> trava(trava_catalogo);
+        unique_ptr<AssinaturaEventos> assinatura(
+            new AssinaturaEventos(this, politica, proxima.load(memory_order_relaxed), potencia));
+        assinantes.push_back(assinatura.get());
+        return assinatura;
+    }
+
+    // Chamado pelo destrutor da assinatura
+    void cancelar(AssinaturaEventos *assinatura) {
+        // Libera as escritas que esperam essa fila antes de pegar a trava que elas seguram
+        assinatura->cancelada.store(true, memory_order_relaxed);
+        unique_lock<shared_mutex> trava(trava_catalogo);
+        assinantes.erase(find(assinantes.begin(), assinantes.end(), assinatura));
+    }
+
+    // Com a trava do catálogo
+    bool ativo() const {
+        return !assinantes.empty();
+    }
+
+    /**
+     * Numera os eventos com sequências consecutivas (um incremento atômico para o lote)
+     * e entrega a cada assinatura. Com a trava do catálogo.
+     */
+    void publicar(Evento *eventos, size_t n) {
+        if (assinantes.empty() || n == 0) {
+            return;
+        }
+        uint64_t primeira = proxima.fetch_add(n, memory_order_relaxed);
+        for (size_t i = 0; i < n; i++) {
+            eventos[i].sequencia = primeira + i;
+        }
+        for (AssinaturaEventos *assinatura : assinantes) {
+            for (size_t i = 0; i < n; i++) {
+                assinatura->escrever(eventos[i]);
+            }
+        }
+    }
+
+    /**
+     * A sequência do próximo evento. Com a trava exclusiva do catálogo, todos os eventos
+     * anteriores já estão no estado.
+     */
+    uint64_t sequencia() const {
+        return proxima.load(memory_order_relaxed);
+    }
+};
+
+inline AssinaturaEventos::~AssinaturaEventos() {
+    canal->cancelar(this);
+}
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * @file importacao.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Leitura em paralelo de arquivos de produtos para Marketplace::importar_produtos
+ *
+ * Formatos (decidido pelo primeiro caractere do arquivo):
+ *  - JSONL: {"loja": id, "nome": ..., "preco": x, "quantidade": n} por linha (quantidade opcional)
+ *  - CSV: loja,nome,preco,quantidade por linha. Uma primeira linha que não começa com número
+ *    é o cabeçalho. O nome pode vir entre aspas, com "" para uma aspa dentro dele.
+ *
+ * O arquivo é mapeado com mmap e dividido em pedaços terminados em fim de linha, um por
+ * thread. Os nomes não são copiados (apontam para o arquivo), a não ser os que tem escapes.
+ */
+
+#ifndef IMPORTACAO_H
+#define IMPORTACAO_H
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "indice_busca.h"
+#include "json.h"
+
+using namespace std;
+
+class LinhaImportacao {
+    public:
+    int loja_id = 0;
+    string_view nome;
+    float preco = 0;
+    int quantidade = 0;
+};
+
+class ResultadoImportacao {
+    public:
+    long long linhas = 0; // Não vazias, sem o cabeçalho
+    long long importados = 0;
+    long long invalidas = 0; // Fora do formato, ou com quantidade negativa
+    long long recusadas = 0; // De lojas que não existem ou não são do usuário, ou que não cabem no catálogo
+    int primeiro_id = -1; // Os importados tem os ids de primeiro_id a primeiro_id + importados - 1
+    double segundos = 0;
+};
+
+// As linhas de um pedaço do arquivo, lidas por uma thread
+class PedacoImportacao {
+    public:
+    vector<LinhaImportacao> linhas;
+    deque<string> decodificados; // Nomes com escapes (endereços estáveis); os outros apontam para o arquivo
+    long long n_linhas = 0;
+    long long invalidas = 0;
+    IndiceTrigramas::Parcial indice; // Ids relativos ao primeiro produto do pedaço
+};
+
+/**
+ * Arquivo mapeado somente para leitura enquanto o objeto existir.
+ */
+class ArquivoMapeado {
+    private:
+    void *inicio = nullptr;
+    size_t tamanho = 0;
+
+    public:
+    /**
+     * @throws runtime_error se o arquivo não puder ser lido
+     */
+    explicit ArquivoMapeado(const string &caminho) {
+        int fd = ::open(caminho.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("não foi possível abrir " + caminho);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw runtime_error("não foi possível ler " + caminho);
+        }
+        tamanho = st.st_size;
+        if (tamanho > 0) {
+            inicio = mmap(nullptr, tamanho, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (inicio == MAP_FAILED) {
+            throw runtime_error("não foi possível mapear " + caminho);
+        }
+    }
+
+    ~ArquivoMapeado() {
+        if (tamanho > 0) {
+            munmap(inicio, tamanho);
+        }
+    }
+
+    ArquivoMapeado(const ArquivoMapeado &) = delete;
+    ArquivoMapeado &operator=(const ArquivoMapeado &) = delete;
+
+    string_view dados() const {
+        return string_view((const char *)inicio, tamanho);
+    }
+};
+
+class LeitorProdutos {
+    private:
+    template <typename T>
+    static bool numero(string_view texto, T &valor) {
+        while (!texto.empty() && (texto.front() == ' ' || texto.front() == '\t')) texto.remove_prefix(1);
+        while (!texto.empty() && (texto.back() == ' ' || texto.back() == '\t' || texto.back() == '\r')) texto.remove_suffix(1);
+        return !texto.empty() && from_chars(texto.data(), texto.data() + texto.size(), valor).ptr == texto.data() + texto.size();
+    }
+
+    // Próximo campo de uma linha CSV a partir de p; avança p para depois da vírgula
+    static bool campo_csv(string_view linha, size_t &p, string_view &valor, PedacoImportacao &pedaco) {
+        if (p > linha.size()) {
+            return false;
+        }
+        if (p < linha.size() && linha[p] == '"') {
+            size_t fim = linha.find('"', p + 1);
+            if (fim == string_view::npos) {
+                return false;
+            }
+            if (fim + 1 < linha.size() && linha[fim + 1] == '"') {
+                // Aspas duplicadas: decodifica numa cópia
+                string texto;
+                size_t q = p + 1;
+                for (;;) {
+                    fim = linha.find('"', q);
+                    if (fim == string_view::npos) {
+                        return false;
+                    }
+                    texto.append(linha.substr(q, fim - q));
+                    if (fim + 1 < linha.size() && linha[fim + 1] == '"') {
+                        texto += '"';
+                        q = fim + 2;
+                    } else {
+                        break;
+                    }
+                }
+                pedaco.decodificados.push_back(move(texto));
+                valor = pedaco.decodificados.back();
+            } else {
+                valor = linha.substr(p + 1, fim - p - 1);
+            }
+            p = fim + 1;
+            if (p < linha.size() && linha[p] != ',') {
+                return false;
+            }
+            p++;
+            return true;
+        }
+        size_t fim = linha.find(',', p);
+        if (fim == string_view::npos) {
+            fim = linha.size();
+        }
+        valor = linha.substr(p, fim - p);
+        p = fim + 1;
+        return true;
+    }
+
+    static bool ler_csv(string_view linha, LinhaImportacao &saida, PedacoImportacao &pedaco) {
+        string_view loja, preco, quantidade;
+        size_t p = 0;
+        return campo_csv(linha, p, loja, pedaco) && campo_csv(linha, p, saida.nome, pedaco)
+            && campo_csv(linha, p, preco, pedaco) && campo_csv(linha, p, quantidade, pedaco)
+            && p > linha.size() && numero(loja, saida.loja_id) && numero(preco, saida.preco)
+            && numero(quantidade, saida.quantidade);
+    }
+
+    static bool ler_jsonl(string_view linha, ObjetoJson &objeto, LinhaImportacao &saida, PedacoImportacao &pedaco) {
+        if (!objeto.ler(linha) || !objeto.tem("loja") || !objeto.tem("nome") || !objeto.tem("preco")) {
+            return false;
+        }
+        saida.nome = objeto.texto("nome");
+        if (saida.nome.data() < linha.data() || saida.nome.data() >= linha.data() + linha.size()) {
+            // Nome com escapes: o objeto reaproveita o buffer na próxima linha
+            pedaco.decodificados.emplace_back(saida.nome);
+            saida.nome = pedaco.decodificados.back();
+        }
+        return numero(objeto.texto("loja"), saida.loja_id) && numero(objeto.texto("preco"), saida.preco)
+            && (!objeto.tem("quantidade") || numero(objeto.texto("quantidade"), saida.quantidade));
+    }
+
+    static void ler_pedaco(string_view dados, bool jsonl, PedacoImportacao &pedaco) {
+        ObjetoJson objeto;
+        size_t p = 0;
+        while (p < dados.size()) {
+            size_t fim = dados.find('\n', p);
+            if (fim == string_view::npos) {
+                fim = dados.size();
+            }
+            string_view linha = dados.substr(p, fim - p);
+            p = fim + 1;
+            if (!linha.empty() && linha.back() == '\r') {
+                linha.remove_suffix(1);
+            }
+            if (linha.empty()) {
+                continue;
+            }
+            pedaco.n_linhas++;
+            LinhaImportacao lida;
+            bool ok = jsonl ? ler_jsonl(linha, objeto, lida, pedaco) : ler_csv(linha, lida, pedaco);
+            if (ok && lida.quantidade >= 0 && isfinite(lida.preco)) {
+                pedaco.linhas.push_back(lida);
+            } else {
+                pedaco.invalidas++;
+            }
+        }
+    }
+
+    // Roda f(i) para i em [0, n) em n threads (na própria thread se n == 1)
+    template <typename F>
+    static void em_paralelo(size_t n, F f) {
+        if (n == 1) {
+            f(0);
+            return;
+        }
+        vector<thread> threads;
+        for (size_t i = 0; i < n; i++) {
+            threads.emplace_back(f, i);
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    public:
+    /**
+     * Lê o arquivo inteiro em n_threads pedaços, em paralelo. Os pedaços vem na ordem do arquivo.
+     */
+    static vector<PedacoImportacao> ler(string_view dados, unsigned n_threads) {
+        size_t i = dados.find_first_not_of(" \t\r\n");
+        bool jsonl = i != string_view::npos && dados[i] == '{';
+        if (!jsonl && !dados.empty() && !isdigit((unsigned char)dados[0]) && dados[0] != '-' && dados[0] != '"') {
+            // Cabeçalho do CSV
+            size_t fim = dados.find('\n');
+            dados.remove_prefix(fim == string_view::npos ? dados.size() : fim + 1);
+        }
+        // Limites dos pedaços, avançados até o próximo fim de linha
+        vector<size_t> limites(1, 0);
+        for (unsigned t = 1; t < n_threads; t++) {
+            size_t limite = max(limites.back(), dados.size() * t / n_threads);
+            size_t fim = dados.find('\n', limite);
+            limites.push_back(fim == string_view::npos ? dados.size() : fim + 1);
+        }
+        limites.push_back(dados.size());
+        vector<PedacoImportacao> pedacos(n_threads);
+        em_paralelo(n_threads, [&](size_t t) {
+            ler_pedaco(dados.substr(limites[t], limites[t + 1] - limites[t]), jsonl, pedacos[t]);
+        });
+        return pedacos;
+    }
+
+    /**
+     * Monta em paralelo o índice de busca parcial de cada pedaço (ids relativos ao
+     * primeiro produto do pedaço), para juntar no IndiceTrigramas depois.
+     */
+    static void indexar(vector<PedacoImportacao> &pedacos) {
+        em_paralelo(pedacos.size(), [&](size_t t) {
+            vector<uint32_t> tris;
+            PedacoImportacao &pedaco = pedacos[t];
+            for (size_t i = 0; i < pedaco.linhas.size(); i++) {
+                IndiceTrigramas::indexar(pedaco.indice, i, pedaco.linhas[i].nome, tris);
+            }
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * @file indice_busca.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Índice invertido de trigramas para busca por parte do nome
+ *
+ */
+
+#ifndef INDICE_BUSCA_H
+#define INDICE_BUSCA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Para cada trigrama (3 bytes consecutivos do nome) guarda a lista ordenada
+ * dos ids que o contêm. Uma consulta com 3 bytes ou mais só precisa conferir
+ * os ids presentes na interseção das listas dos seus trigramas; a conferência
+ * final com string::find continua sendo do chamador, o que mantém exatamente
+ * a mesma semântica (inclusive maiúsculas/minúsculas e bytes UTF-8).
+ */
+class IndiceTrigramas {
+    private:
+    unordered_map<uint32_t, vector<int>> listas; // Chave: trigrama, Valor: ids ordenados
+    size_t total_ids = 0;
+
+    static uint32_t trigrama(const char *texto) {
+        return ((uint32_t)(unsigned char)texto[0] << 16)
+            | ((uint32_t)(unsigned char)texto[1] << 8)
+            | (uint32_t)(unsigned char)texto[2];
+    }
+
+    public:
+    static const size_t TAMANHO_MINIMO = 3;
+
+    // Índice montado à parte (por exemplo em paralelo e sem trava) para juntar() depois:
+    // trigrama -> ids em ordem crescente
+    typedef unordered_map<uint32_t, vector<int>> Parcial;
+
+    /**
+     * Trigramas distintos do texto, em ordem crescente.
+     */
+    static void trigramas(const char *texto, size_t tamanho, vector<uint32_t> &saida) {
+        saida.clear();
+        for (size_t i = 0; i + 3 <= tamanho; i++) {
+            saida.push_back(trigrama(texto + i));
+        }
+        sort(saida.begin(), saida.end());
+        saida.erase(unique(saida.begin(), saida.end()), saida.end());
+    }
+
+    /**
+     * Interseção de listas ordenadas [inicio, fim), começando pela menor.
+     */
+    static void intersectar(vector<pair<const int *, const int *>> usadas, vector<int> &saida) {
+        saida.clear();
+        if (usadas.empty()) {
+            return;
+        }
+        sort(usadas.begin(), usadas.end(), [](const pair<const int *, const int *> &a,
+                                              const pair<const int *, const int *> &b) {
+            return a.second - a.first < b.second - b.first;
+        });
+        saida.assign(usadas[0].first, usadas[0].second);
+        vector<int> temporario;
+        for (size_t i = 1; i < usadas.size() && !saida.empty(); i++) {
+            const int *inicio = usadas[i].first, *fim = usadas[i].second;
+            temporario.clear();
+            if (saida.size() * 16 < (size_t)(fim - inicio)) {
+                // Lista muito maior: busca binária de cada candidato
+                for (int id : saida) {
+                    inicio = lower_bound(inicio, fim, id);
+                    if (inicio == fim) break;
+                    if (*inicio == id) temporario.push_back(id);
+                }
+            } else {
+                set_intersection(saida.begin(), saida.end(), inicio, fim, back_inserter(temporario));
+            }
+            saida.swap(temporario);
+        }
+    }
+
+    /**
+     * Indexa o texto sob esse id. Cada id deve ser indexado uma única vez.
+     */
+    void adicionar(int id, string_view texto) {
+        vector<uint32_t> tris;
+        trigramas(texto.data(), texto.size(), tris);
+        for (uint32_t t : tris) {
+            vector<int> &lista = listas[t];
+            // Ids normalmente chegam em ordem crescente
+            if (lista.empty() || lista.back() < id) {
+                lista.push_back(id);
+            } else {
+                lista.insert(lower_bound(lista.begin(), lista.end(), id), id);
+            }
+        }
+        total_ids++;
+    }
+
+    /**
+     * Indexa o texto sob esse id num índice parcial. Os ids devem vir em ordem crescente.
+     * @param tris Espaço de trabalho, reaproveitado entre as chamadas
+     */
+    static void indexar(Parcial &parcial, int id, string_view texto, vector<uint32_t> &tris) {
+        trigramas(texto.data(), texto.size(), tris);
+        for (uint32_t t : tris) {
+            parcial[t].push_back(id);
+        }
+    }
+
+    /**
+     * Junta um índice parcial somando deslocamento aos ids dele, que depois disso
+     * precisam ser maiores que os já indexados. O parcial é esvaziado.
+     * @param n_ids Quantos ids o parcial indexa
+     */
+    void juntar(Parcial &parcial, int deslocamento, size_t n_ids) {
+        for (auto &i : parcial) {
+            vector<int> &lista = listas[i.first];
+            size_t antes = lista.size();
+            if (antes == 0) {
+                lista.swap(i.second);
+            } else {
+                lista.insert(lista.end(), i.second.begin(), i.second.end());
+            }
+            for (size_t k = antes; k < lista.size(); k++) {
+                lista[k] += deslocamento;
+            }
+        }
+        parcial.clear();
+        total_ids += n_ids;
+    }
+
+    /**
+     * Ids cujo texto pode conter a consulta (superconjunto do resultado), em ordem crescente.
+     * @return false caso a consulta seja curta demais para o índice;
+     * nesse caso o chamador precisa percorrer tudo
+     */
+    bool candidatos(const string &consulta, vector<int> &saida) const {
+        saida.clear();
+        if (consulta.size() < TAMANHO_MINIMO) {
+            return false;
+        }
+        vector<uint32_t> tris;
+        trigramas(consulta.data(), consulta.size(), tris);
+        vector<pair<const int *, const int *>> usadas;
+        for (uint32_t t : tris) {
+            auto it = listas.find(t);
+            if (it == listas.end()) {
+                return true; // Algum trigrama não aparece em nenhum nome
+            }
+            usadas.push_back(make_pair(it->second.data(), it->second.data() + it->second.size()));
+        }
+        intersectar(usadas, saida);
+        return true;
+    }
+
+    /**
+     * Chama f(id) para os mesmos candidatos de candidatos(), só os a partir de a_partir_de,
+     * em ordem crescente, até f retornar false. A interseção é feita aos poucos: a menor
+     * lista propõe um id e as outras avançam até ele por busca binária. Parar cedo custa
+     * só os candidatos percorridos (vezes o log das listas), não a interseção inteira.
+     * @return false caso a consulta seja curta demais para o índice
+     */
+    template <typename F>
+    bool percorrer(const string &consulta, int a_partir_de, F f) const {
+        if (consulta.size() < TAMANHO_MINIMO) {
+            return false;
+        }
+        vector<uint32_t> tris;
+        trigramas(consulta.data(), consulta.size(), tris);
+        vector<pair<const int *, const int *>> usadas;
+        for (uint32_t t : tris) {
+            auto it = listas.find(t);
+            if (it == listas.end()) {
+                return true;
+            }
+            const int *inicio = it->second.data(), *fim = inicio + it->second.size();
+            usadas.push_back(make_pair(lower_bound(inicio, fim, a_partir_de), fim));
+        }
+        sort(usadas.begin(), usadas.end(), [](const pair<const int *, const int *> &a,
+                                              const pair<const int *, const int *> &b) {
+            return a.second - a.first < b.second - b.first;
+        });
+        auto &menor = usadas[0];
+        while (menor.first != menor.second) {
+            int id = *menor.first;
+            size_t i = 1;
+            for (; i < usadas.size(); i++) {
+                auto &lista = usadas[i];
+                lista.first = lower_bound(lista.first, lista.second, id);
+                if (lista.first == lista.second) {
+                    return true;
+                }
+                if (*lista.first != id) {
+                    break;
+                }
+            }
+            if (i < usadas.size()) {
+                // Pula direto para o próximo id que a outra lista pode ter
+                menor.first = lower_bound(menor.first, menor.second, *usadas[i].first);
+            } else {
+                if (!f(id)) {
+                    return true;
+                }
+                menor.first++;
+            }
+        }
+        return true;
+    }
+
+    size_t size() const {
+        return total_ids;
+    }
+};
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file json.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Leitura sem cópia de objetos JSON planos, uma linha por objeto (JSONL)
+ *
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * Um objeto JSON plano (valores texto, número, true/false/null) lido sem copiar:
+ * chaves e valores são string_views para dentro da linha, que precisa continuar
+ * existindo. Só textos com escapes (\n, \", é...) são decodificados para um
+ * buffer próprio.
+ */
+class ObjetoJson {
+    public:
+    static const int MAX_CAMPOS = 16;
+
+    private:
+    struct Campo {
+        string_view chave;
+        string_view valor;
+    };
+
+    Campo campos[MAX_CAMPOS];
+    int n_campos = 0;
+    string decodificados[MAX_CAMPOS];
+
+    static const char *espacos(const char *p, const char *fim) {
+        while (p < fim && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            p++;
+        }
+        return p;
+    }
+
+    static void utf8(string &saida, uint32_t c) {
+        if (c < 0x80) {
+            saida += (char)c;
+        } else if (c < 0x800) {
+            saida += (char)(0xc0 | c >> 6);
+            saida += (char)(0x80 | (c & 0x3f));
+        } else {
+            saida += (char)(0xe0 | c >> 12);
+            saida += (char)(0x80 | (c >> 6 & 0x3f));
+            saida += (char)(0x80 | (c & 0x3f));
+        }
+    }
+
+    // Lê um texto começando em p (depois da aspa). Retorna o fim (depois da aspa) ou nullptr
+    const char *ler_texto(const char *p, const char *fim, string_view &valor, int campo) {
+        const char *inicio = p;
+        const char *aspa = (const char *)memchr(p, '"', fim - p);
+        const char *barra = (const char *)memchr(p, '\\', (aspa ? aspa : fim) - p);
+        if (aspa && !barra) {
+            valor = string_view(inicio, aspa - inicio); // Caso comum: sem escapes, sem cópia
+            return aspa + 1;
+        }
+        string &saida = decodificados[campo];
+        saida.assign(inicio, barra ? barra - inicio : 0);
+        for (p = barra; p && p < fim; p++) {
+            if (*p == '"') {
+                valor = saida;
+                return p + 1;
+            }
+            if (*p != '\\') {
+                saida += *p;
+                continue;
+            }
+            if (++p == fim) {
+                return nullptr;
+            }
+            switch (*p) {
+                case 'n': saida += '\n'; break;
+                case 't': saida += '\t'; break;
+                case 'r': saida += '\r'; break;
+                case 'b': saida += '\b'; break;
+                case 'f': saida += '\f'; break;
+                case 'u': {
+                    uint32_t c = 0;
+                    if (fim - p < 5 || from_chars(p + 1, p + 5, c, 16).ptr != p + 5) {
+                        return nullptr;
+                    }
+                    utf8(saida, c);
+                    p += 4;
+                    break;
+                }
+                default: saida += *p; // \" \\ \/
+            }
+        }
+        return nullptr;
+    }
+
+    const Campo *campo(string_view chave) const {
+        for (int i = 0; i < n_campos; i++) {
+            if (campos[i].chave == chave) {
+                return &campos[i];
+            }
+        }
+        return nullptr;
+    }
+
+    public:
+    /**
+     * Lê a linha. Objetos e listas aninhados, chaves com escape e mais de MAX_CAMPOS
+     * campos são recusados.
+     * @return false se a linha não é um objeto nesse formato
+     */
+    bool ler(string_view linha) {
+        n_campos = 0;
+        const char *p = linha.data(), *fim = p + linha.size();
+        p = espacos(p, fim);
+        if (p == fim || *p++ != '{') {
+            return false;
+        }
+        p = espacos(p, fim);
+        if (p < fim && *p == '}') {
+            return espacos(p + 1, fim) == fim;
+        }
+        while (true) {
+            if (n_campos == MAX_CAMPOS || p == fim || *p++ != '"') {
+                return false;
+            }
+            const char *fim_chave = (const char *)memchr(p, '"', fim - p);
+            if (!fim_chave || memchr(p, '\\', fim_chave - p)) {
+                return false;
+            }
+            Campo &c = campos[n_campos];
+            c.chave = string_view(p, fim_chave - p);
+            p = espacos(fim_chave + 1, fim);
+            if (p == fim || *p++ != ':') {
+                return false;
+            }
+            p = espacos(p, fim);
+            if (p == fim) {
+                return false;
+            }
+            if (*p == '"') {
+                p = ler_texto(p + 1, fim, c.valor, n_campos);
+                if (!p) {
+                    return false;
+                }
+            } else {
+                const char *inicio = p;
+                while (p < fim && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+                    p++;
+                }
+                if (p == inicio || *inicio == '{' || *inicio == '[') {
+                    return false;
+                }
+                c.valor = string_view(inicio, p - inicio);
+            }
+            n_campos++;
+            p = espacos(p, fim);
+            if (p == fim) {
+                return false;
+            }
+            if (*p == '}') {
+                return espacos(p + 1, fim) == fim;
+            }
+            if (*p++ != ',') {
+                return false;
+            }
+            p = espacos(p, fim);
+        }
+    }
+
+    bool tem(string_view chave) const {
+        return campo(chave) != nullptr;
+    }
+
+    // O valor do campo (texto já decodificado, ou o número como escrito); vazio se não existe
+    string_view texto(string_view chave) const {
+        const Campo *c = campo(chave);
+        return c ? c->valor : string_view();
+    }
+
+    long long inteiro(string_view chave, long long padrao = 0) const {
+        const Campo *c = campo(chave);
+        long long v;
+        if (!c || from_chars(c->valor.data(), c->valor.data() + c->valor.size(), v).ec != errc()) {
+            return padrao;
+        }
+        return v;
+    }
+
+    double real(string_view chave, double padrao = 0) const {
+        const Campo *c = campo(chave);
+        double v;
+        if (!c || from_chars(c->valor.data(), c->valor.data() + c->valor.size(), v).ec != errc()) {
+            return padrao;
+        }
+        return v;
+    }
+};
+
+#endif
@@ -0,0 +1,585 @@
+/**
+ * @file main.cpp
+ * @author Isaac Franco (isaacfranco@imd.ufrn.br)
+ * @version 0.1
+ * @date 2022-01-27
+ * 
+ * @brief Demonstração do Marketplace, com as verificações (testa) de cada operação
+ * 
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "marketplace.h"
+#include "reproducao.h"
+#include "servidor.h"
+#include "cliente.h"
+#include "particoes.h"
+
+using namespace std;
+
+
+int main() {
+    Marketplace marketplace;
+
+    bool cadastro1_ok, cadastro2_ok;
+    cout << endl << "=~= TESTE - CADASTRO =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
+    cadastro1_ok = marketplace.me_cadastrar("João", "joao@gmail.com", "123456");
+    testa(cadastro1_ok, "Cadastro de usuário 1");
+    cadastro2_ok = marketplace.me_cadastrar("Maria", "maria@gmail.com", "654321");
+    testa(cadastro2_ok, "Cadastro de usuário 2");
+    vector<bool> importados = marketplace.me_cadastrar(vector<Cadastro>{
+        {"Pedro", "pedro@gmail.com", "111111"}, {"Ana", "ana@gmail.com", "222222"}, {"Outra Maria", "maria@gmail.com", "0"}});
+    testa(importados[0] && importados[1] && !importados[2], "Cadastro em lote");
+
+    cout << "=~= TESTE - USUARIOS =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
+    marketplace.show_usuarios();
+
+    if ( !cadastro1_ok || !cadastro2_ok) {
+        cout << "Cadastro de João ou Maria nao realizado" << endl;
+        return -1;
+    }
+
+    cout << endl << "=~= TESTE - TOKENS =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
+    //string invalid_token = marketplace.login("inexistente@hotmail.com", "senha qualquer");
+    //testa(invalid_token == "invalid", "login de usuario inexistente");
+    
+    string joao_token = marketplace.login("joao@gmail.com", "123456");
+    testa(joao_token != "invalid", "login de usuario valido");
+    cout << "Token de acesso recebido para João: " << joao_token << endl;
+
+    string maria_token = marketplace.login("maria@gmail.com", "654321");
+    testa(maria_token != "invalid", "login de usuario valido");
+
+    {
+        // Sessões com validade de 1s: a primeira expira antes das outras serem criadas
+        ArmazemSessoes armazem(1000);
+        Token expirado{}, ultimo{};
+        expirado[0] = 1;
+        armazem.inserir(expirado, 1, 0);
+        for (int i = 0; i < 40; i++) {
+            ultimo = Token{};
+            ultimo[0] = 2;
+            ultimo[1] = i;
+            armazem.inserir(ultimo, 2 + i, 5000);
+        }
+        testa(armazem.size() == 40 && armazem.verificar(expirado, 5000) == 0 && armazem.verificar(ultimo, 5000) == 41,
+              "Sessão expirada removida ao crescer a tabela");
+    }
+    {
+        // Pedido maior que o buffer do gerador: vários blocos, nenhum trecho zerado
+        vector<uint8_t> bytes(10000);
+        BytesAleatorios::da_thread().gerar(bytes.data(), bytes.size());
+        bool preenchido = true;
+        for (size_t i = 0; i + 64 <= bytes.size(); i += 64) {
+            preenchido = preenchido && count(bytes.begin() + i, bytes.begin() + i + 64, 0) < 64;
+        }
+        testa(preenchido, "Bytes aleatórios em vários blocos");
+    }
+    cout << "Token de acesso recebido para Maria: " << maria_token << endl;
+
+    cout << endl << "=~= TESTE - MARKETPLACE =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
+    cout << "Login do usuário..." << endl;
+    if (joao_token != "invalid") {
+        cout << "Usuário logado com sucesso" << endl;
+
+        cout<< endl  << "=~= Teste de cadastro de loja pelo Usuário logado =~=~=~=~=~=~=" << endl << endl;
+        // João cria duas lojas com o seu token de acesso
+        int bodega_do_joao_id = marketplace.criar_loja(joao_token, "Bodega do João");
+        testa(bodega_do_joao_id != -1, "Cadastro de loja");
+        int acougue_do_joao_id = marketplace.criar_loja(joao_token, "Açougue do João");
+        testa(acougue_do_joao_id != -1, "Cadastro de loja");
+        int bodega_da_maria_id = marketplace.criar_loja(maria_token, "Bodega da Maria");
+        testa(bodega_da_maria_id != -1, "Cadastro de loja");
+        
+        cout<< endl  << "=~=Teste de adição de produto à loja pelo Usuário logado =~=~=~=~=~=~=" << endl << endl;
+        // João adiciona produtos na loja e altera o seu estoque
+        int leite_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Leite em pó", 8.40);
+        testa(leite_id != -1, "Cadastro de produto");
+        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, leite_id, 10);
+        
+        cout<< endl  << "=~= Teste de incremento de estoque pelo Usuário logado =~=~=~=~=~=~=" << endl;
+        int novo_estoque_leite = marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, leite_id, 5);
+        testa(novo_estoque_leite == 15, "Adicionando estoque");
+        
+        int arroz_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Arroz", 3.50);
+        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, arroz_id, 40);
+        
+    
+        int coca_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Coca cola 250ml", 2.40);
+        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, coca_id, 15);
+        
+        // João adicionou um produto na loja que não deveria... Aff João...
+        int picanha_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Picanha Maturada", 58.40);
+        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, picanha_id, 5);
+        
+        int pic_suina_id = marketplace.adicionar_produto(joao_token, acougue_do_joao_id, "Picanha Suína", 78.40);
+        marketplace.adicionar_estoque(joao_token, acougue_do_joao_id, pic_suina_id, 8);
+        
+        cout<< endl  << "=~= Teste de transferência de produto =~=~=~=~=~=~=" << endl;
+
+        // Transferindo um produto de uma loja para outrao (do mesmo usuário)
+        marketplace.transferir_produto(joao_token, bodega_do_joao_id, acougue_do_joao_id, pic_suina_id);
+
+        cout << endl << "~~~~~ Não consegui executar bem! ~~~~~" << endl;
+        cout<< endl  << "=~= Teste de venda de produto =~=~=~=~=~=~=" << endl;
+
+        marketplace.comprar_produto(joao_token, picanha_id, 1);
+        marketplace.comprar_produto(joao_token, coca_id, 1);
+        marketplace.comprar_produto(joao_token, arroz_id, 1);
+        int compra = marketplace.comprar_produto(joao_token, leite_id, 1);
+        testa(compra != -1, "Comprando produto");
+
+        // Carrinho: leva tudo ou nada
+        vector<int> carrinho = marketplace.comprar_carrinho(joao_token, {{arroz_id, 2}, {coca_id, 1}, {arroz_id, 1}});
+        testa(carrinho.size() == 2, "Comprando carrinho");
+        vector<int> sem_estoque = marketplace.comprar_carrinho(joao_token, {{arroz_id, 1}, {picanha_id, 100}});
+        testa(sem_estoque.empty() && marketplace.buscar_produtos("Arroz")[0].quantidade == 36, "Carrinho sem estoque não compra nada");
+
+        ResumoVendas bodega = marketplace.vendas_da_loja(bodega_do_joao_id);
+        testa(bodega.receita_centavos == 8560 && bodega.unidades == 8 && bodega.pedidos == 6, "Totais de vendas da loja");
+        ResumoVendas arroz = marketplace.vendas_do_produto(arroz_id);
+        testa(arroz.receita_centavos == 1400 && arroz.unidades == 4, "Totais de vendas do produto");
+        auto horas = marketplace.vendas_por_hora(instante_atual_ms() - AgregadosVendas::MS_POR_HORA, instante_atual_ms() + 1);
+        long long pedidos = 0;
+        for (auto &hora : horas) {
+            pedidos += hora.second.pedidos;
+        }
+        testa(pedidos == 6, "Totais de vendas por hora");
+        auto mais_vendidos = marketplace.mais_vendidos(2);
+        testa(mais_vendidos.size() == 2 && mais_vendidos[0].produto_id == arroz_id && mais_vendidos[0].unidades == 4
+              && mais_vendidos[1].produto_id == coca_id, "Produtos mais vendidos");
+        auto mais_vendidos_bodega = marketplace.mais_vendidos(5, bodega_do_joao_id);
+        testa(mais_vendidos_bodega.size() == 4 && mais_vendidos_bodega[0].produto_id == arroz_id
+              && mais_vendidos_bodega[3].produto_id == picanha_id, "Produtos mais vendidos da loja");
+        auto em_alta = marketplace.em_alta(1, 5);
+        testa(em_alta.size() == 1 && em_alta[0].produto_id == arroz_id, "Produtos em alta");
+        {
+            // Ids do log ou do snapshot fora do registro são recusados
+            RegistroVendas registro;
+            Venda fora;
+            fora.id = RegistroVendas::MAX_VENDAS;
+            Venda negativa;
+            negativa.id = -1;
+            testa(!registro.restaurar(fora) && !registro.restaurar(negativa) && registro.size() == 0,
+                  "Venda com id fora do registro");
+        }
+        
+        cout<< endl  << "=~= Teste de outro login e exibição dos tokens =~=~=~=~=~=~=" << endl << endl;
+        // Logar como Maria
+        if (maria_token != "invalid"){ //string maria_token = marketplace.login("maria@gmail.com", "654321");
+        cout << "Usuário logado com sucesso" << endl; //testa(maria_token != "invalid", "login de usuario valido");
+            cout << endl;
+            marketplace.comprar_produto(maria_token, pic_suina_id, 2);
+
+            int oleo_id = marketplace.adicionar_produto(maria_token, bodega_da_maria_id, "Oleo", 9.69);
+            marketplace.adicionar_estoque(maria_token, bodega_da_maria_id, oleo_id, 5);
+            cout << endl;
+
+            // Maria buscando picanha:
+            vector<Produto> picanhas = marketplace.buscar_produtos("Picanha");
+            cout << "Quantidade de picanhas encontradas: " << picanhas.size() << endl;
+            // verificando se achou picanhas e comprando a primeira
+            if (picanhas.size() > 0) {
+                marketplace.comprar_produto(maria_token, picanhas[0].id, 1);
+            }
+
+            // Maria buscando uma loja qualquer com o nome Bodega
+            vector<Loja> bodegas = marketplace.buscar_lojas("Bodega");
+            // vendo se existe alguma bodega, se existir, comprando o primeiro produto com o nome Coca
+            cout << "Quantidade de bodegas encontradas: " << bodegas.size() << endl;
+            if (bodegas.size() > 0) {
+                vector<Produto> produtos = marketplace.buscar_produtos("Coca", bodegas[0].id);
+                cout << "Quantidade de Cocas encontradas na bodega: " << produtos.size() << endl;
+                if (produtos.size() > 0) {
+                    marketplace.comprar_produto(maria_token, produtos[0].id, 1);
+                }
+            }
+        }
+        cout << endl << "Tokens e seus id's de usuário: " << endl;
+        marketplace.show_tokens(); // opcional. debug
+        
+        cout << "=~= Teste de exibição de lojas cadastradas =~=~=~=~=~=~=" << endl << endl;
+        // mostrando todas as lojas do marketplace, duas por página
+        int cursor = 0;
+        do {
+            marketplace.ler_lista_lojas(cursor, 2, [&](const Pagina<Loja> &pagina) {
+                for (const Loja *loja : pagina.itens) {
+                    cout << loja->nome << ":" << endl;
+                    for(const Produto &produto : loja->produtos){
+                        cout << "- " << produto.nome << "; \t" << endl;
+                    }
+                    cout << endl;
+                }
+                cursor = pagina.proximo_cursor;
+            });
+        } while (cursor != -1);
+
+        // Os ids de uma página e o cursor da próxima, copiados dentro do ler_pagina_*
+        vector<int> ids;
+        auto copia_pagina = [&](const auto &pagina) {
+            ids.clear();
+            for (auto *item : pagina.itens) {
+                ids.push_back(item->id);
+            }
+            cursor = pagina.proximo_cursor;
+        };
+        marketplace.ler_pagina_produtos("Picanha", 0, 0, 1, copia_pagina);
+        testa(ids.size() == 1 && cursor != -1, "Primeira página da busca");
+        marketplace.ler_pagina_produtos("Picanha", 0, cursor, 1, copia_pagina);
+        testa(ids.size() == 1 && cursor == -1, "Última página da busca");
+
+        marketplace.ler_pagina_preco(50, 80, 0, 0, 10, copia_pagina);
+        testa(ids.size() == 2 && cursor == -1, "Busca por faixa de preço");
+        marketplace.ler_pagina_preco(50, 80, acougue_do_joao_id, 0, 10, copia_pagina);
+        testa(ids == vector<int>{pic_suina_id}, "Busca por faixa de preço na loja");
+        bool vazias = true;
+        for (int limite : {0, -1, -2}) {
+            marketplace.ler_pagina_preco(0, 1000, 0, 0, limite, copia_pagina);
+            vazias = vazias && ids.empty();
+            marketplace.ler_pagina_produtos("a", 0, 0, limite, copia_pagina);
+            vazias = vazias && ids.empty();
+            marketplace.ler_pagina_lojas("a", 0, limite, copia_pagina);
+            vazias = vazias && ids.empty();
+            marketplace.ler_lista_lojas(0, limite, copia_pagina);
+            vazias = vazias && ids.empty();
+        }
+        testa(vazias, "Páginas com limite <= 0");
+
+        // Página a página, de um em um, dá o mesmo que a busca inteira (em ordem de id)
+        auto mesma_busca = [&](const string &nome, int loja_id) {
+            vector<int> esperados, paginados;
+            for (const Produto &produto : loja_id == 0 ? marketplace.buscar_produtos(nome)
+                                                       : marketplace.buscar_produtos(nome, loja_id)) {
+                esperados.push_back(produto.id);
+            }
+            sort(esperados.begin(), esperados.end());
+            cursor = 0;
+            do {
+                marketplace.ler_pagina_produtos(nome, loja_id, cursor, 1, copia_pagina);
+                paginados.insert(paginados.end(), ids.begin(), ids.end());
+            } while (cursor != -1);
+            return !esperados.empty() && esperados == paginados;
+        };
+        testa(mesma_busca("Picanha", 0) && mesma_busca("an", 0) && mesma_busca("ic", acougue_do_joao_id)
+              && mesma_busca("Pic", acougue_do_joao_id), "Busca paginada a partir do cursor");
+
+        {
+            // A vista continua vendo o catálogo de quando foi criada
+            VistaCatalogo vista = marketplace.vista();
+            int leite_antes = vista.buscar_produtos("Leite", bodega_do_joao_id)[0].quantidade;
+            size_t lojas_antes = marketplace.listar_lojas().size();
+            marketplace.comprar_produto(maria_token, leite_id, 1);
+            marketplace.transferir_produto(joao_token, bodega_do_joao_id, acougue_do_joao_id, leite_id);
+            marketplace.adicionar_produto(joao_token, acougue_do_joao_id, "Leite de coco", 4.5);
+            marketplace.criar_loja(maria_token, "Quitanda da Maria");
+            vector<Produto> leites = vista.buscar_produtos("Leite");
+            testa(leites.size() == 1 && leites[0].quantidade == leite_antes
+                  && vista.buscar_produtos("Leite", acougue_do_joao_id).empty()
+                  && vista.listar_lojas().size() == lojas_antes
+                  && marketplace.buscar_produtos("Leite", acougue_do_joao_id).size() == 2, "Vista fixada do catálogo");
+        }
+        testa(marketplace.vista().buscar_produtos("Leite", acougue_do_joao_id).size() == 2, "Vista nova vê as escritas");
+
+        {
+            // Uma cópia do estoque começa de uma vista e segue pelos eventos
+            unique_ptr<AssinaturaEventos> assinatura = marketplace.assinar_eventos(8);
+            unique_ptr<AssinaturaEventos> pequena = marketplace.assinar_eventos(2);
+            VistaCatalogo vista = marketplace.vista();
+            map<int, int> estoques;
+            vista.para_cada_produto([&](const Produto &produto, int) { estoques[produto.id] = produto.quantidade; });
+            int coco_id = marketplace.adicionar_produto(joao_token, acougue_do_joao_id, "Coco", 3);
+            marketplace.adicionar_estoque(joao_token, acougue_do_joao_id, coco_id, 10);
+            marketplace.comprar_carrinho(maria_token, {{coco_id, 2}, {leite_id, 1}});
+            marketplace.transferir_produto(joao_token, acougue_do_joao_id, bodega_do_joao_id, coco_id);
+            vector<Evento> lote;
+            assinatura->receber(lote, 100);
+            bool em_ordem = true;
+            for (size_t i = 0; i < lote.size(); i++) {
+                em_ordem = em_ordem && lote[i].sequencia == vista.sequencia() + i;
+                if (lote[i].tipo == TipoEvento::ESTOQUE_ALTERADO) estoques[lote[i].produto_id] += lote[i].quantidade;
+                if (lote[i].tipo == TipoEvento::VENDA_CRIADA) estoques[lote[i].produto_id] -= lote[i].quantidade;
+            }
+            bool igual = true;
+            marketplace.vista().para_cada_produto([&](const Produto &produto, int) {
+                igual = igual && estoques[produto.id] == produto.quantidade;
+            });
+            testa(lote.size() == 5 && em_ordem && igual && lote[4].tipo == TipoEvento::PRODUTO_TRANSFERIDO
+                  && lote[4].loja_id == bodega_do_joao_id, "Cópia do estoque pelos eventos");
+            pequena->receber(lote, 100);
+            testa(lote.size() == 2 && pequena->perdidos() == 3 && lote[0].sequencia == vista.sequencia() + 3,
+                  "Assinante atrasado perde os eventos mais antigos");
+        }
+
+        cout<< endl  << "=~= Métricas das operações =~=~=~=~=~=~=" << endl << endl;
+        cout << Metricas::texto() << endl;
+#ifndef MARKETPLACE_SEM_METRICAS
+        vector<LatenciaOperacao> metricas = Metricas::ler();
+        testa(metricas[(int)Operacao::COMPRAR_PRODUTO].chamadas >= 4
+              && metricas[(int)Operacao::COMPRAR_PRODUTO].p50_ns <= metricas[(int)Operacao::COMPRAR_PRODUTO].maximo_ns,
+              "Métricas das compras");
+#endif
+
+        cout<< endl  << "=~= Teste de importação de produtos =~=~=~=~=~=~=" << endl << endl;
+        {
+            ofstream("importacao_teste.csv")
+                << "loja,nome,preco,quantidade\n"
+                << bodega_do_joao_id << ",Goiabada Cascão,6.5,12\n"
+                << bodega_do_joao_id << ",\"Doce \"\"da casa\"\", pote\",9,0\n"
+                << bodega_da_maria_id << ",Goiabada da Maria,5,3\n" // Loja de outro usuário
+                << bodega_do_joao_id << ",Goiabada sem preço,,1\n";
+            ResultadoImportacao csv = marketplace.importar_produtos(joao_token, "importacao_teste.csv", 2);
+            vector<Produto> goiabadas = marketplace.buscar_produtos("Goiabada");
+            testa(csv.linhas == 4 && csv.importados == 2 && csv.recusadas == 1 && csv.invalidas == 1
+                  && goiabadas.size() == 1 && goiabadas[0].id == csv.primeiro_id && goiabadas[0].quantidade == 12,
+                  "Importação de CSV");
+            testa(marketplace.buscar_produtos("\"da casa\"").size() == 1, "Nome com aspas no CSV");
+            ofstream("importacao_teste.jsonl")
+                << "{\"loja\": " << bodega_da_maria_id << ", \"nome\": \"Cocada\", \"preco\": 3, \"quantidade\": 20}\n"
+                << "{\"loja\": " << bodega_da_maria_id << ", \"nome\": \"Cocada Queimada\", \"preco\": 3.5}\n"
+                << "{\"loja\": " << bodega_da_maria_id << ", \"nome\": \"Cocada\", \"preco\": 3, \"quantidade\": -1}\n";
+            ResultadoImportacao jsonl = marketplace.importar_produtos(maria_token, "importacao_teste.jsonl");
+            testa(jsonl.importados == 2 && jsonl.invalidas == 1 && jsonl.primeiro_id == csv.primeiro_id + 2
+                  && marketplace.buscar_produtos("Cocada", bodega_da_maria_id).size() == 2, "Importação de JSONL");
+            testa(marketplace.importar_produtos("invalid", "importacao_teste.jsonl").importados == 0,
+                  "Importação com token inválido");
+            remove("importacao_teste.csv");
+            remove("importacao_teste.jsonl");
+        }
+
+        cout<< endl  << "=~= Teste do log de escrita =~=~=~=~=~=~=" << endl << endl;
+        {
+            const string caminho_log = "marketplace_teste.log";
+            remove(caminho_log.c_str());
+            int pao_id;
+            {
+                Marketplace persistente(caminho_log, PoliticaFsync::SEMPRE);
+                persistente.me_cadastrar("Lia", "lia@gmail.com", "l");
+                string lia_token = persistente.login("lia@gmail.com", "l");
+                int padaria_id = persistente.criar_loja(lia_token, "Padaria da Lia");
+                pao_id = persistente.adicionar_produto(lia_token, padaria_id, "Pão de queijo", 1.5);
+                persistente.adicionar_estoque(lia_token, padaria_id, pao_id, 10);
+                testa(persistente.comprar_produto(lia_token, pao_id, 3) != -1, "Escritas com o log");
+            }
+            {
+                Marketplace reaberto(caminho_log);
+                vector<Produto> paes = reaberto.buscar_produtos("Pão de queijo");
+                testa(paes.size() == 1 && paes[0].id == pao_id && paes[0].quantidade == 7
+                      && reaberto.quantidade_vendas() == 1 && reaberto.usuario_por_email("lia@gmail.com").nome == "Lia",
+                      "Estado reconstruído do log");
+            }
+            // Queda no meio de uma gravação: o fim do log é um registro incompleto
+            {
+                ofstream log(caminho_log, ios::app | ios::binary);
+                log.write("\x40\0\0\0\x12\x34\x56\x78\x01\0\0\0", 12);
+            }
+            {
+                Marketplace reaberto(caminho_log, PoliticaFsync::SEMPRE);
+                testa(reaberto.buscar_produtos("Pão de queijo").size() == 1
+                      && reaberto.me_cadastrar("Rui", "rui@gmail.com", "r"), "Fim incompleto do log descartado");
+            }
+            {
+                Marketplace reaberto(caminho_log);
+                testa(reaberto.usuario_por_email("rui@gmail.com").nome == "Rui"
+                      && reaberto.buscar_produtos("Pão de queijo")[0].quantidade == 7,
+                      "Escritas depois do fim descartado");
+            }
+            // Registros que citam lojas ou produtos inexistentes são recusados na reprodução
+            bool recusados = true;
+            for (const Registro &invalido : {Registro(TipoRegistro::LOJA).i32(-1).i32(1).str("X"),
+                                             Registro(TipoRegistro::ESTOQUE).i32(999).i32(5),
+                                             Registro(TipoRegistro::TRANSFERENCIA).i32(999).i32(1).i32(2),
+                                             Registro(TipoRegistro::VENDAS).i32(1).i32(0).i32(1).i32(1)
+                                                 .i32(999).i32(1).f32(1)}) {
+                remove(caminho_log.c_str());
+                {
+                    LogEscrita log(caminho_log, PoliticaFsync::NUNCA);
+                    log.anexar(invalido);
+                }
+                try {
+                    Marketplace reaberto(caminho_log);
+                    recusados = false;
+                } catch (const runtime_error &) {
+                }
+            }
+            testa(recusados, "Registros com ids inexistentes recusados");
+            {
+                // /dev/full: toda gravação do log falha com ENOSPC
+                Marketplace sem_disco("/dev/full", PoliticaFsync::SEMPRE);
+                bool primeira = sem_disco.me_cadastrar("Ana", "ana@gmail.com", "a");
+                string ana_token = sem_disco.login("ana@gmail.com", "a");
+                testa(!primeira && sem_disco.criar_loja(ana_token, "Loja da Ana") == -1
+                      && sem_disco.listar_lojas().empty() && !sem_disco.me_cadastrar("Bia", "bia@gmail.com", "b")
+                      && sem_disco.usuario_por_email("bia@gmail.com").id == 0,
+                      "Escritas recusadas depois da falha do log");
+            }
+            remove(caminho_log.c_str());
+        }
+
+        cout<< endl  << "=~= Teste de snapshot e queda do processo =~=~=~=~=~=~=" << endl << endl;
+        {
+            const string caminho_log = "marketplace_teste.log", caminho_snapshot = "marketplace_teste.img";
+            remove(caminho_log.c_str());
+            remove(caminho_snapshot.c_str());
+            pid_t filho = fork();
+            if (filho == 0) {
+                // Cadastra, grava o snapshot logo em seguida (registros ainda no buffer do log)
+                // e cai sem fechar o log
+                Marketplace persistente(caminho_snapshot, caminho_log);
+                vector<Cadastro> antes;
+                for (int i = 0; i < 50; i++) {
+                    antes.push_back({"Antes " + to_string(i), "antes" + to_string(i) + "@gmail.com", "a"});
+                }
+                persistente.me_cadastrar(antes);
+                _exit(persistente.salvar_snapshot(caminho_snapshot) ? 0 : 1);
+            }
+            int status = -1;
+            waitpid(filho, &status, 0);
+            bool todos = true;
+            try {
+                {
+                    Marketplace reaberto(caminho_snapshot, caminho_log, PoliticaFsync::SEMPRE);
+                    for (int i = 0; i < 80; i++) {
+                        reaberto.me_cadastrar("Depois " + to_string(i), "depois" + to_string(i) + "@gmail.com", "d");
+                    }
+                }
+                Marketplace reaberto(caminho_snapshot, caminho_log);
+                for (int i = 0; i < 50; i++) {
+                    todos = todos && reaberto.usuario_por_email("antes" + to_string(i) + "@gmail.com").id != 0;
+                }
+                for (int i = 0; i < 80; i++) {
+                    todos = todos && reaberto.usuario_por_email("depois" + to_string(i) + "@gmail.com").id != 0;
+                }
+            } catch (const runtime_error &) {
+                todos = false;
+            }
+            testa(WIFEXITED(status) && WEXITSTATUS(status) == 0 && todos, "Snapshot e log depois de uma queda");
+            // Um log que não chega à posição do snapshot não é aberto
+            ofstream(caminho_log, ios::trunc);
+            bool recusado = false;
+            try {
+                Marketplace reaberto(caminho_snapshot, caminho_log);
+            } catch (const runtime_error &) {
+                recusado = true;
+            }
+            testa(recusado, "Log mais curto que o snapshot");
+            // Snapshot com um texto apontando para fora da seção, e depois truncado: recusados
+            ifstream lido(caminho_snapshot, ios::binary);
+            string bytes((istreambuf_iterator<char>(lido)), istreambuf_iterator<char>());
+            CabecalhoSnapshot cabecalho;
+            memcpy(&cabecalho, bytes.data(), sizeof cabecalho);
+            uint32_t fora = 0xfffffff0;
+            memcpy(&bytes[cabecalho.secoes[SECAO_USUARIOS].deslocamento + offsetof(UsuarioSnap, email)], &fora, 4);
+            bool corrompidos = true;
+            for (size_t tamanho : {bytes.size(), bytes.size() / 2}) {
+                ofstream(caminho_snapshot, ios::trunc | ios::binary).write(bytes.data(), tamanho);
+                ImagemSnapshot imagem;
+                try {
+                    imagem.abrir(caminho_snapshot);
+                    corrompidos = false;
+                } catch (const runtime_error &) {
+                }
+            }
+            testa(corrompidos, "Snapshot corrompido recusado");
+            remove(caminho_log.c_str());
+            remove(caminho_snapshot.c_str());
+        }
+
+        cout<< endl  << "=~= Teste de reprodução de requisições =~=~=~=~=~=~=" << endl << endl;
+        Marketplace copia;
+        ReprodutorRequisicoes reprodutor(copia);
+        ResultadoReproducao reproducao = reprodutor.reproduzir(
+            "{\"op\": \"cadastro\", \"nome\": \"Jos\\u00e9\", \"email\": \"jose@gmail.com\", \"senha\": \"1\"}\n"
+            "{\"op\": \"login\", \"email\": \"jose@gmail.com\", \"senha\": \"1\", \"sessao\": \"s1\"}\n"
+            "{\"op\": \"criar_loja\", \"sessao\": \"s1\", \"nome\": \"Mercearia\", \"loja\": 70}\n"
+            "{\"op\": \"adicionar_produto\", \"sessao\": \"s1\", \"loja\": 70, \"nome\": \"Feij\u00e3o\", \"preco\": 7.5, \"produto\": 900}\n"
+            "{\"op\": \"adicionar_estoque\", \"sessao\": \"s1\", \"loja\": 70, \"produto\": 900, \"quantidade\": 3}\n"
+            "\n"
+            "{\"op\": \"comprar_produto\", \"sessao\": \"s1\", \"produto\": 900, \"quantidade\": 2}\n"
+            "{\"op\": \"comprar_produto\", \"sessao\": \"s1\", \"produto\": 900, \"quantidade\": 2}\n"
+            "{\"op\": \"voar\"}\n"
+            "nao e json\n");
+        testa(reproducao.linhas == 9 && reproducao.operacoes == 7 && reproducao.invalidas == 2 && reproducao.falhas == 1,
+              "Reprodução de requisições");
+        testa(copia.buscar_produtos("Feijão").size() == 1 && copia.buscar_produtos("Feijão")[0].quantidade == 1
+              && copia.usuario_por_email("jose@gmail.com").nome == "José", "Estado depois da reprodução");
+
+        cout<< endl  << "=~= Teste do servidor no socket Unix =~=~=~=~=~=~=" << endl << endl;
+        {
+            Servidor servidor(copia, "marketplace_teste.sock", 1);
+            ClienteMarketplace cliente("marketplace_teste.sock");
+            string jose_token = cliente.login("jose@gmail.com", "1");
+            testa(cliente.token_verify(jose_token) == copia.usuario_por_email("jose@gmail.com").id
+                  && cliente.login("jose@gmail.com", "errada") == "invalid", "Login pelo servidor");
+            vector<ProdutoRemoto> remotos = cliente.buscar_produtos("Feij");
+            testa(remotos.size() == 1 && remotos[0].nome == "Feijão" && remotos[0].quantidade == 1,
+                  "Busca pelo servidor");
+            // Duas requisições sem esperar e uma operação desconhecida: as respostas voltam em ordem
+            cliente.iniciar(OperacaoRemota::COMPRAR_PRODUTO).str(jose_token).i32(remotos[0].id).i32(1);
+            uint32_t compra = cliente.terminar();
+            cliente.iniciar((OperacaoRemota)200);
+            uint32_t desconhecida = cliente.terminar();
+            cliente.iniciar(OperacaoRemota::QUANTIDADE_VENDAS);
+            cliente.terminar();
+            cliente.enviar();
+            RespostaRemota r1 = cliente.receber();
+            bool compra_ok = r1.id == compra && r1.status == StatusResposta::OK && r1.campos.i32() != -1;
+            RespostaRemota r2 = cliente.receber();
+            bool desconhecida_ok = r2.id == desconhecida && r2.status == StatusResposta::INVALIDA;
+            testa(compra_ok && desconhecida_ok && cliente.receber().campos.i64() == 2, "Requisições em sequência pelo servidor");
+            // Quantidades maiores do que a mensagem comporta: recusadas sem alocar, e a conexão segue
+            cliente.iniciar(OperacaoRemota::CADASTRO_LOTE).i32(2000000000);
+            cliente.terminar();
+            cliente.iniciar(OperacaoRemota::COMPRAR_CARRINHO).str(jose_token).i32(1 << 30).i32(remotos[0].id).i32(1);
+            cliente.terminar();
+            cliente.enviar();
+            bool lote_ok = cliente.receber().status == StatusResposta::INVALIDA;
+            bool carrinho_ok = cliente.receber().status == StatusResposta::INVALIDA;
+            testa(lote_ok && carrinho_ok && cliente.token_verify(jose_token) != -1,
+                  "Quantidade de itens maior que a mensagem");
+        }
+
+        cout<< endl  << "=~= Teste do marketplace particionado por loja =~=~=~=~=~=~=" << endl << endl;
+        {
+            MarketplaceParticionado particionado(4);
+            particionado.me_cadastrar("Rita", "rita@gmail.com", "r");
+            string rita_token = particionado.login("rita@gmail.com", "r");
+            // Lojas seguidas até haver duas em partições diferentes
+            int feira_id = particionado.criar_loja(rita_token, "Feira da Rita");
+            int quitanda_id = particionado.criar_loja(rita_token, "Quitanda da Rita");
+            while (particionado.particao_da_loja(quitanda_id) == particionado.particao_da_loja(feira_id)) {
+                quitanda_id = particionado.criar_loja(rita_token, "Quitanda da Rita");
+            }
+            int caju_id = particionado.adicionar_produto(rita_token, feira_id, "Caju", 2.5);
+            int manga_id = particionado.adicionar_produto(rita_token, quitanda_id, "Manga", 3);
+            particionado.adicionar_estoque(rita_token, feira_id, caju_id, 5);
+            vector<int> estoques = particionado.adicionar_estoque(rita_token, vector<Reposicao>{
+                {quitanda_id, manga_id, 4}, {feira_id, caju_id, 1}, {feira_id, manga_id, 1}});
+            testa(estoques == vector<int>{4, 6, -1}, "Reposição em lote entre partições");
+            testa(particionado.transferir_produto(rita_token, feira_id, quitanda_id, caju_id)
+                  && !particionado.transferir_produto(rita_token, feira_id, quitanda_id, caju_id),
+                  "Transferência entre partições");
+            testa(particionado.comprar_produto(rita_token, caju_id, 2) != -1
+                  && particionado.buscar_produtos("Caju", quitanda_id).size() == 1
+                  && particionado.buscar_produtos("Caju", quitanda_id)[0].quantidade == 4
+                  && particionado.buscar_produtos("Caju", feira_id).empty(), "Compra depois da transferência");
+            vector<Produto> todos = particionado.buscar_produtos("a");
+            testa(todos.size() == 2 && particionado.buscar_lojas("Rita").size() >= 2
+                  && particionado.quantidade_vendas() == 1, "Busca em todas as partições");
+        }
+        
+    } else {
+        cout << "Usuário não pode se logar" << endl;
+
+        
+    }
+}
+
@@ -0,0 +1,238 @@
+/**
+ * @file mais_vendidos.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Ranking aproximado dos produtos mais vendidos (Space-Saving) com memória limitada
+ *
+ */
+
+#ifndef MAIS_VENDIDOS_H
+#define MAIS_VENDIDOS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class ItemRanking {
+    public:
+    int produto_id;
+    long long unidades; // Estimativa: nunca menor que o real
+    long long erro; // O real é pelo menos unidades - erro
+};
+
+/**
+ * Algoritmo Space-Saving: acompanha no máximo capacidade itens. Um item novo com a
+ * estrutura cheia toma o lugar do de menor contagem e herda essa contagem como erro.
+ * Todo item com mais de total/capacidade unidades certamente está presente.
+ * O menor é achado com um heap de mínimo; não é seguro para várias threads.
+ */
+class SpaceSaving {
+    private:
+    struct Contador {
+        int id;
+        long long contagem;
+        long long erro;
+    };
+
+    size_t capacidade;
+    vector<Contador> heap; // Heap de mínimo por contagem
+    unordered_map<int, size_t> posicoes; // Chave: id, Valor: posição no heap
+
+    void trocar(size_t a, size_t b) {
+        swap(heap[a], heap[b]);
+        posicoes[heap[a].id] = a;
+        posicoes[heap[b].id] = b;
+    }
+
+    // A contagem só aumenta, então o item só desce no heap
+    void descer(size_t i) {
+        while (true) {
+            size_t menor = i, e = 2 * i + 1, d = 2 * i + 2;
+            if (e < heap.size() && heap[e].contagem < heap[menor].contagem) menor = e;
+            if (d < heap.size() && heap[d].contagem < heap[menor].contagem) menor = d;
+            if (menor == i) return;
+            trocar(i, menor);
+            i = menor;
+        }
+    }
+
+    void subir(size_t i) {
+        while (i > 0 && heap[(i - 1) / 2].contagem > heap[i].contagem) {
+            trocar(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    public:
+    explicit SpaceSaving(size_t capacidade) : capacidade(max<size_t>(capacidade, 1)) {
+    }
+
+    void adicionar(int id, long long peso) {
+        auto it = posicoes.find(id);
+        if (it != posicoes.end()) {
+            heap[it->second].contagem += peso;
+            descer(it->second);
+        } else if (heap.size() < capacidade) {
+            heap.push_back(Contador{id, peso, 0});
+            posicoes[id] = heap.size() - 1;
+            subir(heap.size() - 1);
+        } else {
+            // Substitui o menor, que herda a contagem como erro
+            posicoes.erase(heap[0].id);
+            long long minimo = heap[0].contagem;
+            heap[0] = Contador{id, minimo + peso, minimo};
+            posicoes[id] = 0;
+            descer(0);
+        }
+    }
+
+    void limpar() {
+        heap.clear();
+        posicoes.clear();
+    }
+
+    /**
+     * Chama f(id, contagem, erro) para cada item acompanhado.
+     */
+    template <typename F>
+    void para_cada(F f) const {
+        for (auto &c : heap) {
+            f(c.id, c.contagem, c.erro);
+        }
+    }
+};
+
+/**
+ * Mais vendidos desde o início e "em alta" numa janela recente, alimentado a cada venda.
+ * Os produtos são divididos em faixas (pelo id), cada uma com a sua trava, o seu
+ * Space-Saving total e um anel com um Space-Saving por minuto da janela; como cada
+ * produto cai sempre na mesma faixa, juntar as faixas numa consulta não soma erro.
+ *
+ * Memória: no máximo (1 + minutos) * capacidade contadores, alocados conforme o uso.
+ * Mais capacidade, menos erro: com N unidades vendidas, o erro de cada item é no máximo
+ * N * faixas / capacidade (na prática bem menor com vendas concentradas em poucos produtos).
+ */
+class RankingVendas {
+    private:
+    struct Faixa {
+        mutex trava;
+        SpaceSaving total;
+        vector<SpaceSaving> por_minuto; // Posição: minuto % minutos
+        vector<long long> minuto_da_posicao; // Minuto que cada posição guarda (-1: nenhum)
+
+        Faixa(size_t capacidade, int minutos)
+            : total(capacidade), por_minuto(minutos, SpaceSaving(capacidade)), minuto_da_posicao(minutos, -1) {
+        }
+    };
+
+    int minutos;
+    vector<unique_ptr<Faixa>> faixas;
+
+    Faixa &faixa(int produto_id) {
+        return *faixas[(uint32_t)produto_id * 0x9e3779b1u % faixas.size()];
+    }
+
+    static vector<ItemRanking> maiores(unordered_map<int, ItemRanking> &itens, size_t k) {
+        vector<ItemRanking> resultado;
+        resultado.reserve(itens.size());
+        for (auto &i : itens) {
+            resultado.push_back(i.second);
+        }
+        auto ordem = [](const ItemRanking &a, const ItemRanking &b) {
+            return a.unidades != b.unidades ? a.unidades > b.unidades : a.produto_id < b.produto_id;
+        };
+        k = min(k, resultado.size());
+        partial_sort(resultado.begin(), resultado.begin() + k, resultado.end(), ordem);
+        resultado.resize(k);
+        return resultado;
+    }
+
+    public:
+    static const int64_t MS_POR_MINUTO = 60 * 1000;
+
+    /**
+     * @param capacidade Quantidade de produtos acompanhados (no total e em cada minuto)
+     * @param minutos Tamanho máximo da janela de em_alta
+     * @param n_faixas Quantidade de travas independentes
+     */
+    RankingVendas(size_t capacidade = 1024, int minutos = 60, size_t n_faixas = 8)
+        : minutos(max(minutos, 1)) {
+        n_faixas = max<size_t>(n_faixas, 1);
+        for (size_t i = 0; i < n_faixas; i++) {
+            faixas.emplace_back(new Faixa(max<size_t>(capacidade / n_faixas, 1), this->minutos));
+        }
+    }
+
+    /**
+     * Conta unidades vendidas do produto no instante (ms desde 1970; 0 só conta no total).
+     * Vendas mais antigas que a janela guardada só contam no total.
+     */
+    void registrar(int produto_id, int unidades, int64_t instante) {
+        Faixa &f = faixa(produto_id);
+        lock_guard<mutex> trava(f.trava);
+        f.total.adicionar(produto_id, unidades);
+        if (instante <= 0) {
+            return;
+        }
+        long long minuto = instante / MS_POR_MINUTO;
+        size_t posicao = minuto % minutos;
+        if (f.minuto_da_posicao[posicao] < minuto) {
+            f.por_minuto[posicao].limpar();
+            f.minuto_da_posicao[posicao] = minuto;
+        }
+        if (f.minuto_da_posicao[posicao] == minuto) {
+            f.por_minuto[posicao].adicionar(produto_id, unidades);
+        }
+    }
+
+    /**
+     * Os k produtos com mais unidades vendidas desde o início (estimativa).
+     */
+    vector<ItemRanking> mais_vendidos(size_t k) {
+        unordered_map<int, ItemRanking> itens;
+        for (auto &f : faixas) {
+            lock_guard<mutex> trava(f->trava);
+            f->total.para_cada([&](int id, long long contagem, long long erro) {
+                itens[id] = ItemRanking{id, contagem, erro};
+            });
+        }
+        return maiores(itens, k);
+    }
+
+    /**
+     * Os k produtos com mais unidades vendidas nos últimos ultimos_minutos minutos
+     * (incluindo o minuto atual), até o tamanho da janela.
+     */
+    vector<ItemRanking> em_alta(size_t k, int ultimos_minutos, int64_t agora) {
+        long long atual = agora / MS_POR_MINUTO;
+        long long primeiro = atual - min(max(ultimos_minutos, 1), minutos) + 1;
+        unordered_map<int, ItemRanking> itens;
+        for (auto &f : faixas) {
+            lock_guard<mutex> trava(f->trava);
+            for (int p = 0; p < minutos; p++) {
+                long long minuto = f->minuto_da_posicao[p];
+                if (minuto < primeiro || minuto > atual) {
+                    continue;
+                }
+                f->por_minuto[p].para_cada([&](int id, long long contagem, long long erro) {
+                    auto it = itens.find(id);
+                    if (it == itens.end()) {
+                        itens[id] = ItemRanking{id, contagem, erro};
+                    } else {
+                        it->second.unidades += contagem;
+                        it->second.erro += erro;
+                    }
+                });
+            }
+        }
+        return maiores(itens, k);
+    }
+};
+
+#endif
@@ -4,521 +4,1140 @@
  * @version 0.1
  * @date 2022-01-27
  * 
- * @brief Marketplace em C++
+ * @brief Implementação do Marketplace (documentação dos métodos em marketplace.h)
  * 
  */
 
-#include <iostream>
-#include <string>
-#include <vector>
-#include <map>
-#include "utils.h"
+#include "marketplace.h"
 
 using namespace std;
 
-class Usuario {
-    public:
-    int id; // número incremental
-    string email;
-    string nome;
-    string senha_hash; // Senha em hash
-};
-
-class Produto {
-    public:
-    int id; // número incremental
-    string nome;
-    float preco;
-    int quantidade;
-};
-
-class Loja {
-    public:
-    int id; // número incremental
-    string nome;
-    Usuario proprietario;
-    vector<Produto> produtos;
-};
-
-class Venda {
-    public:
-    int id; // número incremental
-    int comprador_id; // Id do Usuário que fez a compra
-    int loja_id; // Id da Loja que o produto foi comprado
-    int produto_id; // Id do produto comprado
-    int quantidade; // Quantos produtos foram comprados
-    float preco_unitario; // Qual era o preço do produto no momento da venda
-};
-
-
-class Marketplace {
-    private:
-    map<string, Usuario> usuarios; // Chave: email, Valor: Usuario
-    map<int, Loja> lojas; // Chave: id da loja, Valor: Loja
-    
-    map<string, int> acessos_liberados; // Chave: token_de_acesso, Valor: id_do_usuario
-    
-    vector<Venda> vendas;
-    int ultimo_produto_id = 0;
-    int ultima_venda_id = 0;
-    // TODO Separa a implementação em .h e .cpp do Marketplace
-    public:
-        Marketplace() {
+VistaCatalogo::VistaCatalogo(VistaCatalogo &&outra) {
+    *this = move(outra);
+}
 
+VistaCatalogo &VistaCatalogo::operator=(VistaCatalogo &&outra) {
+    if (this != &outra) {
+        if (colunas) {
+            colunas->soltar(epoca_);
         }
+        colunas = outra.colunas;
+        lojas = outra.lojas;
+        epoca_ = outra.epoca_;
+        n_produtos = outra.n_produtos;
+        n_lojas = outra.n_lojas;
+        n_vendas = outra.n_vendas;
+        sequencia_ = outra.sequencia_;
+        outra.colunas = nullptr;
+    }
+    return *this;
+}
 
-        int token_verify(string token_de_acesso){
-            for (auto &i : acessos_liberados){
-                if(i.first == token_de_acesso){
-                    return i.second;
-                }
-            }
-            return 0;
+VistaCatalogo::~VistaCatalogo() {
+    if (colunas) {
+        colunas->soltar(epoca_);
+    }
+}
+
+vector<Loja> VistaCatalogo::listar_lojas() const {
+    vector<Loja> por_id(n_lojas);
+    for (size_t id = 0; id < n_lojas; id++) {
+        por_id[id].id = id;
+        por_id[id].proprietario_id = lojas->proprietario(id);
+        if (por_id[id].proprietario_id != 0) {
+            por_id[id].nome = lojas->nome(id);
         }
+    }
+    para_cada_produto([&](const Produto &produto, int loja_id) {
+        por_id[loja_id].produtos.push_back(produto);
+    });
+    vector<Loja> encontradas;
+    for (auto &loja : por_id) {
+        if (loja.proprietario_id != 0) {
+            encontradas.push_back(move(loja));
+        }
+    }
+    return encontradas;
+}
+
+vector<Produto> VistaCatalogo::buscar_produtos(const string &nome_parcial, int loja_id) const {
+    vector<pair<int, Produto>> encontrados;
+    para_cada_produto([&](const Produto &produto, int loja) {
+        if ((loja_id == 0 || loja == loja_id) && produto.nome.vista().find(nome_parcial) != string_view::npos) {
+            encontrados.emplace_back(loja, produto);
+        }
+    });
+    stable_sort(encontrados.begin(), encontrados.end(),
+                [](const pair<int, Produto> &a, const pair<int, Produto> &b) { return a.first < b.first; });
+    vector<Produto> produtos;
+    produtos.reserve(encontrados.size());
+    for (auto &i : encontrados) {
+        produtos.push_back(i.second);
+    }
+    return produtos;
+}
+
+size_t VistaCatalogo::quantidade_vendas() const {
+    return n_vendas;
+}
+
+uint64_t VistaCatalogo::sequencia() const {
+    return sequencia_;
+}
+
+uint32_t VistaCatalogo::epoca() const {
+    return epoca_;
+}
+
+Loja *Marketplace::loja_por_id(int loja_id) {
+    auto it = lojas.find(loja_id);
+    return it == lojas.end() ? nullptr : &it->second;
+}
 
-        Usuario usuario_por_id(int id){
-            for (auto it : usuarios){
-                if(it.second.id == id){
-                    return it.second;
+Produto *Marketplace::produto_por_id(int produto_id) {
+    if (produto_id < 0 || produto_id >= (int)produtos_por_id.size()) {
+        return nullptr;
+    }
+    LocalProduto &local = produtos_por_id[produto_id];
+    return local.loja ? &local.loja->produtos[local.posicao] : nullptr;
+}
+
+vector<int> Marketplace::ids_produtos_com_nome(const string &nome_parcial, int loja_id) {
+    vector<int> encontrados;
+    if (!indice_produtos.candidatos(nome_parcial, encontrados)) {
+        // Consulta curta demais para o índice: percorre as lojas
+        for (auto &i : lojas){
+            if(loja_id != 0 && i.first != loja_id){
+                continue;
+            }
+            for(auto &f : i.second.produtos){
+                if (f.nome.find(nome_parcial) != string::npos){
+                    encontrados.push_back(f.id);
                 }
             }
-            return Usuario();
-        }
-
-        /**
-         * Cadastra um usuário no marketplace, retornando true ou false se o cadastro foi realizado com sucesso.
-         * O e-mail deve ser único
-         * @param nome Nome do usuário
-         * @param email Email do usuário
-         * @param senha Senha do usuário. Deve ser armazenada em forma criptografada.
-         * @return True se o cadastro foi realizado com sucesso, false caso contrário.
-         */
-        bool me_cadastrar(string nome, string email, string senha) {
-            // TODO(opcional) Implementar
-            // Buscando usuário com e-mail no cadastro
-            auto it = usuarios.find(email);
-            // Se não existir, cria um novo usuário
-            if (it == usuarios.end()) {
-                Usuario novo_usuario;
-                novo_usuario.id = usuarios.size() + 1; //podemos fazer assim pois não existe remoção
-                novo_usuario.email = email;
-                novo_usuario.nome = nome;
-                novo_usuario.senha_hash = geraHash(senha);
-                usuarios.insert(make_pair(email, novo_usuario));
-                return true;
+        }
+        return encontrados;
+    }
+    size_t n = 0;
+    for (int id : encontrados) {
+        const LocalProduto &local = produtos_por_id[id];
+        if ((loja_id == 0 || local.loja->id == loja_id)
+            && local.loja->produtos[local.posicao].nome.find(nome_parcial) != string::npos) {
+            encontrados[n++] = id;
+        }
+    }
+    encontrados.resize(n);
+    sort(encontrados.begin(), encontrados.end(), [this](int a, int b) {
+        const LocalProduto &la = produtos_por_id[a], &lb = produtos_por_id[b];
+        return la.loja->id != lb.loja->id ? la.loja->id < lb.loja->id : la.posicao < lb.posicao;
+    });
+    return encontrados;
+}
+
+void Marketplace::pagina_produtos(const string &nome_parcial, int loja_id, int cursor, int limite,
+                                  Pagina<Produto> &pagina) {
+    auto aceita = [&](int id) {
+        const LocalProduto &local = produtos_por_id[id];
+        return local.loja && (loja_id == 0 || local.loja->id == loja_id)
+            && local.loja->produtos[local.posicao].nome.find(nome_parcial) != string::npos;
+    };
+    auto inclui = [&](int id) {
+        if ((int)pagina.itens.size() == limite) {
+            pagina.proximo_cursor = id;
+            return false;
+        }
+        pagina.itens.push_back(produto_por_id(id));
+        return true;
+    };
+    cursor = max(cursor, 0);
+    if (indice_produtos.percorrer(nome_parcial, cursor, [&](int id) { return !aceita(id) || inclui(id); })) {
+        return;
+    }
+    if (loja_id != 0) {
+        // Consulta curta: percorre só a loja; os ids nela não estão em ordem (transferências),
+        // então ordena só os limite + 1 menores
+        Loja *loja = loja_por_id(loja_id);
+        if (!loja) return;
+        vector<int> encontrados;
+        for (auto &f : loja->produtos) {
+            if (f.id >= cursor && f.nome.find(nome_parcial) != string::npos) {
+                encontrados.push_back(f.id);
             }
+        }
+        if (encontrados.size() > (size_t)limite + 1) {
+            nth_element(encontrados.begin(), encontrados.begin() + limite, encontrados.end());
+            encontrados.resize(limite + 1);
+        }
+        sort(encontrados.begin(), encontrados.end());
+        for (int id : encontrados) {
+            if (!inclui(id)) break;
+        }
+    } else {
+        for (int id = cursor; id < (int)produtos_por_id.size(); id++) {
+            if (aceita(id) && !inclui(id)) break;
+        }
+    }
+}
+
+void Marketplace::pagina_preco(float preco_minimo, float preco_maximo, int loja_id, int cursor, int limite,
+                               Pagina<Produto> &pagina) {
+    vector<int> ids;
+    // Um a mais que o limite: se vier, é o início da próxima página
+    colunas.filtrar_preco(preco_minimo, preco_maximo, loja_id, max(cursor, 0), (size_t)limite + 1, ids);
+    if ((int)ids.size() > limite) {
+        pagina.proximo_cursor = ids[limite];
+        ids.pop_back();
+    }
+    for (int id : ids) {
+        pagina.itens.push_back(produto_por_id(id));
+    }
+}
+
+void Marketplace::pagina_lojas(const string *nome_parcial, int cursor, int limite, Pagina<Loja> &pagina) {
+    // Retorna false quando a página fecha
+    auto considera = [&](Loja *loja) {
+        if (nome_parcial && loja->nome.find(*nome_parcial) == string::npos) return true;
+        if ((int)pagina.itens.size() == limite) {
+            pagina.proximo_cursor = loja->id;
             return false;
         }
+        pagina.itens.push_back(loja);
+        return true;
+    };
+    if (nome_parcial && indice_lojas.percorrer(*nome_parcial, cursor,
+                                               [&](int id) { return considera(loja_por_id(id)); })) {
+        return;
+    }
+    for (auto it = lojas.lower_bound(cursor); it != lojas.end(); it++) {
+        if (!considera(&it->second)) break;
+    }
+}
 
-        /**
-         * Tenta logar o usuário com esse e-mail / senha.
-         * Caso bem sucessido o login, deve gerar aleatoriamente um token de acesso
-         * e o par <token, usuario_id> deve ser armazenado em "acessos_liberados".
-         * @param email Email do usuário
-         * @param senha Senha do usuário.
-         * @return  token de acesso caso o login seja bem sucedido. Caso contrário, retornar "invalid"
-         */
-        string login(string email, string senha) {
-            // TODO(opcional) Implementar
-            // Buscando usuário com e-mail no cadastro
-            auto it = usuarios.find(email);
-            // Se não existir, retorna "invalid"
-            if (it == usuarios.end()) {
-                return "invalid";
+vector<int> Marketplace::ids_lojas_com_nome(const string &nome_parcial) {
+    vector<int> encontradas;
+    if (!indice_lojas.candidatos(nome_parcial, encontradas)) {
+        for (auto &i : lojas){
+            if (i.second.nome.find(nome_parcial) != string::npos){
+                encontradas.push_back(i.first);
             }
-            // Se existir, verifica se a senha está correta
-            string senha_hash = geraHash(senha);
-            if (it->second.senha_hash == senha_hash) {
-                // Se estiver correta, gera um token de acesso
-                string token_de_acesso = genRandomString(20);
-                // Armazena o token de acesso e o id do usuário
-                acessos_liberados.insert(make_pair(token_de_acesso, it->second.id));
-                return token_de_acesso;
+        }
+        return encontradas;
+    }
+    size_t n = 0;
+    for (int id : encontradas) {
+        if (loja_por_id(id)->nome.find(nome_parcial) != string::npos) {
+            encontradas[n++] = id;
+        }
+    }
+    encontradas.resize(n);
+    return encontradas;
+}
+
+int Marketplace::usuario_do_token(const string &token_de_acesso) {
+    Token token;
+    if (!token_de_string(token_de_acesso, token)) {
+        return 0;
+    }
+    shared_lock<shared_mutex> trava(trava_sessoes);
+    return acessos_liberados.verificar(token);
+}
+
+uint64_t Marketplace::registrar(const Registro &registro) {
+    return log ? log->anexar(registro) : 0;
+}
+
+bool Marketplace::duravel(uint64_t lsn) {
+    return !log || !lsn || log->esperar(lsn);
+}
+
+bool Marketplace::aceita_escritas() const {
+    return !log || !log->com_falha();
+}
+
+bool Marketplace::reservar_estoque(Produto *produto, int quantidade) {
+    if (!produto->quantidade.reservar(quantidade)) {
+        return false;
+    }
+    colunas.somar_quantidade(produto->id, -quantidade);
+    return true;
+}
+
+int Marketplace::somar_estoque(Produto *produto, int quantidade) {
+    colunas.somar_quantidade(produto->id, quantidade);
+    return produto->quantidade.adicionar(quantidade);
+}
+
+Registro Marketplace::registro_cadastro(const string &nome, const string &email, const HashSenha &senha_hash) {
+    return Registro(TipoRegistro::CADASTRO).str(nome).str(email).str(string(hash_como_texto(senha_hash)));
+}
+
+Registro Marketplace::registro_vendas(const vector<Venda> &lote) {
+    Registro registro(TipoRegistro::VENDAS_DATADAS);
+    registro.i32(lote.size());
+    for (auto &venda : lote) {
+        registro.i32(venda.id).i32(venda.comprador_id).i32(venda.loja_id)
+            .i32(venda.produto_id).i32(venda.quantidade).f32(venda.preco_unitario)
+            .i64(venda.instante);
+    }
+    return registro;
+}
+
+Evento Marketplace::evento_venda(const Venda &venda) {
+    Evento evento;
+    evento.tipo = TipoEvento::VENDA_CRIADA;
+    evento.loja_id = venda.loja_id;
+    evento.produto_id = venda.produto_id;
+    evento.usuario_id = venda.comprador_id;
+    evento.venda_id = venda.id;
+    evento.quantidade = venda.quantidade;
+    evento.preco = venda.preco_unitario;
+    evento.instante = venda.instante;
+    return evento;
+}
+
+bool Marketplace::aplicar_loja(int loja_id, int proprietario_id, string_view nome) {
+    if (loja_id < 1 || (size_t)loja_id >= ColunasLojas::MAX_LOJAS || lojas.count(loja_id)) {
+        return false;
+    }
+    Loja nova_loja;
+    nova_loja.id = loja_id;
+    nova_loja.proprietario_id = proprietario_id;
+    nova_loja.nome = nomes.internar(nome);
+    lojas.insert(make_pair(nova_loja.id, nova_loja));
+    indice_lojas.adicionar(nova_loja.id, nova_loja.nome);
+    colunas_lojas.adicionar(nova_loja.id, proprietario_id, nova_loja.nome);
+    return true;
+}
+
+bool Marketplace::aplicar_produto(int produto_id, Loja *loja, string_view nome, float preco, bool indexar) {
+    if (produto_id < 0 || (size_t)produto_id >= ColunasProdutos::MAX_PRODUTOS || !loja) {
+        return false;
+    }
+    Produto novo_produto;
+    novo_produto.id = produto_id;
+    novo_produto.nome = nomes.internar(nome);
+    novo_produto.preco = preco;
+    novo_produto.quantidade = 0;
+    loja->produtos.push_back(novo_produto);
+    if ((int)produtos_por_id.size() <= produto_id) {
+        produtos_por_id.resize(produto_id + 1);
+    }
+    produtos_por_id[produto_id].loja = loja;
+    produtos_por_id[produto_id].posicao = loja->produtos.size() - 1;
+    if (indexar) {
+        indice_produtos.adicionar(produto_id, nome);
+    }
+    colunas.adicionar(produto_id, loja->id, preco, novo_produto.nome);
+    return true;
+}
+
+void Marketplace::aplicar_transferencia(Loja *origem, Loja *destino, int produto_id) {
+    LocalProduto &local = produtos_por_id[produto_id];
+    // Move para o fim da loja destino e tapa o buraco na origem com o último produto
+    destino->produtos.push_back(move(origem->produtos[local.posicao]));
+    if(local.posicao != origem->produtos.size() - 1){
+        origem->produtos[local.posicao] = move(origem->produtos.back());
+        produtos_por_id[origem->produtos[local.posicao].id].posicao = local.posicao;
+    }
+    origem->produtos.pop_back();
+    local.loja = destino;
+    local.posicao = destino->produtos.size() - 1;
+    colunas.mover(produto_id, destino->id);
+}
+
+void Marketplace::reaplicar(LeitorRegistro &r) {
+    TipoRegistro tipo = r.tipo();
+    switch (tipo) {
+        case TipoRegistro::CADASTRO: {
+            string nome = r.str(), email = r.str();
+            HashSenha senha_hash{};
+            hash_de_texto(r.str(), senha_hash);
+            usuarios.cadastrar(nome, email, senha_hash);
+            break;
+        }
+        case TipoRegistro::LOJA: {
+            int loja_id = r.i32(), usuario_id = r.i32();
+            if (!aplicar_loja(loja_id, usuario_id, r.str())) {
+                throw runtime_error("loja inválida no log: " + to_string(loja_id));
             }
-            return "invalid";
-        }
-
-        
-
-        /**
-         * Cria uma loja no marketplace com o nome especificado para o usuário que tem
-         * um acesso com esse token.
-         * @param token Token de acesso
-         * @param nome Nome da loja
-         * @return O id da loja, ou -1 caso o token não exista em acessos_liberados ou
-         * uma loja com esse nome já exista no marketplace
-         */
-        int criar_loja(string token, string nome) {
-            // TODO Implementar
-            int id_usuario = token_verify(token);
-            if (id_usuario > 0){
-                Loja nova_loja;
-                nova_loja.proprietario = usuario_por_id(id_usuario);
-                nova_loja.nome = nome;
-                nova_loja.id = lojas.size() +1; //podemos fazer assim pois não existe remoção, apenas deslocamento
-                lojas.insert(make_pair(nova_loja.id, nova_loja));
-                cout << "Cadastrando..  " << nova_loja.nome << " | de id: " << nova_loja.id << endl;
-                return nova_loja.id;
-            }else{
-                return -1;
+            break;
+        }
+        case TipoRegistro::PRODUTO: {
+            int produto_id = r.i32(), loja_id = r.i32();
+            string nome = r.str();
+            if (!aplicar_produto(produto_id, loja_por_id(loja_id), nome, r.f32())) {
+                throw runtime_error("produto inválido no log: " + to_string(produto_id));
             }
+            ultimo_produto_id = max(ultimo_produto_id.load(), produto_id + 1);
+            break;
         }
-
-        /**
-         * Adicionando produtos em uma loja(pelo id) de um usuário(pelo token).
-         * Não é permitido adicionar um produto em um loja caso seu proprietário não seja o usuário do token passado
-         * A quantidade de um produto inserido é 0 (zero)
-         * 
-         * @return Um id do produto adicionado para ser usado em outras operações
-         */
-        int adicionar_produto(string token, int loja_id, string nome, float preco) {
-            // TODO Implementar
-            if(token_verify(token)){
-                for (auto &i : lojas){
-                    if(i.first == loja_id){
-                        Produto novo_produto;
-                        novo_produto.id = ultimo_produto_id++; //podemos fazer assim pois não existe remoção
-                        novo_produto.nome = nome;
-                        novo_produto.preco = preco;
-                        novo_produto.quantidade = 0;
-                        i.second.produtos.push_back(novo_produto);
-                        cout << "Produto inserido com sucesso. (" << nome << ")" << endl;
-                        return novo_produto.id;
-                    }
+        case TipoRegistro::PRODUTOS: {
+            int n = r.i32();
+            for (int i = 0; i < n; i++) {
+                int produto_id = r.i32(), loja_id = r.i32();
+                string nome = r.str();
+                float preco = r.f32();
+                Loja *loja = loja_por_id(loja_id);
+                if (!aplicar_produto(produto_id, loja, nome, preco)) {
+                    throw runtime_error("produto inválido no log: " + to_string(produto_id));
                 }
-            }else{
-                return -1;
+                somar_estoque(&loja->produtos.back(), r.i32());
+                ultimo_produto_id = max(ultimo_produto_id.load(), produto_id + 1);
             }
+            break;
         }
-
-        /////////////////nome.find(nome_parcial) != string::npos
-        /**
-         * Adiciona uma quantidade em um produto em uma loja(pelo id) de um usuário(pelo token).
-         * 
-         * @param token Token de acesso
-         * @param loja_id Id da loja
-         * @param produto_id Id do produto
-         * @param quantidade Quantidade a ser adicionada
-         * @return retornar novo estoque
-         */
-        int adicionar_estoque(string token, int loja_id, int produto_id, int quantidade) {
-            // TODO Implementar
-            if(token_verify(token)){
-                for (auto &i : lojas){ //map<int, Loja> lojas | id, Loja
-                    if(i.first == loja_id){ //id == loja_id
-                        vector<Produto>::iterator it;
-                        for(auto it = i.second.produtos.begin(); it != i.second.produtos.end(); it++){
-                            if(it->id == produto_id){
-                                //cout << it->quantidade << endl;
-                                it->quantidade += quantidade;
-                                return it->quantidade;
-                            }
-                        }  
-                    }
+        case TipoRegistro::ESTOQUE: {
+            int produto_id = r.i32();
+            Produto *produto = produto_por_id(produto_id);
+            if (!produto) {
+                throw runtime_error("estoque de produto inexistente no log: " + to_string(produto_id));
+            }
+            somar_estoque(produto, r.i32());
+            break;
+        }
+        case TipoRegistro::TRANSFERENCIA: {
+            int produto_id = r.i32(), origem = r.i32(), destino = r.i32();
+            Loja *loja_origem = loja_por_id(origem), *loja_destino = loja_por_id(destino);
+            if (!produto_por_id(produto_id) || !loja_origem || !loja_destino
+                || produtos_por_id[produto_id].loja != loja_origem) {
+                throw runtime_error("transferência inválida no log: " + to_string(produto_id));
+            }
+            aplicar_transferencia(loja_origem, loja_destino, produto_id);
+            break;
+        }
+        case TipoRegistro::VENDAS:
+        case TipoRegistro::VENDAS_DATADAS: {
+            bool datadas = tipo == TipoRegistro::VENDAS_DATADAS;
+            int n = r.i32();
+            for (int i = 0; i < n; i++) {
+                Venda venda;
+                venda.id = r.i32();
+                venda.comprador_id = r.i32();
+                venda.loja_id = r.i32();
+                venda.produto_id = r.i32();
+                venda.quantidade = r.i32();
+                venda.preco_unitario = r.f32();
+                venda.instante = datadas ? r.i64() : 0;
+                Produto *produto = produto_por_id(venda.produto_id);
+                if (!produto || !vendas.restaurar(venda)) {
+                    throw runtime_error("venda inválida no log: " + to_string(venda.id));
                 }
-            
+                // Sem checar o estoque: no log a venda pode vir antes da reposição que a permitiu
+                somar_estoque(produto, -venda.quantidade);
+                ranking.registrar(venda.produto_id, venda.quantidade, venda.instante);
             }
-            
-            return -1;
+            break;
         }
+    }
+}
 
+Marketplace::Marketplace() {
+}
 
-        
-
-        /**
-         * Muda um produto da loja com o id loja_origem_id para loja_destino_id
-         * Garantir que:
-         *  - loja_origem_id e loja_destino_id são do usuário
-         *  - O produto está originalmente na loja_origem
-         *  - loja_origem_id != loja_destino_id
-         * 
-         * @param token Token de acesso
-         * @param loja_origem_id Id da loja de origem
-         * @param loja_destino_id Id da loja de destino
-         * @param produto_id Id do produto
-         * @return True se a operação foi bem sucedida, false caso contrário
-         */
-        bool transferir_produto(string token, int loja_origem_id, int loja_destino_id, int produto_id) {
-            // TODO Implementar
-            if(token_verify(token)){
-                if(loja_origem_id != loja_destino_id){
-                    for (auto &i : lojas){
-                        if(i.second.id == loja_origem_id){
-                            for(auto &f : i.second.produtos){
-                                if(f.id == produto_id){
-                                    f.quantidade--;
-
-                                }   
-                            }
-                        }
-                        else if(i.second.id == loja_destino_id){
-                            for(auto &f : i.second.produtos){
-                                if(f.id == produto_id){
-                                    f.quantidade++;
-
-                                }   
-                            }
-                        }
-                    }
-                }
-            }    
-            return false;
-        }
+Marketplace::Marketplace(const string &caminho_log, PoliticaFsync politica) {
+    LogEscrita::reproduzir(caminho_log, [this](LeitorRegistro &r) { reaplicar(r); });
+    log.reset(new LogEscrita(caminho_log, politica));
+}
 
-        /**
-         * Lista de produtos do marketplace que tem a string nome_parcial no nome
-         * 
-         * @param nome_parcial String que deve aparecer no nome do produto
-         * @return Lista de produtos que tem a string nome_parcial no nome
-         */
-        vector<Produto> buscar_produtos(string nome_parcial) {
-            vector<Produto> encontrados;
-            for (auto &i : lojas){
-                for(auto &f : i.second.produtos){
-                    if (f.nome.find(nome_parcial) != string::npos){
-                        encontrados.push_back(f);
-                    }
-                }
+Marketplace::Marketplace(const string &caminho_snapshot, const string &caminho_log,
+                         PoliticaFsync politica) {
+    uint64_t lsn = 0;
+    ImagemSnapshot imagem;
+    if (imagem.abrir(caminho_snapshot)) {
+        for (size_t i = 0; i < imagem.n_usuarios(); i++) {
+            const UsuarioSnap &u = imagem.usuario(i);
+            HashSenha senha_hash{};
+            hash_de_texto(imagem.texto(u.senha_hash), senha_hash);
+            usuarios.cadastrar(imagem.texto(u.nome), imagem.texto(u.email), senha_hash);
+        }
+        for (size_t i = 0; i < imagem.n_lojas(); i++) {
+            const LojaSnap &l = imagem.loja(i);
+            if (!aplicar_loja(l.id, l.proprietario_id, imagem.texto(l.nome))) {
+                throw runtime_error("loja inválida no snapshot: " + to_string(l.id));
             }
-            return encontrados;
-        }
-
-        /**
-         * Lista de produtos de uma loja específica do marketplace que tem a string nome_parcial no nome
-         * 
-         * @param nome_parcial String que deve aparecer no nome do produto
-         * @param loja_id Id da loja
-         * @return Lista de produtos que tem a string nome_parcial no nome e que pertencem a loja especificada
-         */
-        vector<Produto> buscar_produtos(string nome_parcial, int loja_id) {
-            vector<Produto> encontrados;
-            for (auto &i : lojas){
-                if(i.first == loja_id){
-                    for(auto &f : i.second.produtos){
-                        if (f.nome.find(nome_parcial) != string::npos){
-                            encontrados.push_back(f);
-                        }
-                    }
+            Loja *loja = loja_por_id(l.id);
+            for (uint32_t j = l.primeiro_produto; j < l.primeiro_produto + l.n_produtos; j++) {
+                const ProdutoSnap &p = imagem.produto(j);
+                if (!aplicar_produto(p.id, loja, imagem.texto(p.nome), p.preco)) {
+                    throw runtime_error("produto inválido no snapshot: " + to_string(p.id));
                 }
+                somar_estoque(&loja->produtos.back(), p.quantidade);
+                ultimo_produto_id = max(ultimo_produto_id.load(), p.id + 1);
             }
-            return encontrados;
-        }
-
-        /**
-         * Lista de lojas do marketplace que tem a string nome_parcial no nome
-         * 
-         * @param nome_parcial String que deve aparecer no nome da loja
-         * @return Lista de lojas que tem a string nome_parcial no nome
-         */
-        vector<Loja> buscar_lojas(string nome_parcial) {
-            vector<Loja> encontradas;
-            for (auto &i : lojas){
-                if (i.second.nome.find(nome_parcial) != string::npos){
-                    encontradas.push_back(i.second);
-                }
+        }
+        for (size_t i = 0; i < imagem.n_vendas(); i++) {
+            const Venda &venda = imagem.venda(i);
+            if (!vendas.restaurar(venda)) {
+                throw runtime_error("venda inválida no snapshot: " + to_string(venda.id));
             }
-            return encontradas;
+            ranking.registrar(venda.produto_id, venda.quantidade, venda.instante);
+        }
+        lsn = imagem.lsn_log();
+    }
+    LogEscrita::reproduzir(caminho_log, [this](LeitorRegistro &r) { reaplicar(r); }, lsn);
+    log.reset(new LogEscrita(caminho_log, politica));
+}
+
+bool Marketplace::salvar_snapshot(const string &caminho) {
+    MEDIR(SALVAR_SNAPSHOT);
+    EscritorSnapshot escritor;
+    uint64_t lsn;
+    {
+        // Os cadastros esperam a cópia dos usuários, para o snapshot ter os mesmos do lsn
+        shared_lock<shared_mutex> trava_u(trava_usuarios);
+        VistaCatalogo v = fixar_vista(lsn);
+        for (auto &usuario : usuarios) {
+            escritor.usuario(usuario.id, usuario.email, usuario.nome, hash_como_texto(usuario.senha_hash));
         }
+        trava_u.unlock();
+        for (auto &loja : v.listar_lojas()) {
+            escritor.loja(loja.id, loja.proprietario_id, loja.nome);
+            for (auto &produto : loja.produtos) {
+                escritor.produto(produto.id, loja.id, produto.nome, produto.preco, produto.quantidade);
+            }
+        }
+        vendas.para_cada([&](const Venda &venda) { escritor.venda(venda); }, v.quantidade_vendas());
+    }
+    // O snapshot só pode apontar para uma posição do log que já está no disco
+    if (log && !log->sincronizar(lsn)) {
+        return false;
+    }
+    return escritor.gravar(caminho, lsn);
+}
+
+VistaCatalogo Marketplace::vista() {
+    uint64_t lsn;
+    return fixar_vista(lsn);
+}
+
+unique_ptr<AssinaturaEventos> Marketplace::assinar_eventos(size_t capacidade, PoliticaEventos politica) {
+    return eventos.assinar(capacidade, politica);
+}
+
+VistaCatalogo Marketplace::fixar_vista(uint64_t &lsn) {
+    VistaCatalogo v;
+    v.epoca_ = colunas.fixar(trava_catalogo, [&]() {
+        v.n_produtos = colunas.size();
+        v.n_lojas = colunas_lojas.size();
+        v.n_vendas = vendas.size();
+        v.sequencia_ = eventos.sequencia();
+        lsn = log ? log->lsn_atual() : 0;
+    });
+    v.colunas = &colunas;
+    v.lojas = &colunas_lojas;
+    return v;
+}
+
+int Marketplace::token_verify(const string &token_de_acesso) {
+    MEDIR(VERIFICA_TOKEN);
+    return usuario_do_token(token_de_acesso);
+}
+
+bool Marketplace::logout(const string &token) {
+    MEDIR(LOGOUT);
+    Token binario;
+    if (!token_de_string(token, binario)) {
+        return false;
+    }
+    unique_lock<shared_mutex> trava(trava_sessoes);
+    return acessos_liberados.revogar(binario);
+}
+
+Usuario Marketplace::usuario_por_id(int id) const {
+    shared_lock<shared_mutex> trava(trava_usuarios);
+    return usuarios.por_id(id);
+}
+
+Usuario Marketplace::usuario_por_email(const string &email) const {
+    shared_lock<shared_mutex> trava(trava_usuarios);
+    return usuarios.por_email(email);
+}
 
-        /**
-         * Lista de lojas do marketplace
-         * 
-         * @return Lista de lojas do marketplace
-         */
-        vector<Loja> listar_lojas() {
-            vector<Loja> encontradas;
+bool Marketplace::me_cadastrar(string nome, string email, string senha) {
+    MEDIR(CADASTRO);
+    if (!aceita_escritas()) {
+        return false;
+    }
+    // TODO(opcional) Implementar
+    // Buscando usuário com e-mail no cadastro
+    {
+        shared_lock<shared_mutex> trava(trava_usuarios);
+        if (usuarios.por_email(email).id != 0) {
+            return false;
+        }
+    }
+    // Se não existir, cria um novo usuário (o hash é calculado fora da trava)
+    HashSenha senha_hash = geraHash(senha);
+    uint64_t lsn;
+    {
+        unique_lock<shared_mutex> trava(trava_usuarios);
+        if (usuarios.cadastrar(nome, email, senha_hash) == 0) {
+            return false;
+        }
+        lsn = registrar(registro_cadastro(nome, email, senha_hash));
+    }
+    return duravel(lsn);
+}
 
-            for (auto &&i : lojas){
-                encontradas.push_back(i.second);
+vector<bool> Marketplace::me_cadastrar(const vector<Cadastro> &cadastros) {
+    MEDIR(CADASTRO_LOTE);
+    if (!aceita_escritas()) {
+        return vector<bool>(cadastros.size(), false);
+    }
+    vector<string> senhas;
+    senhas.reserve(cadastros.size());
+    for (auto &cadastro : cadastros) {
+        senhas.push_back(cadastro.senha);
+    }
+    vector<HashSenha> hashes = geraHashes(senhas);
+    vector<bool> feitos(cadastros.size(), false);
+    uint64_t lsn = 0;
+    {
+        unique_lock<shared_mutex> trava(trava_usuarios);
+        usuarios.reservar(usuarios.size() + cadastros.size());
+        for (size_t i = 0; i < cadastros.size(); i++) {
+            const Cadastro &cadastro = cadastros[i];
+            if (usuarios.cadastrar(cadastro.nome, cadastro.email, hashes[i]) != 0) {
+                feitos[i] = true;
+                lsn = registrar(registro_cadastro(cadastro.nome, cadastro.email, hashes[i]));
             }
+        }
+    }
+    if (!duravel(lsn)) {
+        feitos.assign(feitos.size(), false);
+    }
+    return feitos;
+}
 
-            return encontradas;
-        }
-
-        /**
-         * Cria uma nova Venda para o usuário com acesso com esse token,
-         * para o produto especificado, para a loja desse produto e com a quantidade especificada.
-         * 
-         * @param token Token de acesso
-         * @param produto_id Id do produto
-         * @param quantidade Quantidade a ser vendida
-         * @return Id da venda criada ou -1 caso não seja possível criar a venda
-         */
-        int comprar_produto(string token, int produto_id, int quantidade) {
-            
-            int id_usuario = token_verify(token);
-            if(id_usuario > 0){
-                Venda venda;
-                venda.id = ultima_venda_id++;
-                venda.comprador_id = id_usuario;
-                venda.quantidade = quantidade;
-                for (auto i : lojas){
-                    for(auto it = i.second.produtos.begin(); it != i.second.produtos.end(); it++){
-                        if(it->id == produto_id){
-                            venda.loja_id = i.first;
-                            venda.preco_unitario = it->preco;
-                        }
-                    }
-                }
-            return venda.id;
+string Marketplace::login(string email, string senha) {
+    MEDIR(LOGIN);
+    // TODO(opcional) Implementar
+    // Buscando usuário com e-mail no cadastro
+    int usuario_id;
+    HashSenha senha_hash_cadastrada;
+    {
+        shared_lock<shared_mutex> trava(trava_usuarios);
+        const Usuario &usuario = usuarios.por_email(email);
+        usuario_id = usuario.id;
+        senha_hash_cadastrada = usuario.senha_hash;
+    }
+    // Se não existir, retorna "invalid"
+    if (usuario_id == 0) {
+        return "invalid";
+    }
+    // Se existir, verifica se a senha está correta
+    HashSenha senha_hash = geraHash(senha);
+    if (hashes_iguais(senha_hash_cadastrada, senha_hash)) {
+        // Se estiver correta, gera um token de acesso
+        // e armazena o token de acesso e o id do usuário (gerando outro em caso de colisão)
+        Token token_de_acesso = genRandomToken();
+        unique_lock<shared_mutex> trava(trava_sessoes);
+        while (!acessos_liberados.inserir(token_de_acesso, usuario_id)) {
+            token_de_acesso = genRandomToken();
+        }
+        return token_para_string(token_de_acesso);
+    }
+    return "invalid";
+}
+
+int Marketplace::criar_loja(string token, string nome) {
+    MEDIR(CRIAR_LOJA);
+    if (!aceita_escritas()) {
+        return -1;
+    }
+    // TODO Implementar
+    int id_usuario = usuario_do_token(token);
+    if (id_usuario > 0){
+        int loja_id;
+        uint64_t lsn;
+        {
+            unique_lock<shared_mutex> trava(trava_catalogo);
+            loja_id = lojas.size() +1; //podemos fazer assim pois não existe remoção, apenas deslocamento
+            if (!aplicar_loja(loja_id, id_usuario, nome)) {
+                return -1; // Sem espaço em ColunasLojas
             }
+            lsn = registrar(Registro(TipoRegistro::LOJA).i32(loja_id).i32(id_usuario).str(nome));
+            Evento evento;
+            evento.tipo = TipoEvento::LOJA_CRIADA;
+            evento.loja_id = loja_id;
+            evento.usuario_id = id_usuario;
+            evento.nome = loja_por_id(loja_id)->nome;
+            eventos.publicar(&evento, 1);
+        }
+        if (!duravel(lsn)) {
+            return -1;
         }
+        cout << "Cadastrando..  " << nome << " | de id: " << loja_id << endl;
+        return loja_id;
+    }else{
+        return -1;
+    }
+}
 
+int Marketplace::adicionar_produto(string token, int loja_id, string nome, float preco) {
+    MEDIR(ADICIONAR_PRODUTO);
+    if (!aceita_escritas()) {
+        return -1;
+    }
+    int id_usuario = usuario_do_token(token);
+    int produto_id;
+    uint64_t lsn;
+    {
+        unique_lock<shared_mutex> trava(trava_catalogo);
+        Loja *loja = loja_por_id(loja_id);
+        if(id_usuario <= 0 || !loja || loja->proprietario_id != id_usuario){
+            return -1;
+        }
+        produto_id = ultimo_produto_id; //podemos fazer assim pois não existe remoção
+        if (!aplicar_produto(produto_id, loja, nome, preco)) {
+            return -1; // Catálogo cheio (ColunasProdutos::MAX_PRODUTOS)
+        }
+        ultimo_produto_id++;
+        lsn = registrar(Registro(TipoRegistro::PRODUTO).i32(produto_id).i32(loja_id).str(nome).f32(preco));
+        Evento evento;
+        evento.tipo = TipoEvento::PRODUTO_ADICIONADO;
+        evento.loja_id = loja_id;
+        evento.produto_id = produto_id;
+        evento.preco = preco;
+        evento.nome = loja->produtos.back().nome;
+        eventos.publicar(&evento, 1);
+    }
+    if (!duravel(lsn)) {
+        return -1;
+    }
+    cout << "Produto inserido com sucesso. (" << nome << ")" << endl;
+    return produto_id;
+}
+
+ResultadoImportacao Marketplace::importar_produtos(const string &token, const string &caminho,
+                                                  unsigned n_threads) {
+    MEDIR(IMPORTAR_PRODUTOS);
+    if (!aceita_escritas()) {
+        throw runtime_error("o log falhou: importação recusada");
+    }
+    auto inicio = chrono::steady_clock::now();
+    ResultadoImportacao resultado;
+    int id_usuario = usuario_do_token(token);
+    if (id_usuario <= 0) {
+        return resultado;
+    }
+    if (n_threads == 0) {
+        n_threads = max(1u, thread::hardware_concurrency());
+    }
+    ArquivoMapeado arquivo(caminho);
+    vector<PedacoImportacao> pedacos = LeitorProdutos::ler(arquivo.dados(), n_threads);
 
-        // Métodos de debug (adicionar a vontade)
-        void show_usuarios() {
-            for (auto it = usuarios.begin(); it != usuarios.end(); it++) {
-                cout << it->first << " >>> " << it->second.senha_hash << endl;
-            } cout << endl;
+    // O dono de cada loja é conferido uma vez (lojas não mudam de dono nem são removidas)
+    map<int, Loja *> permitidas; // nullptr: loja recusada
+    {
+        shared_lock<shared_mutex> trava(trava_catalogo);
+        for (auto &pedaco : pedacos) {
+            int ultima = 0;
+            for (auto &linha : pedaco.linhas) {
+                if (linha.loja_id != ultima && !permitidas.count(linha.loja_id)) {
+                    Loja *loja = loja_por_id(linha.loja_id);
+                    permitidas[linha.loja_id] = loja && loja->proprietario_id == id_usuario ? loja : nullptr;
+                }
+                ultima = linha.loja_id;
+            }
         }
-        void show_tokens() {
-            for (auto it = acessos_liberados.begin(); it != acessos_liberados.end(); it++) {
-                cout << it->first << " >>> " << it->second << endl;
-            } cout << endl;
+    }
+    map<Loja *, size_t> novos_por_loja;
+    for (auto &pedaco : pedacos) {
+        resultado.linhas += pedaco.n_linhas;
+        resultado.invalidas += pedaco.invalidas;
+        size_t aceitas = 0;
+        for (auto &linha : pedaco.linhas) {
+            Loja *loja = permitidas[linha.loja_id];
+            if (loja) {
+                pedaco.linhas[aceitas++] = linha;
+                novos_por_loja[loja]++;
+            }
         }
+        resultado.recusadas += pedaco.linhas.size() - aceitas;
+        pedaco.linhas.resize(aceitas);
+        resultado.importados += aceitas;
+    }
+    // O índice de busca de cada pedaço é montado em paralelo e juntado de uma vez
+    LeitorProdutos::indexar(pedacos);
 
-        void show_all(){
-            cout << "lojas" << endl;
-            for(auto i : lojas){
-                cout << i.second.nome << endl;
-                cout << i.second.produtos.size() << endl;
+    uint64_t lsn = 0;
+    {
+        unique_lock<shared_mutex> trava(trava_catalogo);
+        int id = ultimo_produto_id;
+        if ((size_t)id + resultado.importados > ColunasProdutos::MAX_PRODUTOS) {
+            // Não cabe no catálogo: nada é importado
+            resultado.recusadas += resultado.importados;
+            resultado.importados = 0;
+            return resultado;
+        }
+        ultimo_produto_id += resultado.importados;
+        resultado.primeiro_id = resultado.importados > 0 ? id : -1;
+        produtos_por_id.resize(id + resultado.importados);
+        for (auto &i : novos_por_loja) {
+            i.first->produtos.reserve(i.first->produtos.size() + i.second);
+        }
+        bool publicar = eventos.ativo();
+        vector<Evento> lote;
+        for (auto &pedaco : pedacos) {
+            int primeiro = id;
+            Registro registro(TipoRegistro::PRODUTOS);
+            registro.i32(pedaco.linhas.size());
+            for (auto &linha : pedaco.linhas) {
+                Loja *loja = permitidas[linha.loja_id];
+                aplicar_produto(id, loja, linha.nome, linha.preco, false);
+                Produto &produto = loja->produtos.back();
+                if (linha.quantidade > 0) {
+                    somar_estoque(&produto, linha.quantidade);
+                }
+                if (log) {
+                    registro.i32(id).i32(linha.loja_id).str(linha.nome).f32(linha.preco).i32(linha.quantidade);
+                }
+                if (publicar) {
+                    Evento evento;
+                    evento.tipo = TipoEvento::PRODUTO_ADICIONADO;
+                    evento.loja_id = linha.loja_id;
+                    evento.produto_id = id;
+                    evento.preco = linha.preco;
+                    evento.nome = produto.nome;
+                    lote.push_back(evento);
+                    if (linha.quantidade > 0) {
+                        evento = Evento();
+                        evento.tipo = TipoEvento::ESTOQUE_ALTERADO;
+                        evento.loja_id = linha.loja_id;
+                        evento.produto_id = id;
+                        evento.quantidade = linha.quantidade;
+                        evento.estoque = linha.quantidade;
+                        lote.push_back(evento);
+                    }
+                }
+                id++;
             }
+            indice_produtos.juntar(pedaco.indice, primeiro, pedaco.linhas.size());
+            if (!pedaco.linhas.empty()) {
+                lsn = registrar(registro);
+            }
+            eventos.publicar(lote.data(), lote.size());
+            lote.clear();
         }
+    }
+    if (!duravel(lsn)) {
+        throw runtime_error("falha ao gravar a importação no log");
+    }
+    resultado.segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    return resultado;
+}
 
-};
+int Marketplace::adicionar_estoque(string token, int loja_id, int produto_id, int quantidade) {
+    MEDIR(ADICIONAR_ESTOQUE);
+    if (!aceita_escritas()) {
+        return -1;
+    }
+    int id_usuario = usuario_do_token(token);
+    int novo_estoque;
+    uint64_t lsn;
+    {
+        shared_lock<shared_mutex> trava(trava_catalogo);
+        Produto *produto = produto_por_id(produto_id);
+        if(id_usuario <= 0 || !produto){
+            return -1;
+        }
+        Loja *loja = produtos_por_id[produto_id].loja;
+        if(loja->id != loja_id || loja->proprietario_id != id_usuario){
+            return -1;
+        }
+        novo_estoque = somar_estoque(produto, quantidade);
+        lsn = registrar(Registro(TipoRegistro::ESTOQUE).i32(produto_id).i32(quantidade));
+        Evento evento;
+        evento.tipo = TipoEvento::ESTOQUE_ALTERADO;
+        evento.loja_id = loja_id;
+        evento.produto_id = produto_id;
+        evento.quantidade = quantidade;
+        evento.estoque = novo_estoque;
+        eventos.publicar(&evento, 1);
+    }
+    if (!duravel(lsn)) {
+        return -1;
+    }
+    return novo_estoque;
+}
 
+bool Marketplace::transferir_produto(string token, int loja_origem_id, int loja_destino_id, int produto_id) {
+    MEDIR(TRANSFERIR_PRODUTO);
+    if (!aceita_escritas()) {
+        return false;
+    }
+    int id_usuario = usuario_do_token(token);
+    unique_lock<shared_mutex> trava(trava_catalogo);
+    if(id_usuario <= 0 || loja_origem_id == loja_destino_id || !produto_por_id(produto_id)){
+        return false;
+    }
+    Loja *origem = loja_por_id(loja_origem_id);
+    Loja *destino = loja_por_id(loja_destino_id);
+    LocalProduto &local = produtos_por_id[produto_id];
+    if(!origem || !destino || local.loja != origem
+        || origem->proprietario_id != id_usuario || destino->proprietario_id != id_usuario){
+        return false;
+    }
+    aplicar_transferencia(origem, destino, produto_id);
+    uint64_t lsn = registrar(Registro(TipoRegistro::TRANSFERENCIA)
+                                 .i32(produto_id).i32(loja_origem_id).i32(loja_destino_id));
+    Evento evento;
+    evento.tipo = TipoEvento::PRODUTO_TRANSFERIDO;
+    evento.loja_id = loja_destino_id;
+    evento.produto_id = produto_id;
+    evento.loja_origem_id = loja_origem_id;
+    eventos.publicar(&evento, 1);
+    trava.unlock();
+    return duravel(lsn);
+}
+
+vector<Produto> Marketplace::buscar_produtos(string nome_parcial) {
+    MEDIR(BUSCAR_PRODUTOS);
+    vector<Produto> encontrados;
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    for (int id : ids_produtos_com_nome(nome_parcial, 0)){
+        encontrados.push_back(*produto_por_id(id));
+    }
+    return encontrados;
+}
+
+vector<Produto> Marketplace::buscar_produtos(string nome_parcial, int loja_id) {
+    MEDIR(BUSCAR_PRODUTOS);
+    vector<Produto> encontrados;
+    if (loja_id == 0) {
+        return encontrados; // 0 não é id de loja (ids começam em 1)
+    }
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    for (int id : ids_produtos_com_nome(nome_parcial, loja_id)){
+        encontrados.push_back(*produto_por_id(id));
+    }
+    return encontrados;
+}
 
-int main() {
-    Marketplace marketplace;
+vector<Loja> Marketplace::buscar_lojas(string nome_parcial) {
+    MEDIR(BUSCAR_LOJAS);
+    vector<Loja> encontradas;
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    for (int id : ids_lojas_com_nome(nome_parcial)){
+        encontradas.push_back(*loja_por_id(id));
+    }
+    return encontradas;
+}
 
-    bool cadastro1_ok, cadastro2_ok;
-    cout << endl << "=~= TESTE - CADASTRO =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
-    cadastro1_ok = marketplace.me_cadastrar("João", "joao@gmail.com", "123456");
-    testa(cadastro1_ok, "Cadastro de usuário 1");
-    cadastro2_ok = marketplace.me_cadastrar("Maria", "maria@gmail.com", "654321");
-    testa(cadastro2_ok, "Cadastro de usuário 2");
+vector<Loja> Marketplace::listar_lojas() {
+    MEDIR(LISTAR_LOJAS);
+    vector<Loja> encontradas;
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    for (auto &&i : lojas){
+        encontradas.push_back(i.second);
+    }
 
-    cout << "=~= TESTE - USUARIOS =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
-    marketplace.show_usuarios();
+    return encontradas;
+}
 
-    if ( !cadastro1_ok || !cadastro2_ok) {
-        cout << "Cadastro de João ou Maria nao realizado" << endl;
+int Marketplace::comprar_produto(string token, int produto_id, int quantidade) {
+    MEDIR(COMPRAR_PRODUTO);
+    if (!aceita_escritas()) {
         return -1;
     }
-
-    cout << endl << "=~= TESTE - TOKENS =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
-    //string invalid_token = marketplace.login("inexistente@hotmail.com", "senha qualquer");
-    //testa(invalid_token == "invalid", "login de usuario inexistente");
     
-    string joao_token = marketplace.login("joao@gmail.com", "123456");
-    testa(joao_token != "invalid", "login de usuario valido");
-    cout << "Token de acesso recebido para João: " << joao_token << endl;
-
-    string maria_token = marketplace.login("maria@gmail.com", "654321");
-    testa(maria_token != "invalid", "login de usuario valido");
-    cout << "Token de acesso recebido para Maria: " << maria_token << endl;
-
-    cout << endl << "=~= TESTE - MARKETPLACE =~=~=~=~=~=~=~=~=~==~=~=~=~=~=~=~=~=~=" << endl << endl;
-    cout << "Login do usuário..." << endl;
-    if (joao_token != "invalid") {
-        cout << "Usuário logado com sucesso" << endl;
-
-        cout<< endl  << "=~= Teste de cadastro de loja pelo Usuário logado =~=~=~=~=~=~=" << endl << endl;
-        // João cria duas lojas com o seu token de acesso
-        int bodega_do_joao_id = marketplace.criar_loja(joao_token, "Bodega do João");
-        testa(bodega_do_joao_id != -1, "Cadastro de loja");
-        int acougue_do_joao_id = marketplace.criar_loja(joao_token, "Açougue do João");
-        testa(acougue_do_joao_id != -1, "Cadastro de loja");
-        int bodega_da_maria_id = marketplace.criar_loja(maria_token, "Bodega da Maria");
-        testa(bodega_da_maria_id != -1, "Cadastro de loja");
-        
-        cout<< endl  << "=~=Teste de adição de produto à loja pelo Usuário logado =~=~=~=~=~=~=" << endl << endl;
-        // João adiciona produtos na loja e altera o seu estoque
-        int leite_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Leite em pó", 8.40);
-        testa(leite_id != -1, "Cadastro de produto");
-        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, leite_id, 10);
-        
-        cout<< endl  << "=~= Teste de incremento de estoque pelo Usuário logado =~=~=~=~=~=~=" << endl;
-        int novo_estoque_leite = marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, leite_id, 5);
-        testa(novo_estoque_leite == 15, "Adicionando estoque");
-        
-        int arroz_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Arroz", 3.50);
-        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, arroz_id, 40);
-        
-    
-        int coca_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Coca cola 250ml", 2.40);
-        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, coca_id, 15);
-        
-        // João adicionou um produto na loja que não deveria... Aff João...
-        int picanha_id = marketplace.adicionar_produto(joao_token, bodega_do_joao_id, "Picanha Maturada", 58.40);
-        marketplace.adicionar_estoque(joao_token, bodega_do_joao_id, picanha_id, 5);
-        
-        int pic_suina_id = marketplace.adicionar_produto(joao_token, acougue_do_joao_id, "Picanha Suína", 78.40);
-        marketplace.adicionar_estoque(joao_token, acougue_do_joao_id, pic_suina_id, 8);
-        
-        cout<< endl  << "=~= Teste de transferência de produto =~=~=~=~=~=~=" << endl;
-
-        // Transferindo um produto de uma loja para outrao (do mesmo usuário)
-        marketplace.transferir_produto(joao_token, bodega_do_joao_id, acougue_do_joao_id, pic_suina_id);
-
-        cout << endl << "~~~~~ Não consegui executar bem! ~~~~~" << endl;
-        cout<< endl  << "=~= Teste de venda de produto =~=~=~=~=~=~=" << endl;
-
-        marketplace.comprar_produto(joao_token, picanha_id, 1);
-        marketplace.comprar_produto(joao_token, coca_id, 1);
-        marketplace.comprar_produto(joao_token, arroz_id, 1);
-        int compra = marketplace.comprar_produto(joao_token, leite_id, 1);
-        testa(compra != -1, "Comprando produto");
-        
-        cout<< endl  << "=~= Teste de outro login e exibição dos tokens =~=~=~=~=~=~=" << endl << endl;
-        // Logar como Maria
-        if (maria_token != "invalid"){ //string maria_token = marketplace.login("maria@gmail.com", "654321");
-        cout << "Usuário logado com sucesso" << endl; //testa(maria_token != "invalid", "login de usuario valido");
-            cout << endl;
-            marketplace.comprar_produto(maria_token, pic_suina_id, 2);
-
-            int oleo_id = marketplace.adicionar_produto(maria_token, bodega_da_maria_id, "Oleo", 9.69);
-            marketplace.adicionar_estoque(maria_token, bodega_da_maria_id, oleo_id, 5);
-            cout << endl;
-
-            // Maria buscando picanha:
-            vector<Produto> picanhas = marketplace.buscar_produtos("Picanha");
-            cout << "Quantidade de picanhas encontradas: " << picanhas.size() << endl;
-            // verificando se achou picanhas e comprando a primeira
-            if (picanhas.size() > 0) {
-                marketplace.comprar_produto(maria_token, picanhas[0].id, 1);
-            }
+    int id_usuario = usuario_do_token(token);
+    if(id_usuario <= 0 || quantidade <= 0){
+        return -1;
+    }
+    vector<Venda> lote(1);
+    Venda &venda = lote[0];
+    uint64_t lsn;
+    {
+        shared_lock<shared_mutex> trava(trava_catalogo);
+        Produto *produto = produto_por_id(produto_id);
+        if(!produto){
+            return -1;
+        }
+        // Reserva o estoque com compare-and-swap: nunca vende mais do que existe
+        if(!reservar_estoque(produto, quantidade)){
+            return -1;
+        }
+        venda.comprador_id = id_usuario;
+        venda.loja_id = produtos_por_id[produto_id].loja->id;
+        venda.produto_id = produto_id;
+        venda.quantidade = quantidade;
+        venda.preco_unitario = produto->preco;
+        venda.instante = instante_atual_ms();
+        if (vendas.anexar(venda) < 0) {
+            somar_estoque(produto, quantidade); // Registro de vendas cheio: devolve a reserva
+            return -1;
+        }
+        ranking.registrar(produto_id, quantidade, venda.instante);
+        lsn = registrar(registro_vendas(lote));
+        Evento evento = evento_venda(venda);
+        eventos.publicar(&evento, 1);
+    }
+    if (!duravel(lsn)) {
+        return -1;
+    }
+    return venda.id;
+}
 
-            // Maria buscando uma loja qualquer com o nome Bodega
-            vector<Loja> bodegas = marketplace.buscar_lojas("Bodega");
-            // vendo se existe alguma bodega, se existir, comprando o primeiro produto com o nome Coca
-            cout << "Quantidade de bodegas encontradas: " << bodegas.size() << endl;
-            if (bodegas.size() > 0) {
-                vector<Produto> produtos = marketplace.buscar_produtos("Coca", bodegas[0].id);
-                cout << "Quantidade de Cocas encontradas na bodega: " << produtos.size() << endl;
-                if (produtos.size() > 0) {
-                    marketplace.comprar_produto(maria_token, produtos[0].id, 1);
-                }
-            }
+vector<int> Marketplace::comprar_carrinho(string token, const vector<pair<int, int>> &itens) {
+    MEDIR(COMPRAR_CARRINHO);
+    vector<int> ids;
+    if (!aceita_escritas()) {
+        return ids;
+    }
+    int id_usuario = usuario_do_token(token);
+    if(id_usuario <= 0 || itens.empty()){
+        return ids;
+    }
+    int64_t instante = instante_atual_ms();
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    vector<Venda> lote;
+    lote.reserve(itens.size());
+    for (auto &item : itens) {
+        Produto *produto = produto_por_id(item.first);
+        if(!produto || item.second <= 0){
+            return ids;
+        }
+        Venda venda;
+        venda.comprador_id = id_usuario;
+        venda.loja_id = produtos_por_id[item.first].loja->id;
+        venda.produto_id = item.first;
+        venda.quantidade = item.second;
+        venda.preco_unitario = produto->preco;
+        venda.instante = instante;
+        lote.push_back(venda);
+    }
+    // Agrupa por loja e junta linhas repetidas do mesmo produto
+    sort(lote.begin(), lote.end(), [](const Venda &a, const Venda &b) {
+        return a.loja_id != b.loja_id ? a.loja_id < b.loja_id : a.produto_id < b.produto_id;
+    });
+    size_t n = 0;
+    for (size_t i = 0; i < lote.size(); i++) {
+        if (n > 0 && lote[n - 1].produto_id == lote[i].produto_id) {
+            lote[n - 1].quantidade += lote[i].quantidade;
+        } else {
+            lote[n++] = lote[i];
         }
-        cout << endl << "Tokens e seus id's de usuário: " << endl;
-        marketplace.show_tokens(); // opcional. debug
-        
-        cout << "=~= Teste de exibição de lojas cadastradas =~=~=~=~=~=~=" << endl << endl;
-        // mostrando todas as lojas do marketplace
-        vector<Loja> lojas = marketplace.listar_lojas();
-        for (Loja loja : lojas) {
-            cout << loja.nome << ":" << endl;
-            for(Produto produto : loja.produtos){
-                cout << "- " << produto.nome << "; \t" << endl;
+    }
+    lote.resize(n);
+    for (size_t i = 0; i < lote.size(); i++) {
+        if(!reservar_estoque(produto_por_id(lote[i].produto_id), lote[i].quantidade)){
+            // Desfaz as reservas anteriores
+            for (size_t j = 0; j < i; j++) {
+                somar_estoque(produto_por_id(lote[j].produto_id), lote[j].quantidade);
             }
-            cout << endl;
+            return ids;
         }
-        
-    } else {
-        cout << "Usuário não pode se logar" << endl;
+    }
+    if (vendas.anexar_lote(lote) < 0) {
+        // Registro de vendas cheio: devolve as reservas
+        for (auto &venda : lote) {
+            somar_estoque(produto_por_id(venda.produto_id), venda.quantidade);
+        }
+        return ids;
+    }
+    for (auto &venda : lote) {
+        ranking.registrar(venda.produto_id, venda.quantidade, venda.instante);
+    }
+    uint64_t lsn = registrar(registro_vendas(lote));
+    if (eventos.ativo()) {
+        vector<Evento> criados;
+        for (auto &venda : lote) {
+            criados.push_back(evento_venda(venda));
+        }
+        eventos.publicar(criados.data(), criados.size());
+    }
+    trava.unlock();
+    if (!duravel(lsn)) {
+        return ids;
+    }
+    for (auto &venda : lote) {
+        ids.push_back(venda.id);
+    }
+    return ids;
+}
+
+size_t Marketplace::quantidade_vendas() {
+    return vendas.size();
+}
+
+ResumoVendas Marketplace::vendas_da_loja(int loja_id) const {
+    MEDIR(RELATORIO_VENDAS);
+    return vendas.agregados().por_loja(loja_id);
+}
+
+ResumoVendas Marketplace::vendas_do_produto(int produto_id) const {
+    MEDIR(RELATORIO_VENDAS);
+    return vendas.agregados().por_produto(produto_id);
+}
 
-        
+ResumoVendas Marketplace::vendas_do_comprador(int comprador_id) const {
+    MEDIR(RELATORIO_VENDAS);
+    return vendas.agregados().por_comprador(comprador_id);
+}
+
+vector<ItemRanking> Marketplace::mais_vendidos(size_t k, int loja_id) {
+    MEDIR(MAIS_VENDIDOS);
+    if (loja_id == 0) {
+        shared_lock<shared_mutex> trava(trava_catalogo);
+        return ranking.mais_vendidos(k);
+    }
+    vector<ItemRanking> itens;
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    Loja *loja = loja_por_id(loja_id);
+    if (!loja) {
+        return itens;
+    }
+    for (auto &produto : loja->produtos) {
+        ResumoVendas resumo = vendas.agregados().por_produto(produto.id);
+        if (resumo.unidades > 0) {
+            itens.push_back(ItemRanking{produto.id, resumo.unidades, 0});
+        }
     }
+    k = min(k, itens.size());
+    partial_sort(itens.begin(), itens.begin() + k, itens.end(), [](const ItemRanking &a, const ItemRanking &b) {
+        return a.unidades != b.unidades ? a.unidades > b.unidades : a.produto_id < b.produto_id;
+    });
+    itens.resize(k);
+    return itens;
+}
+
+vector<ItemRanking> Marketplace::em_alta(size_t k, int minutos) {
+    MEDIR(MAIS_VENDIDOS);
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    return ranking.em_alta(k, minutos, instante_atual_ms());
+}
+
+void Marketplace::configurar_ranking(size_t capacidade, int minutos) {
+    unique_lock<shared_mutex> trava(trava_catalogo);
+    ranking = RankingVendas(capacidade, minutos);
 }
 
+vector<pair<int64_t, ResumoVendas>> Marketplace::vendas_por_hora(int64_t de_ms, int64_t ate_ms) const {
+    MEDIR(RELATORIO_VENDAS);
+    return vendas.agregados().por_hora(de_ms, ate_ms);
+}
+
+void Marketplace::show_usuarios() {
+    shared_lock<shared_mutex> trava(trava_usuarios);
+    for (auto &usuario : usuarios) {
+        cout << usuario.email << " >>> " << picosha2::bytes_to_hex_string(usuario.senha_hash) << endl;
+    } cout << endl;
+}
+
+void Marketplace::show_tokens() {
+    shared_lock<shared_mutex> trava(trava_sessoes);
+    acessos_liberados.para_cada([](const Token &token, int usuario_id) {
+        cout << token_para_string(token) << " >>> " << usuario_id << endl;
+    }); cout << endl;
+}
+
+void Marketplace::show_all() {
+    shared_lock<shared_mutex> trava(trava_catalogo);
+    cout << "lojas" << endl;
+    for(auto i : lojas){
+        cout << i.second.nome << endl;
+        cout << i.second.produtos.size() << endl;
+    }
+}
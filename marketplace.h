@@ -0,0 +1,700 @@
+/**
+ * @file marketplace.h
+ * @author Isaac Franco (isaacfranco@imd.ufrn.br)
+ * @version 0.1
+ * @date 2022-01-27
+ * 
+ * @brief Marketplace em C++
+ * 
+ */
+
+#ifndef MARKETPLACE_H
+#define MARKETPLACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "utils.h"
+#include "sessoes.h"
+#include "nomes.h"
+#include "usuarios.h"
+#include "indice_busca.h"
+#include "colunas.h"
+#include "vendas.h"
+#include "mais_vendidos.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "metricas.h"
+#include "eventos.h"
+#include "importacao.h"
+
+using namespace std;
+
+/**
+ * Estoque de um produto: um int atômico que pode ser copiado junto com o Produto
+ * (a cópia leva o valor lido no momento).
+ */
+class Estoque {
+    private:
+    atomic<int> valor;
+
+    public:
+    Estoque(int valor = 0) : valor(valor) {
+    }
+
+    Estoque(const Estoque &outro) : valor(outro.valor.load(memory_order_relaxed)) {
+    }
+
+    Estoque &operator=(const Estoque &outro) {
+        valor.store(outro.valor.load(memory_order_relaxed), memory_order_relaxed);
+        return *this;
+    }
+
+    operator int() const {
+        return valor.load(memory_order_relaxed);
+    }
+
+    /**
+     * @return O novo estoque
+     */
+    int adicionar(int quantidade) {
+        return valor.fetch_add(quantidade, memory_order_relaxed) + quantidade;
+    }
+
+    /**
+     * Retira quantidade do estoque se houver o suficiente (compare-and-swap, sem trava).
+     * @return true se a quantidade foi reservada
+     */
+    bool reservar(int quantidade) {
+        int atual = valor.load(memory_order_relaxed);
+        while (atual >= quantidade) {
+            if (valor.compare_exchange_weak(atual, atual - quantidade, memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+class Produto {
+    public:
+    int id; // número incremental
+    Nome nome; // Texto no PoolNomes do Marketplace
+    float preco;
+    Estoque quantidade;
+};
+
+class Loja {
+    public:
+    int id; // número incremental
+    Nome nome; // Texto no PoolNomes do Marketplace
+    int proprietario_id; // Id do Usuario dono da loja
+    vector<Produto> produtos;
+};
+
+
+// Onde um produto está guardado: a loja e a posição em Loja::produtos
+class LocalProduto {
+    public:
+    Loja *loja = nullptr; // nullptr se o id não existe
+    size_t posicao = 0;
+};
+
+/**
+ * Uma página de resultados sem cópia: ponteiros para os objetos guardados no Marketplace.
+ * Só é entregue dentro dos Marketplace::ler_pagina_*, com a trava do catálogo; os ponteiros
+ * não valem depois deles. Para guardar um resultado, copie o objeto ou o id, que é estável.
+ */
+template <typename T>
+class Pagina {
+    public:
+    vector<const T *> itens;
+    int proximo_cursor = -1; // Cursor da próxima página, ou -1 se esta foi a última
+};
+
+
+/**
+ * O catálogo (lojas, produtos e estoques) como estava num instante, para leituras longas
+ * sem trava enquanto compras, reposições e novos produtos continuam. Criada por
+ * Marketplace::vista(); enquanto existir, as escritas guardam o estado anterior dos
+ * produtos que alteram, e esse estado é liberado quando a última vista que o usa é
+ * destruída. Não deve viver mais que o Marketplace.
+ *
+ * Os produtos vêm em ordem de id (dentro de cada loja, nos resultados por loja).
+ */
+class VistaCatalogo {
+    private:
+    ColunasProdutos *colunas = nullptr; // nullptr depois de movida
+    const ColunasLojas *lojas = nullptr;
+    uint32_t epoca_ = 0;
+    size_t n_produtos = 0, n_lojas = 0, n_vendas = 0;
+    uint64_t sequencia_ = 0;
+
+    friend class Marketplace;
+
+    VistaCatalogo() {
+    }
+
+    public:
+    VistaCatalogo(VistaCatalogo &&outra);
+    VistaCatalogo &operator=(VistaCatalogo &&outra);
+    ~VistaCatalogo();
+
+    /**
+     * Chama f(produto, loja_id) para cada produto da vista, em ordem de id.
+     */
+    template <typename F>
+    void para_cada_produto(F f) const;
+
+    /**
+     * Lojas com os seus produtos, em ordem de id.
+     */
+    vector<Loja> listar_lojas() const;
+
+    /**
+     * Produtos que tem nome_parcial no nome, em ordem de loja e, dentro da loja, de id.
+     * @param loja_id Restringe a essa loja; 0 para todas
+     */
+    vector<Produto> buscar_produtos(const string &nome_parcial, int loja_id = 0) const;
+
+    /**
+     * Vendas feitas até a vista (os ids menores que isso).
+     */
+    size_t quantidade_vendas() const;
+
+    /**
+     * Sequência do primeiro evento (ver CanalEventos) que não está na vista: uma cópia
+     * iniciada da vista aplica os eventos com sequência a partir dessa.
+     */
+    uint64_t sequencia() const;
+
+    uint32_t epoca() const;
+};
+
+
+/**
+ * Pode ser usado por várias threads ao mesmo tempo. Travas:
+ *  - trava_catalogo: estrutura de lojas, produtos e índices. Exclusiva para criar loja,
+ *    adicionar produto e transferir; compartilhada para o resto.
+ * trava_usuarios e trava_sessoes são independentes e nunca ficam presas junto com a outra.
+ * O estoque (Estoque) e o registro de vendas (RegistroVendas) são atômicos e não têm trava:
+ * compras e reposições só usam trava_catalogo compartilhada.
+ * Leituras só usam travas compartilhadas, então não bloqueiam umas às outras.
+ * Leituras longas que precisam de um estado consistente usam vista(): a trava exclusiva
+ * fica presa só para fixar a versão, e a leitura segue sem trava.
+ *
+ * Opcionalmente as operações que alteram o estado são gravadas num LogEscrita e
+ * reaplicadas ao abrir o Marketplace de novo com o mesmo arquivo. As sessões não são
+ * gravadas: depois de reiniciar os usuários precisam fazer login de novo.
+ */
+class Marketplace {
+    private:
+    TabelaUsuarios usuarios; // Por id e por email
+    map<int, Loja> lojas; // Chave: id da loja, Valor: Loja
+    
+    ArmazemSessoes acessos_liberados; // Chave: token_de_acesso, Valor: id_do_usuario
+    
+    vector<LocalProduto> produtos_por_id; // Índice: id do produto -> local do produto
+    PoolNomes nomes; // Nomes de lojas e produtos (nomes repetidos são guardados uma vez)
+    IndiceTrigramas indice_produtos; // Índice de busca: Produto::nome -> id do produto
+    IndiceTrigramas indice_lojas; // Índice de busca: Loja::nome -> id da loja
+    ColunasProdutos colunas; // Preço, estoque e loja por id do produto, para varreduras e vistas
+    ColunasLojas colunas_lojas; // Nome e dono por id da loja, para as vistas
+
+    RegistroVendas vendas; // O id da venda é a sua posição
+    RankingVendas ranking; // Mais vendidos e em alta, aproximados; alimentado a cada venda
+    atomic<int> ultimo_produto_id{0};
+
+    mutable shared_mutex trava_usuarios;
+    mutable shared_mutex trava_sessoes;
+    mutable shared_mutex trava_catalogo;
+
+    CanalEventos eventos{trava_catalogo}; // Publicado com trava_catalogo, junto com o log
+
+    unique_ptr<LogEscrita> log; // nullptr: estado só em memória
+
+        // Loja com esse id ou nullptr (os nós do map não mudam de endereço)
+        Loja *loja_por_id(int loja_id);
+
+        // Produto com esse id ou nullptr
+        Produto *produto_por_id(int produto_id);
+
+        /**
+         * Ids dos produtos que tem nome_parcial no nome, na mesma ordem da varredura
+         * loja por loja (id da loja, depois posição em Loja::produtos).
+         * @param loja_id Restringe a busca a essa loja; 0 para todas
+         */
+        vector<int> ids_produtos_com_nome(const string &nome_parcial, int loja_id);
+
+        /**
+         * Preenche a página com os produtos de id >= cursor que tem nome_parcial no nome,
+         * em ordem crescente de id, parando em limite itens.
+         */
+        void pagina_produtos(const string &nome_parcial, int loja_id, int cursor, int limite,
+                             Pagina<Produto> &pagina);
+
+        // Como pagina_produtos, para ler_pagina_preco
+        void pagina_preco(float preco_minimo, float preco_maximo, int loja_id, int cursor, int limite,
+                          Pagina<Produto> &pagina);
+
+        // Como pagina_produtos, para as lojas; nome_parcial nullptr lista todas
+        void pagina_lojas(const string *nome_parcial, int cursor, int limite, Pagina<Loja> &pagina);
+
+        /**
+         * Ids das lojas que tem nome_parcial no nome, em ordem crescente.
+         */
+        vector<int> ids_lojas_com_nome(const string &nome_parcial);
+
+        // token_verify sem medição, para as operações que já são medidas
+        int usuario_do_token(const string &token_de_acesso);
+
+        // Anexa o registro ao log, se houver. Chamado com a trava que ordena a operação.
+        uint64_t registrar(const Registro &registro);
+
+        // Espera o registro chegar ao disco (só espera com PoliticaFsync::SEMPRE). False se a
+        // gravação do log falhou: a operação já aplicada em memória é respondida como falha
+        bool duravel(uint64_t lsn);
+
+        // False se o log já falhou: as escritas são recusadas antes de mudar a memória, que
+        // assim não se afasta do disco (só as operações em andamento na falha ficam nela)
+        bool aceita_escritas() const;
+
+        // Reserva estoque do produto e da coluna de quantidade (ver Estoque::reservar)
+        bool reservar_estoque(Produto *produto, int quantidade);
+
+        // Soma ao estoque do produto e à coluna de quantidade; retorna o novo estoque
+        int somar_estoque(Produto *produto, int quantidade);
+
+        static Registro registro_cadastro(const string &nome, const string &email, const HashSenha &senha_hash);
+
+        static Registro registro_vendas(const vector<Venda> &lote);
+
+        static Evento evento_venda(const Venda &venda);
+
+        // As operações abaixo já foram validadas e são chamadas com trava_catalogo exclusiva
+        // (ou durante a reprodução do log, com uma única thread).
+
+        // False (e nada muda) se loja_id está fora de [1, MAX_LOJAS) ou já existe
+        bool aplicar_loja(int loja_id, int proprietario_id, string_view nome);
+
+        // indexar false: o nome fica para IndiceTrigramas::juntar (importação).
+        // False (e nada muda) se a loja não existe ou o id não cabe em ColunasProdutos
+        bool aplicar_produto(int produto_id, Loja *loja, string_view nome, float preco, bool indexar = true);
+
+        void aplicar_transferencia(Loja *origem, Loja *destino, int produto_id);
+
+        // Reaplica um registro do log
+        void reaplicar(LeitorRegistro &r);
+
+        // vista() que também lê o lsn do log da mesma versão
+        VistaCatalogo fixar_vista(uint64_t &lsn);
+
+    public:
+        Marketplace();
+
+        /**
+         * Marketplace persistente: reaplica o log em caminho_log (se existir) e passa a
+         * gravar nele cada operação que altera o estado. Depois que uma gravação do log
+         * falha, essas operações são recusadas (como se fossem inválidas) sem mudar nada.
+         *
+         * @param caminho_log Arquivo do log
+         * @param politica Quando chamar fsync (ver PoliticaFsync)
+         * @throws runtime_error se o log tem uma loja, produto ou venda com id fora dos limites,
+         * ou um registro que cita loja ou produto inexistente
+         */
+        Marketplace(const string &caminho_log, PoliticaFsync politica = PoliticaFsync::PERIODICA);
+
+        /**
+         * Marketplace persistente que parte de um snapshot (ver salvar_snapshot): carrega o
+         * snapshot, reaplica só a parte do log gravada depois dele e passa a gravar no log.
+         * Sem snapshot válido em caminho_snapshot, reaplica o log inteiro.
+         *
+         * @param caminho_snapshot Arquivo do snapshot
+         * @param caminho_log Arquivo do log
+         * @param politica Quando chamar fsync (ver PoliticaFsync)
+         * @throws runtime_error se o log é mais curto que a posição gravada no snapshot
+         * (o log não é o mesmo do snapshot, ou perdeu o fim), ou se o snapshot está truncado
+         * ou corrompido (ver ImagemSnapshot::abrir)
+         */
+        Marketplace(const string &caminho_snapshot, const string &caminho_log,
+                    PoliticaFsync politica = PoliticaFsync::PERIODICA);
+
+        /**
+         * Grava o estado atual (usuários, lojas, produtos com estoque e vendas) num snapshot
+         * que pode ser aberto com ImagemSnapshot ou usado para reiniciar o Marketplace.
+         * Copia o catálogo de uma VistaCatalogo, sem bloquear as escritas; só os cadastros
+         * de usuários esperam a cópia.
+         *
+         * @param caminho Arquivo do snapshot (substituído de forma atômica)
+         * @return True se o snapshot foi gravado, false caso contrário
+         */
+        bool salvar_snapshot(const string &caminho);
+
+        /**
+         * Fixa o estado atual do catálogo para ler sem trava (ver VistaCatalogo).
+         * Espera as escritas em andamento terminarem, mas não bloqueia as seguintes.
+         */
+        VistaCatalogo vista();
+
+        /**
+         * Assina os eventos de criação de loja, adição de produto, reposição de estoque,
+         * transferência e venda publicados a partir de agora (ver eventos.h). Para montar
+         * uma cópia do catálogo: assinar, criar uma vista(), copiar a vista e aplicar os
+         * eventos com sequência >= VistaCatalogo::sequencia(). A assinatura não deve viver
+         * mais que o Marketplace.
+         *
+         * @param capacidade Quantos eventos a fila do assinante guarda
+         * @param politica O que fazer quando a fila enche
+         */
+        unique_ptr<AssinaturaEventos> assinar_eventos(size_t capacidade = 1 << 16,
+                                                      PoliticaEventos politica = PoliticaEventos::DESCARTAR_ANTIGOS);
+
+        int token_verify(const string &token_de_acesso);
+
+        /**
+         * Encerra a sessão com esse token de acesso.
+         * @param token Token de acesso
+         * @return True se a sessão existia, false caso contrário
+         */
+        bool logout(const string &token);
+
+        /**
+         * @return Cópia do usuário com esse id, ou um usuário com id 0 caso não exista
+         */
+        Usuario usuario_por_id(int id) const;
+
+        /**
+         * @return Cópia do usuário com esse email, ou um usuário com id 0 caso não exista
+         */
+        Usuario usuario_por_email(const string &email) const;
+
+        /**
+         * Cadastra um usuário no marketplace, retornando true ou false se o cadastro foi realizado com sucesso.
+         * O e-mail deve ser único
+         * @param nome Nome do usuário
+         * @param email Email do usuário
+         * @param senha Senha do usuário. Deve ser armazenada em forma criptografada.
+         * @return True se o cadastro foi realizado com sucesso, false caso contrário.
+         */
+        bool me_cadastrar(string nome, string email, string senha);
+
+        /**
+         * Importação em lote: cadastra vários usuários calculando os hashes das senhas
+         * todos de uma vez (várias senhas por instrução SIMD) e pegando a trava uma vez só.
+         * @param cadastros Nome, email e senha de cada usuário
+         * @return Para cada cadastro, true se foi realizado (false se o e-mail já existia,
+         * inclusive repetido dentro do próprio lote)
+         */
+        vector<bool> me_cadastrar(const vector<Cadastro> &cadastros);
+
+        /**
+         * Tenta logar o usuário com esse e-mail / senha.
+         * Caso bem sucessido o login, deve gerar aleatoriamente um token de acesso
+         * e o par <token, usuario_id> deve ser armazenado em "acessos_liberados".
+         * @param email Email do usuário
+         * @param senha Senha do usuário.
+         * @return  token de acesso caso o login seja bem sucedido. Caso contrário, retornar "invalid"
+         */
+        string login(string email, string senha);
+
+        
+
+        /**
+         * Cria uma loja no marketplace com o nome especificado para o usuário que tem
+         * um acesso com esse token.
+         * @param token Token de acesso
+         * @param nome Nome da loja
+         * @return O id da loja, ou -1 caso o token não exista em acessos_liberados ou
+         * uma loja com esse nome já exista no marketplace
+         */
+        int criar_loja(string token, string nome);
+
+        /**
+         * Adicionando produtos em uma loja(pelo id) de um usuário(pelo token).
+         * Não é permitido adicionar um produto em um loja caso seu proprietário não seja o usuário do token passado
+         * A quantidade de um produto inserido é 0 (zero)
+         * 
+         * @return Um id do produto adicionado para ser usado em outras operações
+         */
+        int adicionar_produto(string token, int loja_id, string nome, float preco);
+
+        /**
+         * Importa os produtos de um arquivo CSV ou JSONL (formatos em importacao.h) de uma vez.
+         * O arquivo é lido e indexado em paralelo, fora da trava; o dono de cada loja é
+         * conferido uma vez por loja, e os produtos recebem ids consecutivos, na ordem do
+         * arquivo, com o estoque da linha. Linhas inválidas ou de lojas de outros usuários
+         * são contadas e puladas.
+         *
+         * @param token Token de acesso (inválido: nada é importado)
+         * @param caminho Arquivo a importar
+         * @param n_threads Threads de leitura (0: uma por núcleo)
+         * @throws runtime_error se o arquivo não puder ser lido, ou se a gravação no log falhar (ou já tiver falhado)
+         */
+        ResultadoImportacao importar_produtos(const string &token, const string &caminho,
+                                              unsigned n_threads = 0);
+
+        /////////////////nome.find(nome_parcial) != string::npos
+        /**
+         * Adiciona uma quantidade em um produto em uma loja(pelo id) de um usuário(pelo token).
+         * 
+         * @param token Token de acesso
+         * @param loja_id Id da loja
+         * @param produto_id Id do produto
+         * @param quantidade Quantidade a ser adicionada
+         * @return retornar novo estoque
+         */
+        int adicionar_estoque(string token, int loja_id, int produto_id, int quantidade);
+
+
+        
+
+        /**
+         * Muda um produto da loja com o id loja_origem_id para loja_destino_id
+         * Garantir que:
+         *  - loja_origem_id e loja_destino_id são do usuário
+         *  - O produto está originalmente na loja_origem
+         *  - loja_origem_id != loja_destino_id
+         * 
+         * @param token Token de acesso
+         * @param loja_origem_id Id da loja de origem
+         * @param loja_destino_id Id da loja de destino
+         * @param produto_id Id do produto
+         * @return True se a operação foi bem sucedida, false caso contrário
+         */
+        bool transferir_produto(string token, int loja_origem_id, int loja_destino_id, int produto_id);
+
+        /**
+         * Lista de produtos do marketplace que tem a string nome_parcial no nome
+         * 
+         * @param nome_parcial String que deve aparecer no nome do produto
+         * @return Lista de produtos que tem a string nome_parcial no nome
+         */
+        vector<Produto> buscar_produtos(string nome_parcial);
+
+        /**
+         * Lista de produtos de uma loja específica do marketplace que tem a string nome_parcial no nome
+         * 
+         * @param nome_parcial String que deve aparecer no nome do produto
+         * @param loja_id Id da loja
+         * @return Lista de produtos que tem a string nome_parcial no nome e que pertencem a loja especificada
+         */
+        vector<Produto> buscar_produtos(string nome_parcial, int loja_id);
+
+        /**
+         * Lista de lojas do marketplace que tem a string nome_parcial no nome
+         * 
+         * @param nome_parcial String que deve aparecer no nome da loja
+         * @return Lista de lojas que tem a string nome_parcial no nome
+         */
+        vector<Loja> buscar_lojas(string nome_parcial);
+
+        /**
+         * Lista de lojas do marketplace
+         * 
+         * @return Lista de lojas do marketplace
+         */
+        vector<Loja> listar_lojas();
+
+        /**
+         * Página da busca de produtos por parte do nome, sem copiar os produtos: chama
+         * f(pagina) com a trava do catálogo, e os ponteiros da página só valem dentro de f
+         * (uma escrita no catálogo depois dela pode mover os produtos). Para guardar um
+         * resultado, copie o produto ou o id dentro de f, que não deve chamar o Marketplace.
+         * Os produtos vêm em ordem de id. Com 3 bytes ou mais, a interseção do índice de
+         * busca começa no cursor e para quando a página fecha: o custo é o dos candidatos
+         * percorridos até lá (os que o índice sugere mas não contêm o nome, ou são de outra
+         * loja, também contam). Consultas mais curtas percorrem os ids a partir do cursor
+         * até fechar a página (no pior caso, o resto do catálogo); restritas a uma loja,
+         * percorrem a loja inteira a cada página.
+         *
+         * @param nome_parcial String que deve aparecer no nome do produto
+         * @param loja_id Restringe a essa loja; 0 para todas
+         * @param cursor 0 para a primeira página, ou o proximo_cursor da página anterior
+         * @param limite Quantidade máxima de produtos na página (<= 0: página vazia)
+         * @param f Chamada com a Pagina<Produto> dos produtos encontrados
+         */
+        template <typename F>
+        void ler_pagina_produtos(const string &nome_parcial, int loja_id, int cursor, int limite, F f) {
+            MEDIR(BUSCAR_PRODUTOS);
+            Pagina<Produto> pagina;
+            shared_lock<shared_mutex> trava(trava_catalogo);
+            if (limite > 0) {
+                pagina_produtos(nome_parcial, loja_id, cursor, limite, pagina);
+            }
+            f(pagina);
+        }
+
+        /**
+         * Como ler_pagina_produtos, para os produtos com preço entre preco_minimo e
+         * preco_maximo (inclusive) e estoque maior que zero, em ordem de id. A varredura usa
+         * as colunas de preço e estoque (ColunasProdutos) com SIMD quando disponível.
+         *
+         * @param preco_minimo Menor preço aceito
+         * @param preco_maximo Maior preço aceito
+         * @param loja_id Restringe a essa loja; 0 para todas
+         * @param cursor 0 para a primeira página, ou o proximo_cursor da página anterior
+         * @param limite Quantidade máxima de produtos na página (<= 0: página vazia)
+         * @param f Chamada com a Pagina<Produto> dos produtos encontrados
+         */
+        template <typename F>
+        void ler_pagina_preco(float preco_minimo, float preco_maximo, int loja_id, int cursor, int limite, F f) {
+            MEDIR(BUSCAR_PRODUTOS_PRECO);
+            Pagina<Produto> pagina;
+            shared_lock<shared_mutex> trava(trava_catalogo);
+            if (limite > 0) {
+                pagina_preco(preco_minimo, preco_maximo, loja_id, cursor, limite, pagina);
+            }
+            f(pagina);
+        }
+
+        /**
+         * Como ler_pagina_produtos, para as lojas com parte do nome, em ordem de id.
+         *
+         * @param nome_parcial String que deve aparecer no nome da loja
+         * @param cursor 0 para a primeira página, ou o proximo_cursor da página anterior
+         * @param limite Quantidade máxima de lojas na página (<= 0: página vazia)
+         * @param f Chamada com a Pagina<Loja> das lojas encontradas
+         */
+        template <typename F>
+        void ler_pagina_lojas(const string &nome_parcial, int cursor, int limite, F f) {
+            MEDIR(BUSCAR_LOJAS);
+            Pagina<Loja> pagina;
+            shared_lock<shared_mutex> trava(trava_catalogo);
+            if (limite > 0) {
+                pagina_lojas(&nome_parcial, cursor, limite, pagina);
+            }
+            f(pagina);
+        }
+
+        /**
+         * Como ler_pagina_lojas, para todas as lojas do marketplace.
+         *
+         * @param cursor 0 para a primeira página, ou o proximo_cursor da página anterior
+         * @param limite Quantidade máxima de lojas na página (<= 0: página vazia)
+         * @param f Chamada com a Pagina<Loja>
+         */
+        template <typename F>
+        void ler_lista_lojas(int cursor, int limite, F f) {
+            MEDIR(LISTAR_LOJAS);
+            Pagina<Loja> pagina;
+            shared_lock<shared_mutex> trava(trava_catalogo);
+            if (limite > 0) {
+                pagina_lojas(nullptr, cursor, limite, pagina);
+            }
+            f(pagina);
+        }
+
+        /**
+         * Cria uma nova Venda para o usuário com acesso com esse token,
+         * para o produto especificado, para a loja desse produto e com a quantidade especificada.
+         * 
+         * @param token Token de acesso
+         * @param produto_id Id do produto
+         * @param quantidade Quantidade a ser vendida
+         * @return Id da venda criada ou -1 caso não seja possível criar a venda
+         * (token inválido, produto inexistente ou estoque insuficiente)
+         */
+        int comprar_produto(string token, int produto_id, int quantidade);
+
+
+        /**
+         * Compra todos os itens do carrinho ou nenhum. O token é verificado uma vez,
+         * os itens são agrupados por loja (itens repetidos do mesmo produto viram uma
+         * só venda), o estoque de todos é reservado e, se algum faltar, as reservas já
+         * feitas são devolvidas. As vendas são registradas de uma vez, com ids consecutivos.
+         *
+         * @param token Token de acesso
+         * @param itens Pares <produto_id, quantidade>
+         * @return Ids das vendas criadas (uma por produto, em ordem de loja e produto),
+         * ou lista vazia caso não seja possível comprar o carrinho inteiro
+         */
+        vector<int> comprar_carrinho(string token, const vector<pair<int, int>> &itens);
+
+        /**
+         * @return Quantidade de vendas realizadas
+         */
+        size_t quantidade_vendas();
+
+        /**
+         * Totais de vendas da loja (receita, unidades e pedidos), sem percorrer as vendas.
+         */
+        ResumoVendas vendas_da_loja(int loja_id) const;
+
+        /**
+         * Totais de vendas do produto, sem percorrer as vendas.
+         */
+        ResumoVendas vendas_do_produto(int produto_id) const;
+
+        /**
+         * Totais das compras do usuário, sem percorrer as vendas.
+         */
+        ResumoVendas vendas_do_comprador(int comprador_id) const;
+
+        /**
+         * Os k produtos mais vendidos (em unidades).
+         * Sem loja, a resposta vem do RankingVendas: aproximada, com memória limitada
+         * e sem percorrer o catálogo (ItemRanking::erro limita o quanto a contagem pode
+         * estar acima do real). Com loja, é exata: os totais de AgregadosVendas dos
+         * produtos da loja.
+         *
+         * @param k Tamanho do ranking
+         * @param loja_id Restringe aos produtos que estão nessa loja; 0 para todas
+         * @return Os produtos em ordem decrescente de unidades
+         */
+        vector<ItemRanking> mais_vendidos(size_t k, int loja_id = 0);
+
+        /**
+         * Os k produtos mais vendidos nos últimos minutos (aproximado, ver mais_vendidos).
+         *
+         * @param k Tamanho do ranking
+         * @param minutos Tamanho da janela, até o configurado em configurar_ranking (60 por padrão)
+         * @return Os produtos em ordem decrescente de unidades na janela
+         */
+        vector<ItemRanking> em_alta(size_t k, int minutos);
+
+        /**
+         * Troca a precisão do ranking de mais vendidos pela memória usada. Zera o ranking:
+         * use antes das vendas.
+         *
+         * @param capacidade Quantidade de produtos acompanhados (mais capacidade, menos erro)
+         * @param minutos Maior janela aceita por em_alta
+         */
+        void configurar_ranking(size_t capacidade, int minutos);
+
+        /**
+         * Totais de vendas hora a hora no intervalo [de_ms, ate_ms) (milissegundos desde 1970).
+         * O custo é proporcional ao número de horas, não ao de vendas.
+         * @return Pares <início da hora, totais da hora>, só das horas com vendas
+         */
+        vector<pair<int64_t, ResumoVendas>> vendas_por_hora(int64_t de_ms, int64_t ate_ms) const;
+
+        // Métodos de debug (adicionar a vontade)
+        void show_usuarios();
+        void show_tokens();
+
+        void show_all();
+
+};
+
+template <typename F>
+void VistaCatalogo::para_cada_produto(F f) const {
+    Produto produto;
+    for (size_t id = 0; id < n_produtos; id++) {
+        int loja_id, quantidade;
+        if (colunas->ler(id, epoca_, loja_id, quantidade)) {
+            produto.id = id;
+            produto.nome = colunas->nome(id);
+            produto.preco = colunas->preco(id);
+            produto.quantidade = quantidade;
+            f(produto, loja_id);
+        }
+    }
+}
+
+#endif
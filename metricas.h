@@ -0,0 +1,389 @@
+/**
+ * @file metricas.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Contadores e histogramas de latência das operações do Marketplace
+ *
+ * Cada thread grava nos seus próprios contadores (sem trava e sem instrução atômica
+ * com lock); uma leitura soma as threads. Toda chamada é contada, mas só uma a cada
+ * Metricas::amostragem() tem o tempo medido: ler o relógio custa dezenas de ns (mais
+ * que muitas operações inteiras numa máquina virtual). Os tempos são medidos em ciclos
+ * do TSC e convertidos para nanossegundos só na leitura.
+ *
+ * Compilar com -DMARKETPLACE_SEM_METRICAS remove a medição por completo: MEDIR() vira
+ * nada e as leituras retornam tudo zerado.
+ */
+
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define METRICAS_TSC
+#endif
+
+using namespace std;
+
+enum class Operacao : int {
+    CADASTRO,
+    CADASTRO_LOTE,
+    LOGIN,
+    LOGOUT,
+    VERIFICA_TOKEN,
+    CRIAR_LOJA,
+    ADICIONAR_PRODUTO,
+    ADICIONAR_ESTOQUE,
+    TRANSFERIR_PRODUTO,
+    BUSCAR_PRODUTOS,
+    BUSCAR_PRODUTOS_PRECO,
+    BUSCAR_LOJAS,
+    LISTAR_LOJAS,
+    COMPRAR_PRODUTO,
+    COMPRAR_CARRINHO,
+    RELATORIO_VENDAS,
+    MAIS_VENDIDOS,
+    SALVAR_SNAPSHOT,
+    IMPORTAR_PRODUTOS,
+    TOTAL // Quantidade de operações; não é uma operação
+};
+
+/**
+ * Histograma log-linear (no estilo HDR): cada potência de 2 é dividida em 16 faixas
+ * iguais, o que dá no máximo ~6% de erro em qualquer percentil. Cobre de 0 a 2^48 ciclos.
+ */
+class FaixasLatencia {
+    public:
+    static const int SUBFAIXAS = 16;
+    static const int MAIOR_EXPOENTE = 47;
+    static const int N_FAIXAS = (MAIOR_EXPOENTE - 2) * SUBFAIXAS;
+
+    static int faixa(uint64_t valor) {
+        if (valor < SUBFAIXAS) {
+            return valor;
+        }
+        int expoente = 63 - __builtin_clzll(valor);
+        if (expoente > MAIOR_EXPOENTE) {
+            return N_FAIXAS - 1;
+        }
+        return (expoente - 3) * SUBFAIXAS + ((valor >> (expoente - 4)) & (SUBFAIXAS - 1));
+    }
+
+    // Menor valor que cai na faixa
+    static uint64_t inicio(int faixa) {
+        if (faixa < SUBFAIXAS) {
+            return faixa;
+        }
+        int expoente = faixa / SUBFAIXAS + 3;
+        return (uint64_t)(SUBFAIXAS + faixa % SUBFAIXAS) << (expoente - 4);
+    }
+
+    // Primeiro valor da faixa seguinte
+    static uint64_t fim(int faixa) {
+        return faixa + 1 < N_FAIXAS ? inicio(faixa + 1) : inicio(faixa) * 2;
+    }
+};
+
+/**
+ * Estatísticas de uma operação numa leitura. Tempos em nanossegundos.
+ */
+class LatenciaOperacao {
+    public:
+    uint64_t chamadas = 0;
+    uint64_t amostras = 0; // Chamadas com tempo medido
+    double media_ns = 0;
+    double p50_ns = 0, p90_ns = 0, p99_ns = 0, p999_ns = 0, maximo_ns = 0;
+};
+
+class Metricas {
+    friend class Medicao;
+
+    private:
+    // Gravados só pela thread dona; lidos por qualquer thread (por isso atômicos relaxados)
+    struct DadosThread {
+        uint32_t sequencia[(int)Operacao::TOTAL] = {}; // Só da thread dona: decide quais chamadas são medidas
+        atomic<uint64_t> chamadas[(int)Operacao::TOTAL];
+        atomic<uint64_t> contagem[(int)Operacao::TOTAL][FaixasLatencia::N_FAIXAS];
+        atomic<uint64_t> ciclos[(int)Operacao::TOTAL];
+        atomic<uint64_t> maximo[(int)Operacao::TOTAL];
+
+        DadosThread() {
+            for (int o = 0; o < (int)Operacao::TOTAL; o++) {
+                for (auto &c : contagem[o]) {
+                    c.store(0, memory_order_relaxed);
+                }
+                chamadas[o].store(0, memory_order_relaxed);
+                ciclos[o].store(0, memory_order_relaxed);
+                maximo[o].store(0, memory_order_relaxed);
+            }
+        }
+
+        void somar_em(DadosThread &destino) const {
+            for (int o = 0; o < (int)Operacao::TOTAL; o++) {
+                for (int f = 0; f < FaixasLatencia::N_FAIXAS; f++) {
+                    uint64_t c = contagem[o][f].load(memory_order_relaxed);
+                    if (c) {
+                        destino.contagem[o][f].fetch_add(c, memory_order_relaxed);
+                    }
+                }
+                destino.chamadas[o].fetch_add(chamadas[o].load(memory_order_relaxed), memory_order_relaxed);
+                destino.ciclos[o].fetch_add(ciclos[o].load(memory_order_relaxed), memory_order_relaxed);
+                uint64_t m = maximo[o].load(memory_order_relaxed);
+                if (m > destino.maximo[o].load(memory_order_relaxed)) {
+                    destino.maximo[o].store(m, memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    // Threads vivas e o que sobrou das que já terminaram
+    struct Registro {
+        mutex trava;
+        vector<DadosThread *> threads;
+        DadosThread encerradas;
+        uint64_t ciclos_inicio = Metricas::ciclos();
+        chrono::steady_clock::time_point relogio_inicio = chrono::steady_clock::now();
+    };
+
+    static Registro &registro() {
+        static Registro *r = new Registro(); // Nunca destruído: threads podem terminar depois do main
+        return *r;
+    }
+
+    // Registra os dados da thread na criação e os junta em encerradas quando ela termina
+    struct DonoThread {
+        unique_ptr<DadosThread> dados{new DadosThread()};
+
+        DonoThread() {
+            Registro &r = registro();
+            lock_guard<mutex> trava(r.trava);
+            r.threads.push_back(dados.get());
+        }
+
+        ~DonoThread() {
+            Registro &r = registro();
+            lock_guard<mutex> trava(r.trava);
+            dados->somar_em(r.encerradas);
+            r.threads.erase(find(r.threads.begin(), r.threads.end(), dados.get()));
+        }
+    };
+
+    static atomic<uint32_t> &mascara_amostragem() {
+        static atomic<uint32_t> mascara(15);
+        return mascara;
+    }
+
+    static void incrementar(atomic<uint64_t> &c, uint64_t v) {
+        c.store(c.load(memory_order_relaxed) + v, memory_order_relaxed);
+    }
+
+    public:
+    /**
+     * Mede o tempo de uma a cada n chamadas (n é arredondado para uma potência de 2;
+     * 1 mede todas). O padrão é 16.
+     */
+    static void amostrar_uma_em(uint32_t n) {
+        uint32_t potencia = 1;
+        while (potencia < n && potencia < (1u << 30)) {
+            potencia <<= 1;
+        }
+        mascara_amostragem().store(potencia - 1, memory_order_relaxed);
+    }
+
+    static uint32_t amostragem() {
+        return mascara_amostragem().load(memory_order_relaxed) + 1;
+    }
+
+    static DadosThread &locais() {
+        thread_local DonoThread dono;
+        return *dono.dados;
+    }
+
+    /**
+     * Conta uma chamada da operação.
+     * @return true se essa chamada deve ter o tempo medido (e passado para registrar)
+     */
+    static bool contar(DadosThread &d, Operacao operacao) {
+        incrementar(d.chamadas[(int)operacao], 1);
+        return (d.sequencia[(int)operacao]++ & mascara_amostragem().load(memory_order_relaxed)) == 0;
+    }
+
+    static const char *nome(Operacao operacao) {
+        static const char *nomes[] = {
+            "me_cadastrar", "me_cadastrar_lote", "login", "logout", "token_verify",
+            "criar_loja", "adicionar_produto", "adicionar_estoque", "transferir_produto",
+            "buscar_produtos", "buscar_produtos_preco", "buscar_lojas", "listar_lojas",
+            "comprar_produto", "comprar_carrinho", "relatorio_vendas", "mais_vendidos",
+            "salvar_snapshot", "importar_produtos",
+        };
+        return nomes[(int)operacao];
+    }
+
+    /**
+     * Relógio usado nas medições: o TSC em x86, nanossegundos do steady_clock nos demais.
+     */
+    static uint64_t ciclos() {
+#ifdef METRICAS_TSC
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * Guarda a duração (em ciclos) de uma chamada já contada.
+     */
+    static void registrar(DadosThread &d, Operacao operacao, uint64_t duracao) {
+        int o = (int)operacao;
+        incrementar(d.contagem[o][FaixasLatencia::faixa(duracao)], 1);
+        incrementar(d.ciclos[o], duracao);
+        if (duracao > d.maximo[o].load(memory_order_relaxed)) {
+            d.maximo[o].store(duracao, memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Lê e soma os contadores de todas as threads. Pode ser chamado enquanto as
+     * operações acontecem; cada contador é lido num instante um pouco diferente.
+     */
+    static vector<LatenciaOperacao> ler() {
+        vector<LatenciaOperacao> resultado((int)Operacao::TOTAL);
+        unique_ptr<DadosThread> soma(new DadosThread());
+        Registro &r = registro();
+        double ns_por_ciclo;
+        {
+            lock_guard<mutex> trava(r.trava);
+            r.encerradas.somar_em(*soma);
+            for (DadosThread *d : r.threads) {
+                d->somar_em(*soma);
+            }
+#ifdef METRICAS_TSC
+            // O TSC tem frequência constante: calibra com o tempo desde a criação do registro
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - r.relogio_inicio).count();
+            uint64_t passados = ciclos() - r.ciclos_inicio;
+            ns_por_ciclo = passados ? ns / passados : 1;
+#else
+            ns_por_ciclo = 1;
+#endif
+        }
+        for (int o = 0; o < (int)Operacao::TOTAL; o++) {
+            LatenciaOperacao &l = resultado[o];
+            l.chamadas = soma->chamadas[o].load(memory_order_relaxed);
+            for (int f = 0; f < FaixasLatencia::N_FAIXAS; f++) {
+                l.amostras += soma->contagem[o][f].load(memory_order_relaxed);
+            }
+            if (l.amostras == 0) {
+                continue;
+            }
+            l.media_ns = soma->ciclos[o].load(memory_order_relaxed) * ns_por_ciclo / l.amostras;
+            l.maximo_ns = soma->maximo[o].load(memory_order_relaxed) * ns_por_ciclo;
+            double *percentis[] = {&l.p50_ns, &l.p90_ns, &l.p99_ns, &l.p999_ns};
+            double fracoes[] = {0.5, 0.9, 0.99, 0.999};
+            uint64_t acumulado = 0;
+            int p = 0;
+            for (int f = 0; f < FaixasLatencia::N_FAIXAS && p < 4; f++) {
+                acumulado += soma->contagem[o][f].load(memory_order_relaxed);
+                // O meio da faixa, sem passar do máximo observado
+                double valor = min((FaixasLatencia::inicio(f) + FaixasLatencia::fim(f)) / 2.0 * ns_por_ciclo, l.maximo_ns);
+                while (p < 4 && acumulado >= fracoes[p] * l.amostras) {
+                    *percentis[p++] = valor;
+                }
+            }
+        }
+        return resultado;
+    }
+
+    /**
+     * Uma linha por operação chamada ao menos uma vez, com tempos em microssegundos.
+     */
+    static string texto() {
+        vector<LatenciaOperacao> leitura = ler();
+        ostringstream saida;
+        saida.setf(ios::fixed);
+        saida.precision(2);
+        for (int o = 0; o < (int)Operacao::TOTAL; o++) {
+            const LatenciaOperacao &l = leitura[o];
+            if (l.chamadas == 0) {
+                continue;
+            }
+            saida << nome((Operacao)o) << "\tchamadas=" << l.chamadas << "\tamostras=" << l.amostras
+                  << "\tmedia=" << l.media_ns / 1e3 << "us"
+                  << "\tp50=" << l.p50_ns / 1e3 << "us"
+                  << "\tp90=" << l.p90_ns / 1e3 << "us"
+                  << "\tp99=" << l.p99_ns / 1e3 << "us"
+                  << "\tp999=" << l.p999_ns / 1e3 << "us"
+                  << "\tmax=" << l.maximo_ns / 1e3 << "us\n";
+        }
+        return saida.str();
+    }
+
+    /**
+     * Todas as operações num objeto JSON, com tempos em nanossegundos:
+     * {"login": {"chamadas": 1, "amostras": 1, "media_ns": ..., "p50_ns": ..., ...}, ...}
+     */
+    static string json() {
+        vector<LatenciaOperacao> leitura = ler();
+        ostringstream saida;
+        saida.setf(ios::fixed);
+        saida.precision(0);
+        saida << "{";
+        for (int o = 0; o < (int)Operacao::TOTAL; o++) {
+            const LatenciaOperacao &l = leitura[o];
+            saida << (o ? ", " : "") << "\"" << nome((Operacao)o) << "\": {"
+                  << "\"chamadas\": " << l.chamadas
+                  << ", \"amostras\": " << l.amostras
+                  << ", \"media_ns\": " << l.media_ns
+                  << ", \"p50_ns\": " << l.p50_ns
+                  << ", \"p90_ns\": " << l.p90_ns
+                  << ", \"p99_ns\": " << l.p99_ns
+                  << ", \"p999_ns\": " << l.p999_ns
+                  << ", \"max_ns\": " << l.maximo_ns << "}";
+        }
+        saida << "}";
+        return saida.str();
+    }
+};
+
+/**
+ * Conta a operação e, se for uma chamada amostrada, mede o tempo de vida do objeto
+ * (o escopo da operação).
+ */
+class Medicao {
+    private:
+    Operacao operacao;
+    Metricas::DadosThread &dados;
+    uint64_t inicio;
+
+    public:
+    explicit Medicao(Operacao operacao)
+        : operacao(operacao), dados(Metricas::locais()),
+          inicio(Metricas::contar(dados, operacao) ? Metricas::ciclos() : 0) {
+    }
+
+    Medicao(const Medicao &) = delete;
+    Medicao &operator=(const Medicao &) = delete;
+
+    ~Medicao() {
+        if (inicio) {
+            Metricas::registrar(dados, operacao, Metricas::ciclos() - inicio);
+        }
+    }
+};
+
+#ifdef MARKETPLACE_SEM_METRICAS
+#define MEDIR(operacao) ((void)0)
+#else
+#define MEDIR(operacao) Medicao medicao_operacao(Operacao::operacao)
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * @file nomes.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Textos imutáveis (nomes, emails) guardados em blocos contíguos e sem repetição
+ *
+ */
+
+#ifndef NOMES_H
+#define NOMES_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Referência (8 bytes) para um texto guardado num PoolNomes: [tamanho u32][bytes]['\0'].
+ * É copiada sem alocar e vale enquanto o PoolNomes que a criou existir; para guardar o
+ * texto além disso, converta com str().
+ */
+class Nome {
+    private:
+    const char *registro;
+
+    static const char *vazio() {
+        static const char registro_vazio[sizeof(uint32_t) + 1] = {0};
+        return registro_vazio;
+    }
+
+    public:
+    Nome() : registro(vazio()) {
+    }
+
+    explicit Nome(const char *registro) : registro(registro) {
+    }
+
+    size_t size() const {
+        uint32_t n;
+        memcpy(&n, registro, sizeof n);
+        return n;
+    }
+
+    const char *data() const {
+        return registro + sizeof(uint32_t);
+    }
+
+    string_view vista() const {
+        return string_view(data(), size());
+    }
+
+    operator string_view() const {
+        return vista();
+    }
+
+    string str() const {
+        return string(data(), size());
+    }
+
+    size_t find(string_view parte) const {
+        return vista().find(parte);
+    }
+
+    // Dois Nome do mesmo PoolNomes são iguais se e só se apontam para o mesmo texto
+    bool mesmo(const Nome &outro) const {
+        return registro == outro.registro;
+    }
+
+    bool operator==(string_view outro) const {
+        return vista() == outro;
+    }
+
+    bool operator!=(string_view outro) const {
+        return vista() != outro;
+    }
+};
+
+inline ostream &operator<<(ostream &saida, const Nome &nome) {
+    return saida << nome.vista();
+}
+
+/**
+ * Guarda textos em blocos grandes (sem uma alocação por texto) e, em internar(), guarda
+ * cada texto distinto uma única vez: nomes repetidos (o mesmo produto em várias lojas)
+ * viram o mesmo Nome. Os textos nunca mudam de lugar nem são apagados.
+ * Não é seguro para várias threads escrevendo; quem usa protege com a própria trava.
+ */
+class PoolNomes {
+    private:
+    static const size_t TAMANHO_BLOCO = 1 << 16;
+
+    vector<unique_ptr<char[]>> blocos;
+    size_t livre = 0; // Bytes livres no fim do último bloco
+    char *proximo = nullptr;
+    size_t bytes_guardados = 0;
+
+    vector<const char *> tabela; // Endereçamento aberto; nullptr: vazia
+    size_t ocupadas = 0;
+
+    static uint64_t hash_texto(string_view texto) {
+        uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+        for (unsigned char c : texto) {
+            h = (h ^ c) * 0x100000001b3ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+    void redimensionar(size_t capacidade) {
+        vector<const char *> antiga;
+        antiga.swap(tabela);
+        tabela.assign(capacidade, nullptr);
+        size_t mascara = capacidade - 1;
+        for (const char *registro : antiga) {
+            if (registro) {
+                size_t i = hash_texto(Nome(registro).vista()) & mascara;
+                while (tabela[i]) {
+                    i = (i + 1) & mascara;
+                }
+                tabela[i] = registro;
+            }
+        }
+    }
+
+    public:
+    PoolNomes() = default;
+    PoolNomes(const PoolNomes &) = delete;
+    PoolNomes &operator=(const PoolNomes &) = delete;
+
+    /**
+     * Copia o texto para o pool, sem procurar repetições (para textos únicos, como emails).
+     */
+    Nome guardar(string_view texto) {
+        uint32_t n = texto.size();
+        size_t tamanho = sizeof n + n + 1;
+        if (tamanho > livre) {
+            size_t bloco = max((size_t)TAMANHO_BLOCO, tamanho);
+            blocos.emplace_back(new char[bloco]);
+            proximo = blocos.back().get();
+            livre = bloco;
+        }
+        char *registro = proximo;
+        memcpy(registro, &n, sizeof n);
+        memcpy(registro + sizeof n, texto.data(), n);
+        registro[sizeof n + n] = '\0';
+        // Mantém os registros alinhados a 4 bytes
+        size_t usado = (tamanho + 3) & ~(size_t)3;
+        usado = min(usado, livre);
+        proximo += usado;
+        livre -= usado;
+        bytes_guardados += tamanho;
+        return Nome(registro);
+    }
+
+    /**
+     * O Nome do texto, guardando-o só se ainda não estiver no pool.
+     */
+    Nome internar(string_view texto) {
+        if ((ocupadas + 1) * 2 > tabela.size()) {
+            redimensionar(tabela.empty() ? 64 : tabela.size() * 2);
+        }
+        size_t mascara = tabela.size() - 1;
+        size_t i = hash_texto(texto) & mascara;
+        for (; tabela[i]; i = (i + 1) & mascara) {
+            if (Nome(tabela[i]).vista() == texto) {
+                return Nome(tabela[i]);
+            }
+        }
+        Nome nome = guardar(texto);
+        tabela[i] = nome.data() - sizeof(uint32_t);
+        ocupadas++;
+        return nome;
+    }
+
+    /**
+     * Bytes ocupados pelos textos (sem contar o fim não usado dos blocos).
+     */
+    size_t bytes() const {
+        return bytes_guardados;
+    }
+
+    /**
+     * Quantidade de textos distintos em internar().
+     */
+    size_t distintos() const {
+        return ocupadas;
+    }
+};
+
+#endif
@@ -0,0 +1,546 @@
+/**
+ * @file particoes.cpp
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Implementação do MarketplaceParticionado (ver particoes.h)
+ */
+
+#include "particoes.h"
+#include <algorithm>
+#include <deque>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+static void futex_esperar(atomic<uint32_t> &palavra, uint32_t valor) {
+    syscall(SYS_futex, (uint32_t *)&palavra, FUTEX_WAIT_PRIVATE, valor, nullptr, nullptr, 0);
+}
+
+static void futex_acordar(atomic<uint32_t> &palavra) {
+    syscall(SYS_futex, (uint32_t *)&palavra, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+// Voltas de espera ativa antes de dormir; com um núcleo só, girar apenas atrasa quem vai responder
+static int voltas_de_espera() {
+    static const int voltas = thread::hardware_concurrency() > 1 ? 4000 : 0;
+    return voltas;
+}
+
+static inline void pausa() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+void Mensagem::concluir() {
+    if (estado.exchange(1, memory_order_acq_rel) == 2) {
+        futex_acordar(estado);
+    }
+}
+
+void Mensagem::esperar() {
+    for (int i = voltas_de_espera(); i > 0; i--) {
+        if (estado.load(memory_order_acquire) == 1) {
+            return;
+        }
+        pausa();
+    }
+    uint32_t esperado = 0;
+    if (!estado.compare_exchange_strong(esperado, 2, memory_order_acq_rel)) {
+        return; // Já pronta
+    }
+    while (estado.load(memory_order_acquire) != 1) {
+        futex_esperar(estado, 2);
+    }
+}
+
+Particao::Particao(int indice, int n_particoes, DiretorioProdutos &diretorio)
+    : diretorio(diretorio), indice(indice), n_particoes(n_particoes) {
+    executora = thread(&Particao::executar, this);
+    int nucleos = thread::hardware_concurrency();
+    if (nucleos > 0) {
+        cpu_set_t conjunto;
+        CPU_ZERO(&conjunto);
+        CPU_SET(indice % nucleos, &conjunto);
+        // Melhor esforço: sem permissão, a thread só fica sem núcleo fixo
+        pthread_setaffinity_np(executora.native_handle(), sizeof conjunto, &conjunto);
+    }
+}
+
+Particao::~Particao() {
+    MensagemDe parada([](Particao &particao) { particao.parar = true; });
+    enviar(&parada);
+    executora.join();
+}
+
+void Particao::enviar(Mensagem *m) {
+    fila.inserir(m);
+    // Par da cerca em executar: ou a thread vê a mensagem, ou aqui se vê que ela dorme
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sono.load(memory_order_relaxed) == DORMINDO && sono.exchange(ACORDADA) == DORMINDO) {
+        futex_acordar(sono);
+    }
+}
+
+void Particao::executar() {
+    while (!parar) {
+        Mensagem *m = fila.retirar();
+        for (int i = voltas_de_espera(); !m && i > 0; i--) {
+            pausa();
+            m = fila.retirar();
+        }
+        if (!m) {
+            sono.store(DORMINDO, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            m = fila.retirar();
+            if (!m) {
+                futex_esperar(sono, DORMINDO);
+            }
+            sono.store(ACORDADA, memory_order_relaxed);
+            if (!m) {
+                continue;
+            }
+        }
+        m->executar(m, *this);
+    }
+}
+
+void Particao::criar_loja(int loja_id, int proprietario_id, string_view nome) {
+    Loja nova_loja;
+    nova_loja.id = loja_id;
+    nova_loja.proprietario_id = proprietario_id;
+    nova_loja.nome = nomes.internar(nome);
+    lojas.insert(make_pair(nova_loja.id, nova_loja));
+    indice_lojas.adicionar(nova_loja.id, nova_loja.nome);
+}
+
+int Particao::proprietario(int loja_id) const {
+    auto it = lojas.find(loja_id);
+    return it == lojas.end() ? 0 : it->second.proprietario_id;
+}
+
+int Particao::adicionar_produto(int usuario_id, int loja_id, string_view nome, float preco) {
+    auto it = lojas.find(loja_id);
+    if (it == lojas.end() || it->second.proprietario_id != usuario_id) {
+        return -1;
+    }
+    Loja &loja = it->second;
+    Produto novo_produto;
+    novo_produto.id = proximo_produto++ * n_particoes + indice;
+    novo_produto.nome = nomes.internar(nome);
+    novo_produto.preco = preco;
+    novo_produto.quantidade = 0;
+    loja.produtos.push_back(novo_produto);
+    produtos[novo_produto.id] = LocalProduto{&loja, loja.produtos.size() - 1};
+    indice_produtos.adicionar(novo_produto.id, nome);
+    indexados.insert(novo_produto.id);
+    diretorio.gravar(novo_produto.id, indice);
+    return novo_produto.id;
+}
+
+int Particao::adicionar_estoque(int usuario_id, int loja_id, int produto_id, int quantidade) {
+    auto it = produtos.find(produto_id);
+    if (it == produtos.end() || it->second.loja->id != loja_id || it->second.loja->proprietario_id != usuario_id) {
+        return -1;
+    }
+    return it->second.loja->produtos[it->second.posicao].quantidade.adicionar(quantidade);
+}
+
+int Particao::comprar(int usuario_id, int produto_id, int quantidade) {
+    auto it = produtos.find(produto_id);
+    if (it == produtos.end()) {
+        return NAO_ESTA;
+    }
+    Produto &produto = it->second.loja->produtos[it->second.posicao];
+    if (!produto.quantidade.reservar(quantidade)) {
+        return -1;
+    }
+    Venda venda;
+    venda.id = (int)vendas.size() * n_particoes + indice;
+    venda.comprador_id = usuario_id;
+    venda.loja_id = it->second.loja->id;
+    venda.produto_id = produto_id;
+    venda.quantidade = quantidade;
+    venda.preco_unitario = produto.preco;
+    venda.instante = instante_atual_ms();
+    vendas.push_back(venda);
+    total_vendas.store(vendas.size(), memory_order_relaxed);
+    return venda.id;
+}
+
+bool Particao::retirar_produto(int usuario_id, int loja_origem_id, int produto_id, ProdutoEmTransito &saida) {
+    auto it = produtos.find(produto_id);
+    if (it == produtos.end() || it->second.loja->id != loja_origem_id || it->second.loja->proprietario_id != usuario_id) {
+        return false;
+    }
+    Loja *origem = it->second.loja;
+    size_t posicao = it->second.posicao;
+    Produto &produto = origem->produtos[posicao];
+    saida.id = produto.id;
+    saida.nome = produto.nome.str();
+    saida.preco = produto.preco;
+    saida.quantidade = produto.quantidade;
+    // Tapa o buraco com o último produto da loja, como em Marketplace::aplicar_transferencia
+    if (posicao != origem->produtos.size() - 1) {
+        origem->produtos[posicao] = move(origem->produtos.back());
+        produtos[origem->produtos[posicao].id].posicao = posicao;
+    }
+    origem->produtos.pop_back();
+    produtos.erase(it);
+    diretorio.gravar(produto_id, DiretorioProdutos::EM_TRANSITO);
+    return true;
+}
+
+void Particao::receber_produto(int loja_destino_id, const ProdutoEmTransito &produto) {
+    Loja &destino = lojas.at(loja_destino_id);
+    Produto novo_produto;
+    novo_produto.id = produto.id;
+    novo_produto.nome = nomes.internar(produto.nome);
+    novo_produto.preco = produto.preco;
+    novo_produto.quantidade = produto.quantidade;
+    destino.produtos.push_back(novo_produto);
+    produtos[produto.id] = LocalProduto{&destino, destino.produtos.size() - 1};
+    if (indexados.insert(produto.id).second) {
+        indice_produtos.adicionar(produto.id, produto.nome);
+    }
+    diretorio.gravar(produto.id, indice);
+}
+
+vector<pair<int, Produto>> Particao::buscar_produtos(const string &nome_parcial, int loja_id) {
+    vector<pair<int, Produto>> encontrados;
+    vector<int> candidatos;
+    if (!indice_produtos.candidatos(nome_parcial, candidatos)) {
+        // Consulta curta demais para o índice: percorre as lojas
+        for (auto &i : lojas) {
+            if (loja_id != 0 && i.first != loja_id) {
+                continue;
+            }
+            for (auto &produto : i.second.produtos) {
+                if (produto.nome.find(nome_parcial) != string::npos) {
+                    encontrados.push_back(make_pair(i.first, produto));
+                }
+            }
+        }
+        return encontrados;
+    }
+    vector<const LocalProduto *> locais;
+    for (int id : candidatos) {
+        auto it = produtos.find(id); // O índice guarda também os que foram transferidos para fora
+        if (it != produtos.end() && (loja_id == 0 || it->second.loja->id == loja_id)
+            && it->second.loja->produtos[it->second.posicao].nome.find(nome_parcial) != string::npos) {
+            locais.push_back(&it->second);
+        }
+    }
+    sort(locais.begin(), locais.end(), [](const LocalProduto *a, const LocalProduto *b) {
+        return a->loja->id != b->loja->id ? a->loja->id < b->loja->id : a->posicao < b->posicao;
+    });
+    for (const LocalProduto *local : locais) {
+        encontrados.push_back(make_pair(local->loja->id, local->loja->produtos[local->posicao]));
+    }
+    return encontrados;
+}
+
+vector<Loja> Particao::buscar_lojas(const string &nome_parcial) {
+    vector<Loja> encontradas;
+    vector<int> candidatos;
+    if (!indice_lojas.candidatos(nome_parcial, candidatos)) {
+        for (auto &i : lojas) {
+            candidatos.push_back(i.first);
+        }
+    }
+    for (int id : candidatos) {
+        const Loja &loja = lojas.at(id);
+        if (loja.nome.find(nome_parcial) != string::npos) {
+            encontradas.push_back(loja);
+        }
+    }
+    return encontradas;
+}
+
+MarketplaceParticionado::MarketplaceParticionado(int n_particoes) {
+    if (n_particoes <= 0) {
+        n_particoes = max(1u, thread::hardware_concurrency());
+    }
+    for (int i = 0; i < n_particoes; i++) {
+        particoes.push_back(make_unique<Particao>(i, n_particoes, diretorio));
+    }
+}
+
+MarketplaceParticionado::~MarketplaceParticionado() {
+    particoes.clear();
+}
+
+template <typename F>
+auto MarketplaceParticionado::na_particao(int particao, F f) -> decltype(f(declval<Particao &>())) {
+    decltype(f(declval<Particao &>())) resultado{};
+    MensagemDe mensagem([&](Particao &p) { resultado = f(p); });
+    particoes[particao]->enviar(&mensagem);
+    mensagem.esperar();
+    return resultado;
+}
+
+template <typename R, typename F>
+vector<R> MarketplaceParticionado::em_todas(F f) {
+    vector<R> resultados(particoes.size());
+    auto tarefa = [&](Particao &p) { resultados[p.indice] = f(p); };
+    deque<MensagemDe<decltype(tarefa)>> mensagens; // deque: as mensagens não mudam de lugar
+    for (auto &particao : particoes) {
+        mensagens.emplace_back(tarefa);
+        particao->enviar(&mensagens.back());
+    }
+    for (auto &mensagem : mensagens) {
+        mensagem.esperar();
+    }
+    return resultados;
+}
+
+int MarketplaceParticionado::n_particoes() const {
+    return particoes.size();
+}
+
+int MarketplaceParticionado::particao_da_loja(int loja_id) const {
+    uint32_t h = (uint32_t)loja_id * 0x9e3779b1u; // Hash de Fibonacci: ids seguidos se espalham
+    return (uint64_t)(h ^ (h >> 16)) * particoes.size() >> 32;
+}
+
+int MarketplaceParticionado::usuario_do_token(const string &token_de_acesso) {
+    Token token;
+    if (!token_de_string(token_de_acesso, token)) {
+        return 0;
+    }
+    shared_lock<shared_mutex> trava(trava_sessoes);
+    return acessos_liberados.verificar(token);
+}
+
+bool MarketplaceParticionado::me_cadastrar(string nome, string email, string senha) {
+    MEDIR(CADASTRO);
+    {
+        shared_lock<shared_mutex> trava(trava_usuarios);
+        if (usuarios.por_email(email).id != 0) {
+            return false;
+        }
+    }
+    HashSenha senha_hash = geraHash(senha);
+    unique_lock<shared_mutex> trava(trava_usuarios);
+    return usuarios.cadastrar(nome, email, senha_hash) != 0;
+}
+
+string MarketplaceParticionado::login(string email, string senha) {
+    MEDIR(LOGIN);
+    int usuario_id;
+    HashSenha senha_hash_cadastrada;
+    {
+        shared_lock<shared_mutex> trava(trava_usuarios);
+        const Usuario &usuario = usuarios.por_email(email);
+        usuario_id = usuario.id;
+        senha_hash_cadastrada = usuario.senha_hash;
+    }
+    if (usuario_id == 0 || !hashes_iguais(senha_hash_cadastrada, geraHash(senha))) {
+        return "invalid";
+    }
+    Token token_de_acesso = genRandomToken();
+    unique_lock<shared_mutex> trava(trava_sessoes);
+    while (!acessos_liberados.inserir(token_de_acesso, usuario_id)) {
+        token_de_acesso = genRandomToken();
+    }
+    return token_para_string(token_de_acesso);
+}
+
+int MarketplaceParticionado::token_verify(const string &token_de_acesso) {
+    MEDIR(VERIFICA_TOKEN);
+    return usuario_do_token(token_de_acesso);
+}
+
+bool MarketplaceParticionado::logout(const string &token) {
+    MEDIR(LOGOUT);
+    Token binario;
+    if (!token_de_string(token, binario)) {
+        return false;
+    }
+    unique_lock<shared_mutex> trava(trava_sessoes);
+    return acessos_liberados.revogar(binario);
+}
+
+int MarketplaceParticionado::criar_loja(string token, string nome) {
+    MEDIR(CRIAR_LOJA);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0) {
+        return -1;
+    }
+    int loja_id = ++ultima_loja_id;
+    na_particao(particao_da_loja(loja_id), [&](Particao &p) {
+        p.criar_loja(loja_id, usuario_id, nome);
+        return 0;
+    });
+    return loja_id;
+}
+
+int MarketplaceParticionado::adicionar_produto(string token, int loja_id, string nome, float preco) {
+    MEDIR(ADICIONAR_PRODUTO);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0 || loja_id <= 0) {
+        return -1;
+    }
+    return na_particao(particao_da_loja(loja_id), [&](Particao &p) {
+        return p.adicionar_produto(usuario_id, loja_id, nome, preco);
+    });
+}
+
+int MarketplaceParticionado::adicionar_estoque(string token, int loja_id, int produto_id, int quantidade) {
+    MEDIR(ADICIONAR_ESTOQUE);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0 || loja_id <= 0) {
+        return -1;
+    }
+    return na_particao(particao_da_loja(loja_id), [&](Particao &p) {
+        return p.adicionar_estoque(usuario_id, loja_id, produto_id, quantidade);
+    });
+}
+
+vector<int> MarketplaceParticionado::adicionar_estoque(string token, const vector<Reposicao> &itens) {
+    MEDIR(ADICIONAR_ESTOQUE);
+    vector<int> estoques(itens.size(), -1);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0) {
+        return estoques;
+    }
+    vector<vector<int>> por_particao(particoes.size()); // Posições em itens
+    for (size_t i = 0; i < itens.size(); i++) {
+        if (itens[i].loja_id > 0) {
+            por_particao[particao_da_loja(itens[i].loja_id)].push_back(i);
+        }
+    }
+    // Cada partição escreve só nas posições dos seus itens
+    auto tarefa = [&](Particao &p) {
+        for (int i : por_particao[p.indice]) {
+            estoques[i] = p.adicionar_estoque(usuario_id, itens[i].loja_id, itens[i].produto_id, itens[i].quantidade);
+        }
+    };
+    deque<MensagemDe<decltype(tarefa)>> mensagens;
+    for (size_t p = 0; p < particoes.size(); p++) {
+        if (!por_particao[p].empty()) {
+            mensagens.emplace_back(tarefa);
+            particoes[p]->enviar(&mensagens.back());
+        }
+    }
+    for (auto &mensagem : mensagens) {
+        mensagem.esperar();
+    }
+    return estoques;
+}
+
+int MarketplaceParticionado::comprar_produto(string token, int produto_id, int quantidade) {
+    MEDIR(COMPRAR_PRODUTO);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0 || quantidade <= 0) {
+        return -1;
+    }
+    for (;;) {
+        int particao = diretorio.ler(produto_id);
+        if (particao == DiretorioProdutos::INEXISTENTE) {
+            return -1;
+        }
+        if (particao == DiretorioProdutos::EM_TRANSITO) {
+            this_thread::yield();
+            continue;
+        }
+        int venda_id = na_particao(particao, [&](Particao &p) {
+            return p.comprar(usuario_id, produto_id, quantidade);
+        });
+        // NAO_ESTA: o produto saiu da partição depois da leitura do diretório
+        if (venda_id != Particao::NAO_ESTA) {
+            return venda_id;
+        }
+    }
+}
+
+bool MarketplaceParticionado::transferir_produto(string token, int loja_origem_id, int loja_destino_id, int produto_id) {
+    MEDIR(TRANSFERIR_PRODUTO);
+    int usuario_id = usuario_do_token(token);
+    if (usuario_id <= 0 || loja_origem_id <= 0 || loja_destino_id <= 0 || loja_origem_id == loja_destino_id) {
+        return false;
+    }
+    int origem = particao_da_loja(loja_origem_id), destino = particao_da_loja(loja_destino_id);
+    if (origem == destino) {
+        return na_particao(origem, [&](Particao &p) {
+            ProdutoEmTransito produto;
+            if (p.proprietario(loja_destino_id) != usuario_id
+                || !p.retirar_produto(usuario_id, loja_origem_id, produto_id, produto)) {
+                return false;
+            }
+            p.receber_produto(loja_destino_id, produto);
+            return true;
+        });
+    }
+    // Lojas não são apagadas nem mudam de dono: o destino conferido continua válido
+    if (na_particao(destino, [&](Particao &p) { return p.proprietario(loja_destino_id); }) != usuario_id) {
+        return false;
+    }
+    ProdutoEmTransito produto;
+    if (!na_particao(origem, [&](Particao &p) {
+            return p.retirar_produto(usuario_id, loja_origem_id, produto_id, produto);
+        })) {
+        return false;
+    }
+    na_particao(destino, [&](Particao &p) {
+        p.receber_produto(loja_destino_id, produto);
+        return 0;
+    });
+    return true;
+}
+
+vector<Produto> MarketplaceParticionado::buscar_produtos(string nome_parcial) {
+    MEDIR(BUSCAR_PRODUTOS);
+    auto partes = em_todas<vector<pair<int, Produto>>>([&](Particao &p) { return p.buscar_produtos(nome_parcial, 0); });
+    vector<pair<int, Produto>> todos;
+    for (auto &parte : partes) {
+        todos.insert(todos.end(), make_move_iterator(parte.begin()), make_move_iterator(parte.end()));
+    }
+    // Cada parte já vem em ordem de loja e posição, e uma loja está numa parte só
+    stable_sort(todos.begin(), todos.end(), [](const pair<int, Produto> &a, const pair<int, Produto> &b) {
+        return a.first < b.first;
+    });
+    vector<Produto> encontrados;
+    encontrados.reserve(todos.size());
+    for (auto &item : todos) {
+        encontrados.push_back(move(item.second));
+    }
+    return encontrados;
+}
+
+vector<Produto> MarketplaceParticionado::buscar_produtos(string nome_parcial, int loja_id) {
+    MEDIR(BUSCAR_PRODUTOS);
+    vector<Produto> encontrados;
+    if (loja_id <= 0) {
+        return encontrados;
+    }
+    auto parte = na_particao(particao_da_loja(loja_id), [&](Particao &p) { return p.buscar_produtos(nome_parcial, loja_id); });
+    for (auto &item : parte) {
+        encontrados.push_back(move(item.second));
+    }
+    return encontrados;
+}
+
+vector<Loja> MarketplaceParticionado::buscar_lojas(string nome_parcial) {
+    MEDIR(BUSCAR_LOJAS);
+    auto partes = em_todas<vector<Loja>>([&](Particao &p) { return p.buscar_lojas(nome_parcial); });
+    vector<Loja> encontradas;
+    for (auto &parte : partes) {
+        encontradas.insert(encontradas.end(), make_move_iterator(parte.begin()), make_move_iterator(parte.end()));
+    }
+    sort(encontradas.begin(), encontradas.end(), [](const Loja &a, const Loja &b) { return a.id < b.id; });
+    return encontradas;
+}
+
+size_t MarketplaceParticionado::quantidade_vendas() {
+    size_t total = 0;
+    for (auto &particao : particoes) {
+        total += particao->total_vendas.load(memory_order_relaxed);
+    }
+    return total;
+}
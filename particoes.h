@@ -0,0 +1,371 @@
+/**
+ * @file particoes.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Marketplace particionado por loja: uma thread por núcleo, sem estado compartilhado
+ *
+ * Cada Particao é dona das lojas cujo id cai nela (pelo hash do id), dos produtos dessas
+ * lojas, do estoque, das vendas e dos índices de busca, e só a thread da partição mexe
+ * neles: não há trava nem atômico no caminho das operações de uma loja. As outras threads
+ * pedem operações mandando uma Mensagem pela fila da partição (sem trava, várias
+ * produtoras e uma consumidora) e esperam a resposta. Operações de várias partições
+ * (busca global, transferência entre lojas de partições diferentes) mandam uma mensagem
+ * para cada uma e juntam as respostas.
+ *
+ * Usuários e sessões são globais e protegidos como no Marketplace (shared_mutex): são
+ * lidos em toda operação, mas só mudam no cadastro e no login.
+ */
+
+#ifndef PARTICOES_H
+#define PARTICOES_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "marketplace.h"
+
+using namespace std;
+
+class Particao;
+
+/**
+ * Um pedido para a thread de uma partição. Fica com quem pediu (normalmente na pilha,
+ * já que quem pede espera a resposta) e entra na fila sem alocação.
+ */
+class Mensagem {
+    public:
+    atomic<Mensagem *> proxima{nullptr}; // Encadeamento da FilaMensagens
+    void (*executar)(Mensagem *, Particao &) = nullptr;
+    atomic<uint32_t> estado{0}; // 0: na fila, 1: pronta, 2: pronta ainda não, com alguém dormindo à espera
+
+    /**
+     * Chamado pela partição depois de executar; a mensagem pode ser destruída logo em
+     * seguida por quem espera, então a partição não a toca mais.
+     */
+    void concluir();
+
+    /**
+     * Espera a partição concluir: gira um pouco (só com mais de um núcleo) e dorme num futex.
+     */
+    void esperar();
+};
+
+// Mensagem que executa f(particao)
+template <typename F>
+class MensagemDe : public Mensagem {
+    public:
+    F f;
+
+    explicit MensagemDe(F f) : f(move(f)) {
+        executar = [](Mensagem *m, Particao &particao) {
+            static_cast<MensagemDe *>(m)->f(particao);
+            m->concluir();
+        };
+    }
+};
+
+/**
+ * Fila intrusiva sem trava de várias produtoras e uma consumidora (algoritmo de Vyukov):
+ * inserir é uma troca atômica da cabeça; retirar não escreve em nada compartilhado.
+ * Uma inserção pela metade (cabeça trocada, elo ainda não gravado) faz retirar() devolver
+ * nullptr até ser completada.
+ */
+class FilaMensagens {
+    private:
+    alignas(64) atomic<Mensagem *> cabeca; // Última inserida (lado das produtoras)
+    alignas(64) Mensagem *cauda; // Próxima a retirar (lado da consumidora)
+    Mensagem sentinela;
+
+    public:
+    FilaMensagens() : cabeca(&sentinela), cauda(&sentinela) {
+    }
+
+    FilaMensagens(const FilaMensagens &) = delete;
+    FilaMensagens &operator=(const FilaMensagens &) = delete;
+
+    void inserir(Mensagem *m) {
+        m->proxima.store(nullptr, memory_order_relaxed);
+        Mensagem *anterior = cabeca.exchange(m, memory_order_acq_rel);
+        anterior->proxima.store(m, memory_order_release);
+    }
+
+    // Só a consumidora chama
+    Mensagem *retirar() {
+        Mensagem *atual = cauda;
+        Mensagem *proxima = atual->proxima.load(memory_order_acquire);
+        if (atual == &sentinela) {
+            if (!proxima) {
+                return nullptr;
+            }
+            cauda = atual = proxima;
+            proxima = proxima->proxima.load(memory_order_acquire);
+        }
+        if (proxima) {
+            cauda = proxima;
+            return atual;
+        }
+        if (atual != cabeca.load(memory_order_acquire)) {
+            return nullptr; // Inserção em andamento
+        }
+        // atual é a última: recoloca a sentinela para poder entregar atual
+        inserir(&sentinela);
+        proxima = atual->proxima.load(memory_order_acquire);
+        if (proxima) {
+            cauda = proxima;
+            return atual;
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * Em que partição está cada produto, por id. Um produto nasce na partição da sua loja e
+ * só muda numa transferência entre partições; as compras, que chegam só com o id do
+ * produto, consultam aqui. Blocos criados sob demanda com compare-and-swap, como em
+ * TabelaResumos.
+ */
+class DiretorioProdutos {
+    private:
+    static const size_t TAMANHO_BLOCO = 4096;
+    static const size_t MAX_BLOCOS = 1 << 16;
+
+    atomic<atomic<int16_t> *> *blocos;
+
+    atomic<int16_t> *bloco(size_t b) {
+        atomic<int16_t> *atual = blocos[b].load(memory_order_acquire);
+        if (atual == nullptr) {
+            atomic<int16_t> *novo = new atomic<int16_t>[TAMANHO_BLOCO];
+            for (size_t i = 0; i < TAMANHO_BLOCO; i++) {
+                novo[i].store(INEXISTENTE, memory_order_relaxed);
+            }
+            if (blocos[b].compare_exchange_strong(atual, novo, memory_order_acq_rel)) {
+                atual = novo;
+            } else {
+                delete[] novo;
+            }
+        }
+        return atual;
+    }
+
+    public:
+    static const int16_t INEXISTENTE = -1;
+    static const int16_t EM_TRANSITO = -2; // Saiu de uma partição e ainda não entrou na outra
+
+    DiretorioProdutos() : blocos(new atomic<atomic<int16_t> *>[MAX_BLOCOS]()) {
+    }
+
+    DiretorioProdutos(const DiretorioProdutos &) = delete;
+    DiretorioProdutos &operator=(const DiretorioProdutos &) = delete;
+
+    ~DiretorioProdutos() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            delete[] blocos[b].load();
+        }
+        delete[] blocos;
+    }
+
+    int ler(int produto_id) const {
+        if (produto_id < 0 || produto_id >= (long long)(TAMANHO_BLOCO * MAX_BLOCOS)) {
+            return INEXISTENTE;
+        }
+        atomic<int16_t> *b = blocos[produto_id / TAMANHO_BLOCO].load(memory_order_acquire);
+        return b ? b[produto_id % TAMANHO_BLOCO].load(memory_order_acquire) : INEXISTENTE;
+    }
+
+    // Ids fora do alcance são ignorados (adicionar_produto não os gera)
+    void gravar(int produto_id, int16_t particao) {
+        if (produto_id < 0 || produto_id >= (long long)(TAMANHO_BLOCO * MAX_BLOCOS)) {
+            return;
+        }
+        bloco(produto_id / TAMANHO_BLOCO)[produto_id % TAMANHO_BLOCO].store(particao, memory_order_release);
+    }
+};
+
+// Um item de MarketplaceParticionado::adicionar_estoque em lote
+class Reposicao {
+    public:
+    int loja_id;
+    int produto_id;
+    int quantidade;
+};
+
+// Um produto saindo de uma partição para outra numa transferência
+class ProdutoEmTransito {
+    public:
+    int id;
+    string nome;
+    float preco;
+    int quantidade;
+};
+
+/**
+ * Lojas, produtos e vendas de uma partição. Os métodos só podem ser chamados pela thread
+ * da partição (de dentro de uma Mensagem); o usuário já vem verificado pelo chamador.
+ * Os ids de produtos e vendas criados aqui são n * sequencia + indice: cada partição gera
+ * os seus sem combinar com as outras.
+ */
+class Particao {
+    private:
+    enum : uint32_t { ACORDADA = 0, DORMINDO = 1 };
+
+    FilaMensagens fila;
+    alignas(64) atomic<uint32_t> sono{ACORDADA}; // Palavra do futex em que a thread dorme sem mensagens
+    bool parar = false;
+    thread executora;
+
+    map<int, Loja> lojas; // Chave: id da loja
+    unordered_map<int, LocalProduto> produtos; // Chave: id do produto (só os desta partição)
+    unordered_set<int> indexados; // Produtos já no indice_produtos (que não remove)
+    PoolNomes nomes;
+    IndiceTrigramas indice_produtos;
+    IndiceTrigramas indice_lojas;
+    vector<Venda> vendas;
+    int proximo_produto = 0; // Sequência local dos ids de produto
+    DiretorioProdutos &diretorio;
+
+    void executar();
+
+    public:
+    const int indice;
+    const int n_particoes;
+    atomic<long long> total_vendas{0}; // Lido por outras threads em quantidade_vendas
+
+    /**
+     * Cria a thread da partição, presa ao núcleo indice % núcleos quando possível.
+     */
+    Particao(int indice, int n_particoes, DiretorioProdutos &diretorio);
+
+    // Para a thread depois de executar as mensagens já enviadas
+    ~Particao();
+
+    Particao(const Particao &) = delete;
+    Particao &operator=(const Particao &) = delete;
+
+    /**
+     * Põe a mensagem na fila e acorda a thread se ela estiver dormindo. Pode ser chamado
+     * por qualquer thread.
+     */
+    void enviar(Mensagem *m);
+
+    // As operações abaixo rodam na thread da partição
+
+    void criar_loja(int loja_id, int proprietario_id, string_view nome);
+
+    // @return O proprietário da loja, ou 0 se ela não está nesta partição
+    int proprietario(int loja_id) const;
+
+    // @return O id do novo produto, ou -1 se a loja não existe ou não é do usuário
+    int adicionar_produto(int usuario_id, int loja_id, string_view nome, float preco);
+
+    // @return O novo estoque, ou -1 se o produto não está na loja ou a loja não é do usuário
+    int adicionar_estoque(int usuario_id, int loja_id, int produto_id, int quantidade);
+
+    // Retorno de comprar quando o produto não está (mais) nesta partição
+    static const int NAO_ESTA = -2;
+
+    // @return O id da venda, -1 se não há estoque, ou NAO_ESTA
+    int comprar(int usuario_id, int produto_id, int quantidade);
+
+    /**
+     * Tira o produto da loja de origem para mandá-lo a outra partição e marca o produto
+     * como EM_TRANSITO no diretório.
+     * @return false se o produto não está na loja ou a loja não é do usuário
+     */
+    bool retirar_produto(int usuario_id, int loja_origem_id, int produto_id, ProdutoEmTransito &saida);
+
+    // Põe na loja um produto retirado de outra loja e atualiza o diretório
+    void receber_produto(int loja_destino_id, const ProdutoEmTransito &produto);
+
+    // Produtos com nome_parcial no nome, com o id da loja, em ordem de loja e posição
+    vector<pair<int, Produto>> buscar_produtos(const string &nome_parcial, int loja_id);
+
+    // Lojas com nome_parcial no nome, em ordem de id
+    vector<Loja> buscar_lojas(const string &nome_parcial);
+};
+
+/**
+ * Mesmas operações do Marketplace (sem log, snapshot e relatórios), com as lojas
+ * divididas entre n partições. Pode ser usado por várias threads ao mesmo tempo;
+ * operações em lojas de partições diferentes não disputam nada além da leitura das
+ * sessões.
+ */
+class MarketplaceParticionado {
+    private:
+    TabelaUsuarios usuarios;
+    ArmazemSessoes acessos_liberados;
+    mutable shared_mutex trava_usuarios;
+    mutable shared_mutex trava_sessoes;
+
+    DiretorioProdutos diretorio;
+    vector<unique_ptr<Particao>> particoes;
+    atomic<int> ultima_loja_id{0};
+
+    int usuario_do_token(const string &token_de_acesso);
+
+    // Executa f(particao) na thread da partição e espera o resultado
+    template <typename F>
+    auto na_particao(int particao, F f) -> decltype(f(declval<Particao &>()));
+
+    // Executa f em todas as partições ao mesmo tempo; resultado[i] vem da partição i
+    template <typename R, typename F>
+    vector<R> em_todas(F f);
+
+    public:
+        /**
+         * @param n_particoes Quantidade de partições (threads); 0 para uma por núcleo
+         */
+        explicit MarketplaceParticionado(int n_particoes = 0);
+        ~MarketplaceParticionado();
+
+        int n_particoes() const;
+
+        // Partição dona da loja (hash do id)
+        int particao_da_loja(int loja_id) const;
+
+        bool me_cadastrar(string nome, string email, string senha);
+        string login(string email, string senha);
+        int token_verify(const string &token_de_acesso);
+        bool logout(const string &token);
+
+        // Como no Marketplace; a loja fica na partição do hash do id
+        int criar_loja(string token, string nome);
+        int adicionar_produto(string token, int loja_id, string nome, float preco);
+        int adicionar_estoque(string token, int loja_id, int produto_id, int quantidade);
+
+        /**
+         * Várias reposições com uma mensagem por partição envolvida, todas ao mesmo tempo:
+         * o custo de passar de uma thread para outra é pago uma vez por lote.
+         * @return O novo estoque de cada item (-1 como em adicionar_estoque), na mesma ordem
+         */
+        vector<int> adicionar_estoque(string token, const vector<Reposicao> &itens);
+
+        /**
+         * Vai à partição do produto pelo DiretorioProdutos; se o produto está sendo
+         * transferido, espera ele chegar à outra partição.
+         */
+        int comprar_produto(string token, int produto_id, int quantidade);
+
+        /**
+         * Na mesma partição, uma mensagem. Entre partições: confere o destino, retira da
+         * origem e põe no destino (três mensagens); enquanto isso as compras do produto
+         * esperam (ver comprar_produto).
+         */
+        bool transferir_produto(string token, int loja_origem_id, int loja_destino_id, int produto_id);
+
+        // Busca em todas as partições ao mesmo tempo; mesma ordem do Marketplace (loja e posição)
+        vector<Produto> buscar_produtos(string nome_parcial);
+        vector<Produto> buscar_produtos(string nome_parcial, int loja_id);
+        vector<Loja> buscar_lojas(string nome_parcial);
+
+        size_t quantidade_vendas();
+};
+
+#endif
@@ -36,6 +36,11 @@ THE SOFTWARE.
 #include <sstream>
 #include <vector>
 #include <fstream>
+#include <string>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PICOSHA2_X86_MULTI_BUFFER
+#endif
 namespace picosha2 {
 typedef unsigned long word_t;
 typedef unsigned char byte_t;
@@ -373,5 +378,157 @@ template<typename OutIter>void hash256(std::ifstream& f, OutIter first, OutIter
     hash256(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>(), first,last);
 
 }
+
+namespace detail {
+// Appends the SHA-256 padding (0x80, zeros, 64-bit big-endian bit length) to
+// src and writes the whole padded message to dst. Returns the block count.
+inline std::size_t pad_message(const std::string& src, std::vector<byte_t>& dst) {
+    std::size_t blocks = (src.size() + 9 + 63) / 64;
+    dst.assign(blocks * 64, 0);
+    std::copy(src.begin(), src.end(), dst.begin());
+    dst[src.size()] = 0x80;
+    unsigned long long bits = static_cast<unsigned long long>(src.size()) * 8;
+    for (std::size_t i = 0; i < 8; ++i) {
+        dst[dst.size() - 1 - i] = static_cast<byte_t>(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+inline void write_digest(const word_t* h, byte_t* dst) {
+    for (std::size_t i = 0; i < 8; ++i) {
+        for (std::size_t j = 0; j < 4; ++j) {
+            dst[i * 4 + j] = mask_8bit(static_cast<byte_t>(h[i] >> (24 - 8 * j)));
+        }
+    }
+}
+
+inline void hash256_batch_scalar(const std::string* srcs, std::size_t n, byte_t* dst) {
+    std::vector<byte_t> padded;
+    for (std::size_t m = 0; m < n; ++m) {
+        std::size_t blocks = pad_message(srcs[m], padded);
+        word_t h[8];
+        std::copy(initial_message_digest, initial_message_digest + 8, h);
+        for (std::size_t b = 0; b < blocks; ++b) {
+            hash256_block(h, padded.begin() + b * 64, padded.begin() + b * 64 + 64);
+        }
+        write_digest(h, dst + m * k_digest_size);
+    }
+}
+
+#ifdef PICOSHA2_X86_MULTI_BUFFER
+// 8-lane SHA-256: each 32-bit lane of a __m256i belongs to a different message.
+#define PICOSHA2_AVX2 __attribute__((target("avx2"), always_inline)) inline
+
+PICOSHA2_AVX2 __m256i rotr_x8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+PICOSHA2_AVX2 __m256i add_x8(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+
+PICOSHA2_AVX2 __m256i xor3_x8(__m256i a, __m256i b, __m256i c) {
+    return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+}
+
+__attribute__((target("avx2"))) inline void hash256_batch_x8(
+    const std::string* srcs, std::size_t lanes, byte_t* dst) {
+    std::vector<byte_t> padded[8];
+    std::size_t blocks[8] = {0};
+    std::size_t max_blocks = 0;
+    for (std::size_t l = 0; l < lanes; ++l) {
+        blocks[l] = pad_message(srcs[l], padded[l]);
+        max_blocks = std::max(max_blocks, blocks[l]);
+    }
+    __m256i h[8];
+    for (std::size_t i = 0; i < 8; ++i) {
+        h[i] = _mm256_set1_epi32(static_cast<int>(initial_message_digest[i]));
+    }
+    for (std::size_t b = 0; b < max_blocks; ++b) {
+        // Lanes whose message already ended keep their state
+        int active[8];
+        for (std::size_t l = 0; l < 8; ++l) {
+            active[l] = l < lanes && b < blocks[l] ? -1 : 0;
+        }
+        __m256i keep = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(active));
+        __m256i w[64];
+        for (std::size_t t = 0; t < 16; ++t) {
+            int words[8];
+            for (std::size_t l = 0; l < 8; ++l) {
+                if (active[l]) {
+                    const byte_t* p = &padded[l][b * 64 + t * 4];
+                    words[l] = static_cast<int>((static_cast<unsigned>(p[0]) << 24) |
+                                                (static_cast<unsigned>(p[1]) << 16) |
+                                                (static_cast<unsigned>(p[2]) << 8) | p[3]);
+                } else {
+                    words[l] = 0;
+                }
+            }
+            w[t] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+        }
+        for (std::size_t t = 16; t < 64; ++t) {
+            __m256i s0 = xor3_x8(rotr_x8(w[t - 15], 7), rotr_x8(w[t - 15], 18),
+                                 _mm256_srli_epi32(w[t - 15], 3));
+            __m256i s1 = xor3_x8(rotr_x8(w[t - 2], 17), rotr_x8(w[t - 2], 19),
+                                 _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = add_x8(add_x8(s1, w[t - 7]), add_x8(s0, w[t - 16]));
+        }
+        __m256i a = h[0], bb = h[1], c = h[2], d = h[3];
+        __m256i e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (std::size_t t = 0; t < 64; ++t) {
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i temp1 = add_x8(add_x8(hh, xor3_x8(rotr_x8(e, 6), rotr_x8(e, 11), rotr_x8(e, 25))),
+                                   add_x8(ch, add_x8(_mm256_set1_epi32(static_cast<int>(add_constant[t])), w[t])));
+            __m256i maj = xor3_x8(_mm256_and_si256(a, bb), _mm256_and_si256(a, c), _mm256_and_si256(bb, c));
+            __m256i temp2 = add_x8(xor3_x8(rotr_x8(a, 2), rotr_x8(a, 13), rotr_x8(a, 22)), maj);
+            hh = g;
+            g = f;
+            f = e;
+            e = add_x8(d, temp1);
+            d = c;
+            c = bb;
+            bb = a;
+            a = add_x8(temp1, temp2);
+        }
+        __m256i result[8] = {a, bb, c, d, e, f, g, hh};
+        for (std::size_t i = 0; i < 8; ++i) {
+            h[i] = _mm256_blendv_epi8(h[i], add_x8(h[i], result[i]), keep);
+        }
+    }
+    unsigned state[8][8];
+    for (std::size_t i = 0; i < 8; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[i]), h[i]);
+    }
+    for (std::size_t l = 0; l < lanes; ++l) {
+        word_t lane_h[8];
+        for (std::size_t i = 0; i < 8; ++i) {
+            lane_h[i] = state[i][l];
+        }
+        write_digest(lane_h, dst + l * k_digest_size);
+    }
+}
+#undef PICOSHA2_AVX2
+#endif
+}  // namespace detail
+
+// Hashes n independent messages at once; the digest of srcs[i] is written to
+// dst[i * k_digest_size .. (i + 1) * k_digest_size). Uses 8-lane AVX2 when the
+// CPU supports it and a scalar loop otherwise.
+inline void hash256_batch(const std::string* srcs, std::size_t n, byte_t* dst) {
+#ifdef PICOSHA2_X86_MULTI_BUFFER
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        for (std::size_t i = 0; i < n; i += 8) {
+            detail::hash256_batch_x8(srcs + i, std::min<std::size_t>(8, n - i),
+                                     dst + i * k_digest_size);
+        }
+        return;
+    }
+#endif
+    detail::hash256_batch_scalar(srcs, n, dst);
+}
+
+inline void hash256_batch(const std::vector<std::string>& srcs, std::vector<byte_t>& dst) {
+    dst.resize(srcs.size() * k_digest_size);
+    hash256_batch(srcs.data(), srcs.size(), dst.data());
+}
 }// namespace picosha2
 #endif  // PICOSHA2_H
@@ -0,0 +1,430 @@
+/**
+ * @file protocolo.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Protocolo binário do servidor do Marketplace (ver servidor.h e cliente.h)
+ *
+ * Requisição: [tamanho u32][id u32][operacao u8][campos...]
+ * Resposta:   [tamanho u32][id u32][status u8][campos...]
+ * tamanho conta os bytes depois dele. O id é escolhido pelo cliente e volta na
+ * resposta; as respostas de uma conexão saem na ordem das requisições, então o
+ * cliente pode mandar várias requisições sem esperar (pipelining).
+ * Campos: inteiros little-endian (i32, i64), f32, textos [u32 tamanho][bytes].
+ * Os campos de cada operação estão em executar_requisicao.
+ */
+
+#ifndef PROTOCOLO_H
+#define PROTOCOLO_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "marketplace.h"
+
+using namespace std;
+
+enum class OperacaoRemota : uint8_t {
+    CADASTRO = 1,            // nome, email, senha -> i32 (1: cadastrado)
+    CADASTRO_LOTE = 2,       // n, n x (nome, email, senha) -> n, n x i32
+    LOGIN = 3,               // email, senha -> token ("invalid" se falhou)
+    LOGOUT = 4,              // token -> i32
+    VERIFICA_TOKEN = 5,      // token -> i32 usuario_id (0 se inválido)
+    USUARIO_POR_ID = 6,      // i32 id -> Usuario
+    USUARIO_POR_EMAIL = 7,   // email -> Usuario
+    CRIAR_LOJA = 8,          // token, nome -> i32 loja_id
+    ADICIONAR_PRODUTO = 9,   // token, i32 loja_id, nome, f32 preco -> i32 produto_id
+    ADICIONAR_ESTOQUE = 10,  // token, i32 loja_id, i32 produto_id, i32 quantidade -> i32 estoque
+    TRANSFERIR_PRODUTO = 11, // token, i32 origem, i32 destino, i32 produto_id -> i32
+    BUSCAR_PRODUTOS = 12,    // nome, i32 loja_id (0: todas) -> n, n x Produto
+    BUSCAR_LOJAS = 13,       // nome -> n, n x Loja
+    LISTAR_LOJAS = 14,       // -> n, n x Loja
+    BUSCAR_PRODUTOS_PAGINA = 15, // nome, i32 loja_id, i32 cursor, i32 limite -> i32 proximo, n, n x Produto
+    BUSCAR_LOJAS_PAGINA = 16,    // nome, i32 cursor, i32 limite -> i32 proximo, n, n x LojaResumo
+    LISTAR_LOJAS_PAGINA = 17,    // i32 cursor, i32 limite -> i32 proximo, n, n x LojaResumo
+    BUSCAR_PRODUTOS_PRECO = 18,  // f32 minimo, f32 maximo, i32 loja_id, i32 cursor, i32 limite -> como 15
+    COMPRAR_PRODUTO = 19,    // token, i32 produto_id, i32 quantidade -> i32 venda_id
+    COMPRAR_CARRINHO = 20,   // token, n, n x (i32 produto_id, i32 quantidade) -> n, n x i32 venda_id
+    QUANTIDADE_VENDAS = 21,  // -> i64
+    VENDAS_DA_LOJA = 22,     // i32 loja_id -> Resumo
+    VENDAS_DO_PRODUTO = 23,  // i32 produto_id -> Resumo
+    VENDAS_DO_COMPRADOR = 24, // i32 comprador_id -> Resumo
+    VENDAS_POR_HORA = 25,    // i64 de_ms, i64 ate_ms -> n, n x (i64 hora_ms, Resumo)
+    MAIS_VENDIDOS = 26,      // i32 k, i32 loja_id -> n, n x Item
+    EM_ALTA = 27,            // i32 k, i32 minutos -> n, n x Item
+    CONFIGURAR_RANKING = 28, // i32 capacidade, i32 minutos -> (nada)
+    SALVAR_SNAPSHOT = 29,    // caminho -> i32
+    METRICAS = 30,           // -> texto JSON (Metricas::json)
+};
+// Produto: i32 id, nome, f32 preco, i32 quantidade
+// Loja: i32 id, nome, i32 proprietario_id, n, n x Produto
+// LojaResumo: i32 id, nome, i32 proprietario_id, i32 n_produtos
+// Usuario: i32 id (0 se não existe), nome, email
+// Resumo: i64 receita_centavos, i64 unidades, i64 pedidos
+// Item: i32 produto_id, i64 unidades, i64 erro
+
+enum class StatusResposta : uint8_t {
+    OK = 0,       // Operação executada (falhas do Marketplace vêm no valor, como na API)
+    INVALIDA = 1, // Operação desconhecida ou campos faltando
+};
+
+static const size_t MAX_MENSAGEM = 16 << 20;
+
+/**
+ * Escreve campos no fim de um buffer.
+ */
+class EscritorMensagem {
+    public:
+    string &dados;
+
+    explicit EscritorMensagem(string &dados) : dados(dados) {
+    }
+
+    EscritorMensagem &u8(uint8_t v) {
+        dados.push_back((char)v);
+        return *this;
+    }
+
+    EscritorMensagem &i32(int32_t v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    EscritorMensagem &i64(int64_t v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    EscritorMensagem &f32(float v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    EscritorMensagem &str(string_view v) {
+        i32(v.size());
+        dados.append(v.data(), v.size());
+        return *this;
+    }
+};
+
+/**
+ * Lê os campos de uma mensagem sem copiar: str() aponta para dentro do buffer.
+ * Ler além do fim retorna zero/vazio e marca a mensagem como inválida.
+ */
+class LeitorMensagem {
+    private:
+    const char *p;
+    const char *fim;
+    bool valida = true;
+
+    template <typename T>
+    T ler() {
+        T v{};
+        if (p + sizeof v > fim) {
+            valida = false;
+            p = fim;
+            return v;
+        }
+        memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+
+    public:
+    LeitorMensagem(const char *dados, size_t n) : p(dados), fim(dados + n) {
+    }
+
+    uint8_t u8() { return ler<uint8_t>(); }
+    int32_t i32() { return ler<int32_t>(); }
+    int64_t i64() { return ler<int64_t>(); }
+    float f32() { return ler<float>(); }
+
+    string_view str() {
+        uint32_t n = ler<uint32_t>();
+        if (n > (size_t)(fim - p)) {
+            valida = false;
+            p = fim;
+            return string_view();
+        }
+        string_view v(p, n);
+        p += n;
+        return v;
+    }
+
+    /**
+     * Quantidade de itens de uma lista, cada um com ao menos bytes_por_item bytes. Uma
+     * quantidade negativa ou que não cabe no resto da mensagem a marca como inválida (e
+     * retorna 0), para não alocar a partir de um número vindo da rede.
+     */
+    int32_t contagem(size_t bytes_por_item) {
+        int32_t n = i32();
+        if (n < 0 || (size_t)n > (size_t)(fim - p) / bytes_por_item) {
+            valida = false;
+            p = fim;
+            return 0;
+        }
+        return n;
+    }
+
+    bool ok() const {
+        return valida;
+    }
+};
+
+inline void escrever_produto(EscritorMensagem &e, const Produto &produto) {
+    e.i32(produto.id).str(produto.nome).f32(produto.preco).i32(produto.quantidade);
+}
+
+inline void escrever_resumo(EscritorMensagem &e, const ResumoVendas &resumo) {
+    e.i64(resumo.receita_centavos).i64(resumo.unidades).i64(resumo.pedidos);
+}
+
+inline void escrever_itens(EscritorMensagem &e, const vector<ItemRanking> &itens) {
+    e.i32(itens.size());
+    for (auto &item : itens) {
+        e.i32(item.produto_id).i64(item.unidades).i64(item.erro);
+    }
+}
+
+inline void escrever_lojas(EscritorMensagem &e, const vector<Loja> &lojas) {
+    e.i32(lojas.size());
+    for (auto &loja : lojas) {
+        e.i32(loja.id).str(loja.nome).i32(loja.proprietario_id).i32(loja.produtos.size());
+        for (auto &produto : loja.produtos) {
+            escrever_produto(e, produto);
+        }
+    }
+}
+
+/**
+ * Executa a requisição (operação e campos, sem tamanho e id) no Marketplace e escreve
+ * os campos da resposta em saida.
+ * @return O status da resposta; com INVALIDA, saida fica como estava
+ */
+inline StatusResposta executar_requisicao(Marketplace &marketplace, const char *dados, size_t n, string &saida) {
+    LeitorMensagem r(dados, n);
+    size_t inicio = saida.size();
+    EscritorMensagem e(saida);
+    auto s = [](string_view v) { return string(v); };
+    switch ((OperacaoRemota)r.u8()) {
+        case OperacaoRemota::CADASTRO: {
+            string nome = s(r.str()), email = s(r.str()), senha = s(r.str());
+            if (r.ok()) e.i32(marketplace.me_cadastrar(nome, email, senha));
+            break;
+        }
+        case OperacaoRemota::CADASTRO_LOTE: {
+            vector<Cadastro> cadastros(r.contagem(12)); // email, senha e nome: ao menos 4 bytes cada
+            for (auto &c : cadastros) {
+                if (!r.ok()) break;
+                c.nome = s(r.str());
+                c.email = s(r.str());
+                c.senha = s(r.str());
+            }
+            if (!r.ok()) break;
+            vector<bool> feitos = marketplace.me_cadastrar(cadastros);
+            e.i32(feitos.size());
+            for (bool feito : feitos) {
+                e.i32(feito);
+            }
+            break;
+        }
+        case OperacaoRemota::LOGIN: {
+            string email = s(r.str()), senha = s(r.str());
+            if (r.ok()) e.str(marketplace.login(email, senha));
+            break;
+        }
+        case OperacaoRemota::LOGOUT: {
+            string token = s(r.str());
+            if (r.ok()) e.i32(marketplace.logout(token));
+            break;
+        }
+        case OperacaoRemota::VERIFICA_TOKEN: {
+            string token = s(r.str());
+            if (r.ok()) e.i32(marketplace.token_verify(token));
+            break;
+        }
+        case OperacaoRemota::USUARIO_POR_ID:
+        case OperacaoRemota::USUARIO_POR_EMAIL: {
+            bool por_id = (OperacaoRemota)dados[0] == OperacaoRemota::USUARIO_POR_ID;
+            int id = por_id ? r.i32() : 0;
+            string email = por_id ? string() : s(r.str());
+            if (!r.ok()) break;
+            // Por valor: a cópia é feita com a trava dos usuários
+            Usuario usuario = por_id ? marketplace.usuario_por_id(id) : marketplace.usuario_por_email(email);
+            e.i32(usuario.id).str(usuario.nome).str(usuario.email);
+            break;
+        }
+        case OperacaoRemota::CRIAR_LOJA: {
+            string token = s(r.str()), nome = s(r.str());
+            if (r.ok()) e.i32(marketplace.criar_loja(token, nome));
+            break;
+        }
+        case OperacaoRemota::ADICIONAR_PRODUTO: {
+            string token = s(r.str());
+            int loja_id = r.i32();
+            string nome = s(r.str());
+            float preco = r.f32();
+            if (r.ok()) e.i32(marketplace.adicionar_produto(token, loja_id, nome, preco));
+            break;
+        }
+        case OperacaoRemota::ADICIONAR_ESTOQUE: {
+            string token = s(r.str());
+            int loja_id = r.i32(), produto_id = r.i32(), quantidade = r.i32();
+            if (r.ok()) e.i32(marketplace.adicionar_estoque(token, loja_id, produto_id, quantidade));
+            break;
+        }
+        case OperacaoRemota::TRANSFERIR_PRODUTO: {
+            string token = s(r.str());
+            int origem = r.i32(), destino = r.i32(), produto_id = r.i32();
+            if (r.ok()) e.i32(marketplace.transferir_produto(token, origem, destino, produto_id));
+            break;
+        }
+        case OperacaoRemota::BUSCAR_PRODUTOS: {
+            string nome = s(r.str());
+            int loja_id = r.i32();
+            if (!r.ok()) break;
+            vector<Produto> produtos = loja_id == 0 ? marketplace.buscar_produtos(nome)
+                                                    : marketplace.buscar_produtos(nome, loja_id);
+            e.i32(produtos.size());
+            for (auto &produto : produtos) {
+                escrever_produto(e, produto);
+            }
+            break;
+        }
+        case OperacaoRemota::BUSCAR_LOJAS: {
+            string nome = s(r.str());
+            if (r.ok()) escrever_lojas(e, marketplace.buscar_lojas(nome));
+            break;
+        }
+        case OperacaoRemota::LISTAR_LOJAS:
+            escrever_lojas(e, marketplace.listar_lojas());
+            break;
+        case OperacaoRemota::BUSCAR_PRODUTOS_PAGINA:
+        case OperacaoRemota::BUSCAR_PRODUTOS_PRECO: {
+            // Os ponteiros da página só valem com a trava do catálogo: serializa dentro dela
+            auto escrever = [&](const Pagina<Produto> &pagina) {
+                e.i32(pagina.proximo_cursor).i32(pagina.itens.size());
+                for (const Produto *produto : pagina.itens) {
+                    escrever_produto(e, *produto);
+                }
+            };
+            if ((OperacaoRemota)dados[0] == OperacaoRemota::BUSCAR_PRODUTOS_PAGINA) {
+                string nome = s(r.str());
+                int loja_id = r.i32(), cursor = r.i32(), limite = r.i32();
+                if (!r.ok()) break;
+                marketplace.ler_pagina_produtos(nome, loja_id, cursor, limite, escrever);
+            } else {
+                float minimo = r.f32(), maximo = r.f32();
+                int loja_id = r.i32(), cursor = r.i32(), limite = r.i32();
+                if (!r.ok()) break;
+                marketplace.ler_pagina_preco(minimo, maximo, loja_id, cursor, limite, escrever);
+            }
+            break;
+        }
+        case OperacaoRemota::BUSCAR_LOJAS_PAGINA:
+        case OperacaoRemota::LISTAR_LOJAS_PAGINA: {
+            auto escrever = [&](const Pagina<Loja> &pagina) {
+                e.i32(pagina.proximo_cursor).i32(pagina.itens.size());
+                for (const Loja *loja : pagina.itens) {
+                    e.i32(loja->id).str(loja->nome).i32(loja->proprietario_id).i32(loja->produtos.size());
+                }
+            };
+            if ((OperacaoRemota)dados[0] == OperacaoRemota::BUSCAR_LOJAS_PAGINA) {
+                string nome = s(r.str());
+                int cursor = r.i32(), limite = r.i32();
+                if (!r.ok()) break;
+                marketplace.ler_pagina_lojas(nome, cursor, limite, escrever);
+            } else {
+                int cursor = r.i32(), limite = r.i32();
+                if (!r.ok()) break;
+                marketplace.ler_lista_lojas(cursor, limite, escrever);
+            }
+            break;
+        }
+        case OperacaoRemota::COMPRAR_PRODUTO: {
+            string token = s(r.str());
+            int produto_id = r.i32(), quantidade = r.i32();
+            if (r.ok()) e.i32(marketplace.comprar_produto(token, produto_id, quantidade));
+            break;
+        }
+        case OperacaoRemota::COMPRAR_CARRINHO: {
+            string token = s(r.str());
+            vector<pair<int, int>> itens(r.contagem(8));
+            for (auto &item : itens) {
+                if (!r.ok()) break;
+                item.first = r.i32();
+                item.second = r.i32();
+            }
+            if (!r.ok()) break;
+            vector<int> vendas = marketplace.comprar_carrinho(token, itens);
+            e.i32(vendas.size());
+            for (int venda : vendas) {
+                e.i32(venda);
+            }
+            break;
+        }
+        case OperacaoRemota::QUANTIDADE_VENDAS:
+            e.i64(marketplace.quantidade_vendas());
+            break;
+        case OperacaoRemota::VENDAS_DA_LOJA: {
+            int id = r.i32();
+            if (r.ok()) escrever_resumo(e, marketplace.vendas_da_loja(id));
+            break;
+        }
+        case OperacaoRemota::VENDAS_DO_PRODUTO: {
+            int id = r.i32();
+            if (r.ok()) escrever_resumo(e, marketplace.vendas_do_produto(id));
+            break;
+        }
+        case OperacaoRemota::VENDAS_DO_COMPRADOR: {
+            int id = r.i32();
+            if (r.ok()) escrever_resumo(e, marketplace.vendas_do_comprador(id));
+            break;
+        }
+        case OperacaoRemota::VENDAS_POR_HORA: {
+            int64_t de = r.i64(), ate = r.i64();
+            if (!r.ok()) break;
+            auto horas = marketplace.vendas_por_hora(de, ate);
+            e.i32(horas.size());
+            for (auto &hora : horas) {
+                e.i64(hora.first);
+                escrever_resumo(e, hora.second);
+            }
+            break;
+        }
+        case OperacaoRemota::MAIS_VENDIDOS: {
+            int k = r.i32(), loja_id = r.i32();
+            if (r.ok()) escrever_itens(e, marketplace.mais_vendidos(max(0, k), loja_id));
+            break;
+        }
+        case OperacaoRemota::EM_ALTA: {
+            int k = r.i32(), minutos = r.i32();
+            if (r.ok()) escrever_itens(e, marketplace.em_alta(max(0, k), minutos));
+            break;
+        }
+        case OperacaoRemota::CONFIGURAR_RANKING: {
+            int capacidade = r.i32(), minutos = r.i32();
+            if (r.ok()) marketplace.configurar_ranking(max(1, capacidade), minutos);
+            break;
+        }
+        case OperacaoRemota::SALVAR_SNAPSHOT: {
+            string caminho = s(r.str());
+            if (r.ok()) e.i32(marketplace.salvar_snapshot(caminho));
+            break;
+        }
+        case OperacaoRemota::METRICAS:
+            e.str(Metricas::json());
+            break;
+        default:
+            return StatusResposta::INVALIDA;
+    }
+    if (!r.ok()) {
+        saida.resize(inicio);
+        return StatusResposta::INVALIDA;
+    }
+    return StatusResposta::OK;
+}
+
+#endif
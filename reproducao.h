@@ -0,0 +1,235 @@
+/**
+ * @file reproducao.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Reprodução de requisições gravadas em JSONL contra um Marketplace
+ *
+ * Cada linha é um objeto JSON plano com o campo "op" e os parâmetros da operação;
+ * "t" (opcional) é o instante da requisição em ms, usado para reproduzir no ritmo
+ * original. Tokens e ids não são conhecidos quando o tráfego é gravado, então:
+ *  - login guarda o token com o nome dado em "sessao", e as operações seguintes
+ *    usam esse nome ("sessao") no lugar do token;
+ *  - criar_loja e adicionar_produto podem trazer o id gravado ("loja", "produto"),
+ *    e as referências seguintes a esse id são traduzidas para o id criado aqui.
+ *
+ * Operações e campos:
+ *  {"op": "cadastro", "nome": ..., "email": ..., "senha": ...}
+ *  {"op": "login", "email": ..., "senha": ..., "sessao": ...}
+ *  {"op": "logout", "sessao": ...}
+ *  {"op": "criar_loja", "sessao": ..., "nome": ..., "loja": id}
+ *  {"op": "adicionar_produto", "sessao": ..., "loja": id, "nome": ..., "preco": x, "produto": id}
+ *  {"op": "adicionar_estoque", "sessao": ..., "loja": id, "produto": id, "quantidade": n}
+ *  {"op": "transferir_produto", "sessao": ..., "origem": id, "destino": id, "produto": id}
+ *  {"op": "buscar_produtos", "nome": ..., "loja": id}    (loja opcional)
+ *  {"op": "buscar_lojas", "nome": ...}
+ *  {"op": "comprar_produto", "sessao": ..., "produto": id, "quantidade": n}
+ */
+
+#ifndef REPRODUCAO_H
+#define REPRODUCAO_H
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include "marketplace.h"
+#include "json.h"
+
+using namespace std;
+
+class ResultadoReproducao {
+    public:
+    long long linhas = 0; // Não vazias
+    long long operacoes = 0; // Reconhecidas e executadas
+    long long invalidas = 0; // JSON inválido ou operação desconhecida
+    long long falhas = 0; // Executadas, mas o Marketplace recusou (token inválido, sem estoque...)
+    double segundos = 0;
+};
+
+/**
+ * Aplica requisições gravadas (formato no início do arquivo) a um Marketplace, em ordem,
+ * numa thread. As sessões e a tradução de ids ficam guardadas entre chamadas, então um
+ * tráfego pode ser reproduzido em pedaços.
+ */
+class ReprodutorRequisicoes {
+    private:
+    Marketplace &marketplace;
+    map<string, string, less<>> tokens; // Nome da sessão -> token
+    unordered_map<long long, int> lojas; // Id gravado -> id criado aqui
+    unordered_map<long long, int> produtos;
+    ObjetoJson requisicao;
+
+    static const string &vazio() {
+        static const string texto;
+        return texto;
+    }
+
+    const string &token(const ObjetoJson &r) const {
+        auto it = tokens.find(r.texto("sessao"));
+        return it == tokens.end() ? vazio() : it->second;
+    }
+
+    static int traduzir(const unordered_map<long long, int> &ids, long long id) {
+        auto it = ids.find(id);
+        return it == ids.end() ? (int)id : it->second;
+    }
+
+    int loja(const ObjetoJson &r, string_view chave) const {
+        return traduzir(lojas, r.inteiro(chave));
+    }
+
+    int produto(const ObjetoJson &r) const {
+        return traduzir(produtos, r.inteiro("produto"));
+    }
+
+    static string str(string_view v) {
+        return string(v);
+    }
+
+    public:
+    explicit ReprodutorRequisicoes(Marketplace &marketplace) : marketplace(marketplace) {
+    }
+
+    /**
+     * Executa uma requisição já lida.
+     * @return 1 se deu certo, 0 se o Marketplace recusou, -1 se a operação é desconhecida
+     */
+    int aplicar(const ObjetoJson &r) {
+        string_view op = r.texto("op");
+        if (op == "cadastro") {
+            return marketplace.me_cadastrar(str(r.texto("nome")), str(r.texto("email")), str(r.texto("senha")));
+        } else if (op == "login") {
+            string token = marketplace.login(str(r.texto("email")), str(r.texto("senha")));
+            if (token == "invalid") {
+                return 0;
+            }
+            auto it = tokens.find(r.texto("sessao"));
+            if (it == tokens.end()) {
+                tokens.emplace(str(r.texto("sessao")), token);
+            } else {
+                it->second = token;
+            }
+            return 1;
+        } else if (op == "logout") {
+            return marketplace.logout(token(r));
+        } else if (op == "criar_loja") {
+            int id = marketplace.criar_loja(token(r), str(r.texto("nome")));
+            if (id != -1 && r.tem("loja")) {
+                lojas[r.inteiro("loja")] = id;
+            }
+            return id != -1;
+        } else if (op == "adicionar_produto") {
+            int id = marketplace.adicionar_produto(token(r), loja(r, "loja"), str(r.texto("nome")), r.real("preco"));
+            if (id != -1 && r.tem("produto")) {
+                produtos[r.inteiro("produto")] = id;
+            }
+            return id != -1;
+        } else if (op == "adicionar_estoque") {
+            return marketplace.adicionar_estoque(token(r), loja(r, "loja"), produto(r), r.inteiro("quantidade")) != -1;
+        } else if (op == "transferir_produto") {
+            return marketplace.transferir_produto(token(r), loja(r, "origem"), loja(r, "destino"), produto(r));
+        } else if (op == "buscar_produtos") {
+            if (r.tem("loja")) {
+                marketplace.buscar_produtos(str(r.texto("nome")), loja(r, "loja"));
+            } else {
+                marketplace.buscar_produtos(str(r.texto("nome")));
+            }
+            return 1;
+        } else if (op == "buscar_lojas") {
+            marketplace.buscar_lojas(str(r.texto("nome")));
+            return 1;
+        } else if (op == "comprar_produto") {
+            return marketplace.comprar_produto(token(r), produto(r), r.inteiro("quantidade", 1)) != -1;
+        }
+        return -1;
+    }
+
+    /**
+     * Reproduz as linhas do conteúdo.
+     * @param velocidade 0 para o mais rápido possível; senão, respeita os intervalos entre
+     * os campos "t" divididos por velocidade (1 é o ritmo original)
+     */
+    ResultadoReproducao reproduzir(string_view conteudo, double velocidade = 0) {
+        ResultadoReproducao resultado;
+        auto inicio = chrono::steady_clock::now();
+        long long primeiro_t = -1;
+        const char *p = conteudo.data(), *fim = p + conteudo.size();
+        while (p < fim) {
+            const char *quebra = (const char *)memchr(p, '\n', fim - p);
+            string_view linha(p, (quebra ? quebra : fim) - p);
+            p = quebra ? quebra + 1 : fim;
+            if (linha.find_first_not_of(" \t\r") == string_view::npos) {
+                continue;
+            }
+            resultado.linhas++;
+            if (!requisicao.ler(linha)) {
+                resultado.invalidas++;
+                continue;
+            }
+            if (velocidade > 0 && requisicao.tem("t")) {
+                long long t = requisicao.inteiro("t");
+                if (primeiro_t < 0) {
+                    primeiro_t = t;
+                }
+                this_thread::sleep_until(inicio + chrono::microseconds((long long)((t - primeiro_t) * 1000 / velocidade)));
+            }
+            int feito = aplicar(requisicao);
+            if (feito < 0) {
+                resultado.invalidas++;
+            } else {
+                resultado.operacoes++;
+                resultado.falhas += feito == 0;
+            }
+        }
+        resultado.segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        return resultado;
+    }
+
+    /**
+     * Reproduz um arquivo JSONL, mapeado com mmap (as linhas não são copiadas).
+     * @throws runtime_error se o arquivo não puder ser lido
+     */
+    ResultadoReproducao reproduzir_arquivo(const string &caminho, double velocidade = 0) {
+        int fd = ::open(caminho.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("não foi possível abrir " + caminho);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw runtime_error("não foi possível ler " + caminho);
+        }
+        if (st.st_size == 0) {
+            ::close(fd);
+            return ResultadoReproducao();
+        }
+        void *dados = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (dados == MAP_FAILED) {
+            throw runtime_error("não foi possível mapear " + caminho);
+        }
+        madvise(dados, st.st_size, MADV_SEQUENTIAL);
+        ResultadoReproducao resultado;
+        try {
+            resultado = reproduzir(string_view((const char *)dados, st.st_size), velocidade);
+        } catch (...) {
+            munmap(dados, st.st_size);
+            throw;
+        }
+        munmap(dados, st.st_size);
+        return resultado;
+    }
+};
+
+#endif
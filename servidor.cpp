@@ -0,0 +1,343 @@
+/**
+ * @file servidor.cpp
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Implementação do Servidor (ver servidor.h)
+ */
+
+#include "servidor.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Cabeçalho de uma resposta: tamanho, id e status
+static const size_t TAMANHO_CABECALHO = 9;
+
+Servidor::Servidor(Marketplace &marketplace, const string &caminho, int n_trabalhadores)
+    : marketplace(marketplace), caminho_(caminho) {
+    auto falhar = [&](const string &etapa) {
+        string erro = etapa + " " + caminho + ": " + strerror(errno);
+        if (fd_escuta >= 0) close(fd_escuta);
+        if (fd_epoll >= 0) close(fd_epoll);
+        if (fd_parar >= 0) close(fd_parar);
+        fd_epoll = -1;
+        throw runtime_error(erro);
+    };
+    sockaddr_un endereco{};
+    endereco.sun_family = AF_UNIX;
+    if (caminho.size() >= sizeof endereco.sun_path) {
+        errno = ENAMETOOLONG;
+        falhar("caminho do socket");
+    }
+    memcpy(endereco.sun_path, caminho.c_str(), caminho.size() + 1);
+
+    fd_escuta = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_escuta < 0) falhar("socket");
+    unlink(caminho.c_str());
+    if (bind(fd_escuta, (sockaddr *)&endereco, sizeof endereco) < 0) falhar("bind");
+    // Antes do listen ninguém consegue conectar, então não há janela com outra permissão
+    if (chmod(caminho.c_str(), 0600) < 0) falhar("chmod");
+    if (listen(fd_escuta, SOMAXCONN) < 0) falhar("listen");
+
+    fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (fd_epoll < 0) falhar("epoll_create1");
+    fd_parar = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd_parar < 0) falhar("eventfd");
+    // O reator diferencia os descritores próprios pelo endereço em data.ptr
+    epoll_event evento{};
+    evento.events = EPOLLIN;
+    evento.data.ptr = &fd_escuta;
+    if (epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd_escuta, &evento) < 0) falhar("epoll_ctl");
+    evento.data.ptr = &fd_parar;
+    if (epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd_parar, &evento) < 0) falhar("epoll_ctl");
+
+    for (int i = 0; i < n_trabalhadores; i++) {
+        trabalhadores.emplace_back(&Servidor::trabalhar, this);
+    }
+    reator = thread(&Servidor::reagir, this);
+}
+
+Servidor::~Servidor() {
+    parar();
+}
+
+void Servidor::parar() {
+    if (fd_epoll < 0) {
+        return;
+    }
+    uint64_t um = 1;
+    if (write(fd_parar, &um, sizeof um) < 0) {
+        // O eventfd só falha se o contador estourar; o reator já foi acordado
+    }
+    reator.join();
+    {
+        lock_guard<mutex> trava(trava_fila);
+        parando = true;
+    }
+    tem_trabalho.notify_all();
+    for (auto &t : trabalhadores) {
+        t.join();
+    }
+    trabalhadores.clear();
+    for (Conexao *conexao : conexoes) {
+        close(conexao->fd);
+        delete conexao;
+    }
+    conexoes.clear();
+    fila.clear();
+    close(fd_escuta);
+    close(fd_parar);
+    close(fd_epoll);
+    fd_epoll = -1;
+    unlink(caminho_.c_str());
+}
+
+const string &Servidor::caminho() const {
+    return caminho_;
+}
+
+uint64_t Servidor::requisicoes() const {
+    return requisicoes_.load(memory_order_relaxed);
+}
+
+uint64_t Servidor::conexoes_abertas_total() const {
+    return conexoes_aceitas.load(memory_order_relaxed);
+}
+
+void Servidor::reagir() {
+    epoll_event eventos[256];
+    vector<Conexao *> prontas;
+    for (;;) {
+        int n = epoll_wait(fd_epoll, eventos, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        prontas.clear();
+        for (int i = 0; i < n; i++) {
+            void *origem = eventos[i].data.ptr;
+            if (origem == &fd_parar) {
+                return;
+            } else if (origem == &fd_escuta) {
+                aceitar();
+            } else {
+                prontas.push_back((Conexao *)origem);
+            }
+        }
+        if (prontas.empty()) {
+            continue;
+        }
+        if (trabalhadores.empty()) {
+            // Sem grupo de threads o reator atende (melhor com um núcleo só)
+            for (Conexao *conexao : prontas) {
+                if (!atender(conexao)) fechar(conexao);
+            }
+            continue;
+        }
+        {
+            lock_guard<mutex> trava(trava_fila);
+            fila.insert(fila.end(), prontas.begin(), prontas.end());
+        }
+        if (prontas.size() == 1) {
+            tem_trabalho.notify_one();
+        } else {
+            tem_trabalho.notify_all();
+        }
+    }
+}
+
+void Servidor::trabalhar() {
+    for (;;) {
+        Conexao *conexao;
+        {
+            unique_lock<mutex> trava(trava_fila);
+            tem_trabalho.wait(trava, [this]() { return parando || !fila.empty(); });
+            if (parando) {
+                return;
+            }
+            conexao = fila.front();
+            fila.pop_front();
+        }
+        if (!atender(conexao)) {
+            fechar(conexao);
+        }
+    }
+}
+
+void Servidor::aceitar() {
+    for (;;) {
+        int fd = accept4(fd_escuta, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN: fila de conexões vazia; outros erros (sem descritores) esperam o próximo evento
+            return;
+        }
+        Conexao *conexao = new Conexao();
+        conexao->fd = fd;
+        {
+            lock_guard<mutex> trava(trava_conexoes);
+            conexoes.insert(conexao);
+        }
+        conexoes_aceitas.fetch_add(1, memory_order_relaxed);
+        epoll_event evento{};
+        evento.events = EPOLLIN | EPOLLONESHOT;
+        evento.data.ptr = conexao;
+        if (epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd, &evento) < 0) {
+            fechar(conexao);
+        }
+    }
+}
+
+void Servidor::fechar(Conexao *conexao) {
+    epoll_ctl(fd_epoll, EPOLL_CTL_DEL, conexao->fd, nullptr);
+    close(conexao->fd);
+    {
+        lock_guard<mutex> trava(trava_conexoes);
+        conexoes.erase(conexao);
+    }
+    delete conexao;
+}
+
+/**
+ * Tenta escrever o que sobrou da última vez.
+ * @return false se a conexão caiu
+ */
+bool Servidor::escrever_pendente(Conexao *conexao) {
+    while (conexao->enviado < conexao->saida.size()) {
+        ssize_t n = send(conexao->fd, conexao->saida.data() + conexao->enviado,
+                         conexao->saida.size() - conexao->enviado, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conexao->enviado += n;
+    }
+    conexao->saida.clear();
+    conexao->enviado = 0;
+    return true;
+}
+
+bool Servidor::atender(Conexao *conexao) {
+    // Buffers reaproveitados entre as conexões atendidas pela mesma thread
+    thread_local vector<array<char, TAMANHO_CABECALHO>> cabecalhos;
+    thread_local vector<size_t> fins; // Fim do corpo de cada resposta em corpos
+    thread_local string corpos;
+    thread_local vector<iovec> partes;
+
+    // Respostas antigas saem antes de ler mais: a ordem importa e, enquanto o cliente
+    // não lê, não adianta acumular respostas novas
+    if (!escrever_pendente(conexao)) {
+        return false;
+    }
+    bool fim = false;
+    if (conexao->saida.empty()) {
+        const size_t bloco = 64 << 10;
+        for (;;) {
+            string &entrada = conexao->entrada;
+            size_t antes = entrada.size();
+            entrada.resize(antes + bloco);
+            ssize_t n = recv(conexao->fd, &entrada[antes], bloco, 0);
+            entrada.resize(antes + max<ssize_t>(n, 0));
+            if (n == 0) {
+                fim = true;
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+                break;
+            }
+            // Leitura curta: o socket esvaziou (se chegar mais, o epoll avisa de novo)
+            if ((size_t)n < bloco) break;
+        }
+    }
+
+    // Executa as requisições completas
+    cabecalhos.clear();
+    fins.clear();
+    corpos.clear();
+    const string &entrada = conexao->entrada;
+    size_t p = 0;
+    while (entrada.size() - p >= 4) {
+        uint32_t tamanho;
+        memcpy(&tamanho, entrada.data() + p, 4);
+        if (tamanho < 5 || tamanho > MAX_MENSAGEM) {
+            return false;
+        }
+        if (entrada.size() - p - 4 < tamanho) {
+            break;
+        }
+        size_t inicio = corpos.size();
+        StatusResposta status;
+        try {
+            status = executar_requisicao(marketplace, entrada.data() + p + 8, tamanho - 4, corpos);
+        } catch (...) {
+            // Ex.: bad_alloc de uma mensagem absurda; fecha só esta conexão
+            return false;
+        }
+        uint32_t tamanho_resposta = 5 + (corpos.size() - inicio);
+        array<char, TAMANHO_CABECALHO> cabecalho;
+        memcpy(cabecalho.data(), &tamanho_resposta, 4);
+        memcpy(cabecalho.data() + 4, entrada.data() + p + 4, 4);
+        cabecalho[8] = (char)status;
+        cabecalhos.push_back(cabecalho);
+        fins.push_back(corpos.size());
+        p += 4 + tamanho;
+    }
+    conexao->entrada.erase(0, p);
+    requisicoes_.fetch_add(cabecalhos.size(), memory_order_relaxed);
+
+    // Cabeçalhos e corpos vão juntos num sendmsg (o writev com MSG_NOSIGNAL, para uma
+    // conexão fechada pelo cliente não derrubar o processo com SIGPIPE)
+    partes.clear();
+    for (size_t i = 0; i < cabecalhos.size(); i++) {
+        partes.push_back({cabecalhos[i].data(), TAMANHO_CABECALHO});
+        size_t inicio = i == 0 ? 0 : fins[i - 1];
+        if (fins[i] > inicio) {
+            partes.push_back({&corpos[inicio], fins[i] - inicio});
+        }
+    }
+    size_t primeira = 0;
+    while (primeira < partes.size()) {
+        msghdr mensagem{};
+        mensagem.msg_iov = &partes[primeira];
+        mensagem.msg_iovlen = min<size_t>(partes.size() - primeira, IOV_MAX);
+        ssize_t n = sendmsg(conexao->fd, &mensagem, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            n = 0;
+        }
+        size_t escrito = n;
+        while (primeira < partes.size() && escrito >= partes[primeira].iov_len) {
+            escrito -= partes[primeira++].iov_len;
+        }
+        if (escrito > 0 || (n == 0 && primeira < partes.size())) {
+            // O socket encheu: o resto espera em saida até o EPOLLOUT
+            partes[primeira].iov_base = (char *)partes[primeira].iov_base + escrito;
+            partes[primeira].iov_len -= escrito;
+            for (size_t i = primeira; i < partes.size(); i++) {
+                conexao->saida.append((const char *)partes[i].iov_base, partes[i].iov_len);
+            }
+            break;
+        }
+    }
+    if (fim) {
+        return false;
+    }
+    epoll_event evento{};
+    evento.events = (conexao->saida.empty() ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+    evento.data.ptr = conexao;
+    return epoll_ctl(fd_epoll, EPOLL_CTL_MOD, conexao->fd, &evento) == 0;
+}
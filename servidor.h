@@ -0,0 +1,99 @@
+/**
+ * @file servidor.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Servidor do Marketplace num socket Unix, com o protocolo de protocolo.h
+ *
+ * Uma thread (o reator) espera eventos com epoll e aceita conexões; as conexões com
+ * dados prontos vão para uma fila atendida por um grupo de threads. Cada conexão é
+ * registrada com EPOLLONESHOT: depois de um evento ela fica desarmada até a thread
+ * que a atende terminar, então só uma thread mexe nela por vez e as respostas saem
+ * na ordem das requisições. A thread lê tudo o que chegou, executa todas as
+ * requisições completas (o cliente pode mandar várias sem esperar) e manda as
+ * respostas de uma vez com writev.
+ */
+
+#ifndef SERVIDOR_H
+#define SERVIDOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "marketplace.h"
+#include "protocolo.h"
+
+using namespace std;
+
+class Servidor {
+    private:
+        // Estado de uma conexão; só a thread que a atende mexe nele
+        struct Conexao {
+            int fd;
+            string entrada; // Bytes recebidos que ainda não formam uma requisição completa
+            string saida; // Respostas que o socket não aceitou na última escrita
+            size_t enviado = 0; // Quanto de saida já foi escrito
+        };
+
+        Marketplace &marketplace;
+        string caminho_;
+        int fd_escuta = -1;
+        int fd_epoll = -1;
+        int fd_parar = -1; // eventfd que acorda o reator para encerrar
+        thread reator;
+        vector<thread> trabalhadores;
+
+        mutex trava_fila;
+        condition_variable tem_trabalho;
+        deque<Conexao *> fila; // Conexões com eventos, esperando uma thread
+        bool parando = false;
+
+        mutex trava_conexoes;
+        unordered_set<Conexao *> conexoes; // Todas as abertas, para fechar no fim
+
+        atomic<uint64_t> requisicoes_{0};
+        atomic<uint64_t> conexoes_aceitas{0};
+
+        void reagir();
+        void trabalhar();
+        void aceitar();
+        // Atende a conexão; retorna false se ela deve ser fechada
+        bool atender(Conexao *conexao);
+        bool escrever_pendente(Conexao *conexao);
+        void fechar(Conexao *conexao);
+
+    public:
+        /**
+         * Cria o socket (com permissão só para o dono, 0600), substituindo um arquivo
+         * antigo no mesmo caminho, e começa a atender.
+         *
+         * @param marketplace Marketplace servido; deve viver mais que o Servidor
+         * @param caminho Caminho do socket Unix
+         * @param n_trabalhadores Threads que executam as requisições
+         * @throws runtime_error se o socket não puder ser criado
+         */
+        Servidor(Marketplace &marketplace, const string &caminho, int n_trabalhadores = 2);
+        ~Servidor();
+
+        Servidor(const Servidor &) = delete;
+        Servidor &operator=(const Servidor &) = delete;
+
+        /**
+         * Para de aceitar conexões, espera as threads terminarem a requisição em curso,
+         * fecha as conexões e remove o socket. Chamado também pelo destrutor.
+         */
+        void parar();
+
+        const string &caminho() const;
+
+        // Requisições executadas e conexões aceitas desde a criação
+        uint64_t requisicoes() const;
+        uint64_t conexoes_abertas_total() const;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file servidor_main.cpp
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Executável do servidor: ./servidor caminho.sock [threads] [log]
+ *
+ * threads 0 atende no próprio reator (melhor com um núcleo). Com log, o Marketplace
+ * é durável (wal.h) e recuperado do log na partida. Encerra com SIGINT ou SIGTERM.
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "marketplace.h"
+#include "servidor.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "uso: " << argv[0] << " caminho.sock [threads] [log]" << endl;
+        return 1;
+    }
+    // Os sinais são esperados com sigwait; as threads criadas depois herdam o bloqueio
+    sigset_t sinais;
+    sigemptyset(&sinais);
+    sigaddset(&sinais, SIGINT);
+    sigaddset(&sinais, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sinais, nullptr);
+
+    unique_ptr<Marketplace> marketplace = argc > 3 ? make_unique<Marketplace>(argv[3]) : make_unique<Marketplace>();
+    int threads = argc > 2 ? atoi(argv[2]) : 2;
+    try {
+        Servidor servidor(*marketplace, argv[1], threads);
+        cout << "atendendo em " << servidor.caminho() << " com " << threads << " threads" << endl;
+        int sinal;
+        sigwait(&sinais, &sinal);
+        servidor.parar();
+        cout << servidor.requisicoes() << " requisicoes em " << servidor.conexoes_abertas_total() << " conexoes" << endl;
+    } catch (const exception &erro) {
+        cerr << erro.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,283 @@
+/**
+ * @file sessoes.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Armazenamento das sessões (tokens de acesso) do Marketplace
+ *
+ */
+
+#ifndef SESSOES_H
+#define SESSOES_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Token de acesso em forma binária (128 bits)
+typedef array<uint8_t, 16> Token;
+
+/**
+ * Converte o token binário para a forma textual (hexadecimal) devolvida pelo login.
+ */
+inline string token_para_string(const Token &token) {
+    static const char hex[] = "0123456789abcdef";
+    string str(token.size() * 2, '0');
+    for (size_t i = 0; i < token.size(); i++) {
+        str[2 * i] = hex[token[i] >> 4];
+        str[2 * i + 1] = hex[token[i] & 0x0f];
+    }
+    return str;
+}
+
+/**
+ * Converte a forma textual do token de volta para binário.
+ * @return false caso a string não seja um token válido
+ */
+inline bool token_de_string(const string &str, Token &token) {
+    if (str.size() != token.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < str.size(); i++) {
+        char c = str[i];
+        int valor;
+        if (c >= '0' && c <= '9') valor = c - '0';
+        else if (c >= 'a' && c <= 'f') valor = c - 'a' + 10;
+        else return false;
+        if (i % 2 == 0) token[i / 2] = valor << 4;
+        else token[i / 2] |= valor;
+    }
+    return true;
+}
+
+/**
+ * Tabela de sessões indexada por hash (endereçamento aberto, sondagem linear).
+ * Cada sessão tem validade e cada usuário tem um número máximo de sessões simultâneas;
+ * ao passar do limite a sessão mais antiga do usuário é revogada.
+ */
+class ArmazemSessoes {
+    private:
+    static const int VAZIO = 0;
+    static const int REMOVIDO = -1;
+
+    struct Entrada {
+        Token token;
+        int usuario_id; // VAZIO, REMOVIDO ou o id do usuário (> 0)
+        int64_t expira_em; // Em milissegundos do relógio monotônico
+    };
+
+    vector<Entrada> tabela;
+    size_t ocupadas = 0; // Entradas com sessão
+    size_t removidas = 0; // Entradas marcadas como REMOVIDO
+    int64_t validade_ms;
+    size_t max_por_usuario;
+    unordered_map<int, vector<Token>> sessoes_por_usuario; // Em ordem de criação
+
+    static size_t hash_token(const Token &token) {
+        uint64_t a, b;
+        memcpy(&a, token.data(), 8);
+        memcpy(&b, token.data() + 8, 8);
+        uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ULL)) * 0xbf58476d1ce4e5b9ULL;
+        return h ^ (h >> 31);
+    }
+
+    // Posição do token na tabela ou -1 caso não exista
+    long long posicao(const Token &token) const {
+        if (tabela.empty()) {
+            return -1;
+        }
+        size_t mascara = tabela.size() - 1;
+        for (size_t i = hash_token(token) & mascara;; i = (i + 1) & mascara) {
+            const Entrada &e = tabela[i];
+            if (e.usuario_id == VAZIO) {
+                return -1;
+            }
+            if (e.usuario_id != REMOVIDO && e.token == token) {
+                return i;
+            }
+        }
+    }
+
+    void redimensionar(size_t capacidade) {
+        vector<Entrada> antiga;
+        antiga.swap(tabela);
+        tabela.assign(capacidade, Entrada{Token(), VAZIO, 0});
+        removidas = 0;
+        size_t mascara = capacidade - 1;
+        for (auto &e : antiga) {
+            if (e.usuario_id > 0) {
+                size_t i = hash_token(e.token) & mascara;
+                while (tabela[i].usuario_id != VAZIO) {
+                    i = (i + 1) & mascara;
+                }
+                tabela[i] = e;
+            }
+        }
+    }
+
+    void remover_posicao(size_t pos) {
+        int usuario_id = tabela[pos].usuario_id;
+        auto it = sessoes_por_usuario.find(usuario_id);
+        if (it != sessoes_por_usuario.end()) {
+            auto &lista = it->second;
+            for (size_t i = 0; i < lista.size(); i++) {
+                if (lista[i] == tabela[pos].token) {
+                    lista.erase(lista.begin() + i);
+                    break;
+                }
+            }
+            if (lista.empty()) {
+                sessoes_por_usuario.erase(it);
+            }
+        }
+        tabela[pos].usuario_id = REMOVIDO;
+        ocupadas--;
+        removidas++;
+    }
+
+    public:
+    static int64_t agora_ms() {
+        return chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @param validade_ms Tempo de vida de uma sessão em milissegundos
+     * @param max_por_usuario Número máximo de sessões simultâneas por usuário
+     */
+    ArmazemSessoes(int64_t validade_ms = 24LL * 60 * 60 * 1000, size_t max_por_usuario = 16)
+        : validade_ms(validade_ms), max_por_usuario(max_por_usuario) {
+    }
+
+    /**
+     * Reserva espaço para n sessões sem redimensionar a tabela.
+     */
+    void reservar(size_t n) {
+        size_t capacidade = 16;
+        while (capacidade < n * 2) {
+            capacidade *= 2;
+        }
+        if (capacidade > tabela.size()) {
+            redimensionar(capacidade);
+        }
+    }
+
+    /**
+     * Registra uma nova sessão para o usuário.
+     * @return false caso o token já exista (colisão)
+     */
+    bool inserir(const Token &token, int usuario_id, int64_t agora = agora_ms()) {
+        if (posicao(token) >= 0) {
+            return false;
+        }
+        auto &lista = sessoes_por_usuario[usuario_id];
+        if (max_por_usuario > 0 && lista.size() >= max_por_usuario) {
+            Token mais_antigo = lista.front();
+            remover_posicao(posicao(mais_antigo));
+        }
+        // Fator de carga (contando removidas) mantido abaixo de 1/2
+        if ((ocupadas + removidas + 1) * 2 > tabela.size()) {
+            // Antes de crescer, tira as sessões expiradas (custo junto com o do redimensionamento)
+            expirar(agora);
+            size_t capacidade = tabela.empty() ? 16 : tabela.size();
+            while (capacidade < (ocupadas + 1) * 4) {
+                capacidade *= 2;
+            }
+            redimensionar(capacidade);
+        }
+        size_t mascara = tabela.size() - 1;
+        size_t i = hash_token(token) & mascara;
+        while (tabela[i].usuario_id > 0) {
+            i = (i + 1) & mascara;
+        }
+        if (tabela[i].usuario_id == REMOVIDO) {
+            removidas--;
+        }
+        tabela[i] = Entrada{token, usuario_id, agora + validade_ms};
+        ocupadas++;
+        sessoes_por_usuario[usuario_id].push_back(token);
+        return true;
+    }
+
+    /**
+     * Não altera a tabela, então pode ser chamado por várias threads ao mesmo tempo.
+     * As sessões expiradas são removidas por expirar(), que inserir chama antes de
+     * crescer a tabela.
+     * @return O id do usuário dono da sessão, ou 0 caso o token não exista ou tenha expirado
+     */
+    int verificar(const Token &token, int64_t agora = agora_ms()) const {
+        long long pos = posicao(token);
+        if (pos < 0 || tabela[pos].expira_em <= agora) {
+            return 0;
+        }
+        return tabela[pos].usuario_id;
+    }
+
+    /**
+     * Encerra uma sessão (logout).
+     * @return true caso a sessão existisse
+     */
+    bool revogar(const Token &token) {
+        long long pos = posicao(token);
+        if (pos < 0) {
+            return false;
+        }
+        remover_posicao(pos);
+        return true;
+    }
+
+    /**
+     * Encerra todas as sessões de um usuário.
+     * @return Quantidade de sessões encerradas
+     */
+    size_t revogar_usuario(int usuario_id) {
+        auto it = sessoes_por_usuario.find(usuario_id);
+        if (it == sessoes_por_usuario.end()) {
+            return 0;
+        }
+        vector<Token> lista = it->second;
+        for (auto &token : lista) {
+            remover_posicao(posicao(token));
+        }
+        return lista.size();
+    }
+
+    /**
+     * Remove todas as sessões expiradas.
+     * @return Quantidade de sessões removidas
+     */
+    size_t expirar(int64_t agora = agora_ms()) {
+        size_t total = 0;
+        for (size_t i = 0; i < tabela.size(); i++) {
+            if (tabela[i].usuario_id > 0 && tabela[i].expira_em <= agora) {
+                remover_posicao(i);
+                total++;
+            }
+        }
+        return total;
+    }
+
+    size_t size() const {
+        return ocupadas;
+    }
+
+    /**
+     * Percorre as sessões ativas chamando f(token, usuario_id).
+     */
+    template <typename F>
+    void para_cada(F f) const {
+        for (auto &e : tabela) {
+            if (e.usuario_id > 0) {
+                f(e.token, e.usuario_id);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,436 @@
+/**
+ * @file snapshot.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Snapshot do Marketplace em arquivo, para ser lido direto via mmap
+ *
+ * O arquivo é um cabeçalho seguido de seções de registros de tamanho fixo que se
+ * referem umas às outras por posição/deslocamento (nenhum ponteiro), então um
+ * processo novo pode mapear o arquivo e responder buscas sem montar map/vector/string.
+ *
+ *  - USUARIOS: UsuarioSnap em ordem de id
+ *  - LOJAS: LojaSnap em ordem de id; os produtos de cada loja são contíguos em PRODUTOS
+ *  - PRODUTOS: ProdutoSnap loja por loja, na ordem de Loja::produtos
+ *  - VENDAS: Venda em ordem de id
+ *  - TEXTOS: bytes de todos os nomes, emails e hashes (referenciados por Texto)
+ *  - TRIGRAMAS / LISTAS: índice de busca dos nomes de produto; cada TrigramaSnap aponta
+ *    para uma faixa ordenada de posições em PRODUTOS
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "indice_busca.h"
+#include "vendas.h"
+
+using namespace std;
+
+static const char MAGICA_SNAPSHOT[8] = {'M', 'K', 'T', 'S', 'N', 'A', 'P', 0};
+static const uint32_t VERSAO_SNAPSHOT = 2; // 2: Venda::instante
+
+enum SecaoSnapshot {
+    SECAO_USUARIOS, SECAO_LOJAS, SECAO_PRODUTOS, SECAO_VENDAS, SECAO_TEXTOS, SECAO_TRIGRAMAS, SECAO_LISTAS,
+    N_SECOES
+};
+
+struct Texto {
+    uint32_t deslocamento; // Em TEXTOS
+    uint32_t tamanho;
+};
+
+struct UsuarioSnap {
+    int32_t id;
+    Texto email;
+    Texto nome;
+    Texto senha_hash;
+};
+
+struct LojaSnap {
+    int32_t id;
+    int32_t proprietario_id;
+    Texto nome;
+    uint32_t primeiro_produto; // Posição em PRODUTOS
+    uint32_t n_produtos;
+};
+
+struct ProdutoSnap {
+    int32_t id;
+    int32_t loja_id;
+    Texto nome;
+    float preco;
+    int32_t quantidade;
+};
+
+struct TrigramaSnap {
+    uint32_t trigrama;
+    uint32_t inicio; // Posição em LISTAS
+    uint32_t tamanho;
+};
+
+struct CabecalhoSnapshot {
+    char magica[8];
+    uint32_t versao;
+    uint32_t n_secoes;
+    uint64_t lsn_log; // Posição no log de escrita até onde o snapshot vai
+    struct {
+        uint64_t deslocamento; // Desde o início do arquivo
+        uint64_t quantidade; // Em registros (bytes para TEXTOS)
+    } secoes[N_SECOES];
+};
+
+/**
+ * Acumula o conteúdo do snapshot e grava o arquivo.
+ * Os produtos devem ser adicionados loja por loja, logo depois da sua loja.
+ */
+class EscritorSnapshot {
+    private:
+    vector<UsuarioSnap> usuarios;
+    vector<LojaSnap> lojas;
+    vector<ProdutoSnap> produtos;
+    vector<Venda> vendas;
+    string textos;
+
+    Texto texto(string_view str) {
+        Texto t{(uint32_t)textos.size(), (uint32_t)str.size()};
+        textos += str;
+        return t;
+    }
+
+    static bool gravar_bytes(FILE *f, const void *dados, size_t n, uint64_t &posicao) {
+        size_t alinhamento = (8 - posicao % 8) % 8;
+        static const char zeros[8] = {0};
+        // Seção vazia: dados pode ser nulo (vector vazio)
+        if (fwrite(zeros, 1, alinhamento, f) != alinhamento || (n > 0 && fwrite(dados, 1, n, f) != n)) {
+            return false;
+        }
+        posicao += alinhamento + n;
+        return true;
+    }
+
+    public:
+    void usuario(int id, string_view email, string_view nome, string_view senha_hash) {
+        usuarios.push_back(UsuarioSnap{id, texto(email), texto(nome), texto(senha_hash)});
+    }
+
+    void loja(int id, int proprietario_id, string_view nome) {
+        lojas.push_back(LojaSnap{id, proprietario_id, texto(nome), (uint32_t)produtos.size(), 0});
+    }
+
+    void produto(int id, int loja_id, string_view nome, float preco, int quantidade) {
+        produtos.push_back(ProdutoSnap{id, loja_id, texto(nome), preco, quantidade});
+        lojas.back().n_produtos++;
+    }
+
+    void venda(const Venda &venda) {
+        vendas.push_back(venda);
+    }
+
+    /**
+     * Grava em caminho (via arquivo temporário + rename, então um snapshot antigo
+     * nunca fica pela metade).
+     * @param lsn_log Posição do log de escrita que o snapshot cobre
+     * @return false em caso de erro de escrita
+     */
+    bool gravar(const string &caminho, uint64_t lsn_log) {
+        // Índice de trigramas sobre as posições em PRODUTOS
+        map<uint32_t, vector<int>> listas;
+        vector<uint32_t> tris;
+        for (size_t i = 0; i < produtos.size(); i++) {
+            IndiceTrigramas::trigramas(textos.data() + produtos[i].nome.deslocamento,
+                                       produtos[i].nome.tamanho, tris);
+            for (uint32_t t : tris) {
+                listas[t].push_back(i);
+            }
+        }
+        vector<TrigramaSnap> trigramas;
+        vector<int32_t> posicoes;
+        for (auto &l : listas) {
+            trigramas.push_back(TrigramaSnap{l.first, (uint32_t)posicoes.size(), (uint32_t)l.second.size()});
+            posicoes.insert(posicoes.end(), l.second.begin(), l.second.end());
+        }
+
+        CabecalhoSnapshot cabecalho;
+        memset(&cabecalho, 0, sizeof cabecalho);
+        memcpy(cabecalho.magica, MAGICA_SNAPSHOT, sizeof MAGICA_SNAPSHOT);
+        cabecalho.versao = VERSAO_SNAPSHOT;
+        cabecalho.n_secoes = N_SECOES;
+        cabecalho.lsn_log = lsn_log;
+        const void *dados[N_SECOES] = {usuarios.data(), lojas.data(), produtos.data(), vendas.data(),
+                                       textos.data(), trigramas.data(), posicoes.data()};
+        size_t quantidades[N_SECOES] = {usuarios.size(), lojas.size(), produtos.size(), vendas.size(),
+                                        textos.size(), trigramas.size(), posicoes.size()};
+        size_t tamanhos[N_SECOES] = {sizeof(UsuarioSnap), sizeof(LojaSnap), sizeof(ProdutoSnap), sizeof(Venda),
+                                     1, sizeof(TrigramaSnap), sizeof(int32_t)};
+        uint64_t posicao = sizeof cabecalho;
+        for (int s = 0; s < N_SECOES; s++) {
+            posicao += (8 - posicao % 8) % 8;
+            cabecalho.secoes[s].deslocamento = posicao;
+            cabecalho.secoes[s].quantidade = quantidades[s];
+            posicao += quantidades[s] * tamanhos[s];
+        }
+
+        string temporario = caminho + ".tmp";
+        FILE *f = fopen(temporario.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        posicao = 0;
+        bool ok = gravar_bytes(f, &cabecalho, sizeof cabecalho, posicao);
+        for (int s = 0; s < N_SECOES && ok; s++) {
+            ok = gravar_bytes(f, dados[s], quantidades[s] * tamanhos[s], posicao);
+        }
+        ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+        ok = fclose(f) == 0 && ok;
+        return ok && rename(temporario.c_str(), caminho.c_str()) == 0;
+    }
+};
+
+/**
+ * Snapshot aberto com mmap, somente leitura. Todos os ponteiros e string_views
+ * devolvidos apontam para dentro do arquivo mapeado e valem enquanto a imagem existir.
+ */
+class ImagemSnapshot {
+    private:
+    const char *base = nullptr;
+    size_t tamanho = 0;
+    const CabecalhoSnapshot *cabecalho = nullptr;
+
+    template <typename T>
+    const T *secao(SecaoSnapshot s) const {
+        return (const T *)(base + cabecalho->secoes[s].deslocamento);
+    }
+
+    // inicio + quantidade * tamanho_item <= limite, sem estourar
+    static bool cabe(uint64_t inicio, uint64_t quantidade, uint64_t tamanho_item, uint64_t limite) {
+        return inicio <= limite && quantidade <= (limite - inicio) / tamanho_item;
+    }
+
+    /**
+     * Confere que todo deslocamento e faixa gravados apontam para dentro da sua seção.
+     * @throws runtime_error no primeiro que não aponta
+     */
+    void validar() const {
+        size_t tamanhos[N_SECOES] = {sizeof(UsuarioSnap), sizeof(LojaSnap), sizeof(ProdutoSnap), sizeof(Venda),
+                                     1, sizeof(TrigramaSnap), sizeof(int32_t)};
+        for (int s = 0; s < N_SECOES; s++) {
+            if (cabecalho->secoes[s].deslocamento % 8 != 0
+                || !cabe(cabecalho->secoes[s].deslocamento, cabecalho->secoes[s].quantidade, tamanhos[s], tamanho)) {
+                throw runtime_error("snapshot corrompido: seção " + to_string(s) + " fora do arquivo");
+            }
+        }
+        uint64_t n_textos = cabecalho->secoes[SECAO_TEXTOS].quantidade;
+        auto confere_texto = [&](const Texto &t) {
+            if (!cabe(t.deslocamento, t.tamanho, 1, n_textos)) {
+                throw runtime_error("snapshot corrompido: texto fora da seção");
+            }
+        };
+        for (size_t i = 0; i < n_usuarios(); i++) {
+            confere_texto(usuario(i).email);
+            confere_texto(usuario(i).nome);
+            confere_texto(usuario(i).senha_hash);
+        }
+        for (size_t i = 0; i < n_lojas(); i++) {
+            confere_texto(loja(i).nome);
+            if (!cabe(loja(i).primeiro_produto, loja(i).n_produtos, 1, n_produtos())) {
+                throw runtime_error("snapshot corrompido: produtos da loja " + to_string(loja(i).id));
+            }
+        }
+        for (size_t i = 0; i < n_produtos(); i++) {
+            confere_texto(produto(i).nome);
+        }
+        uint64_t n_listas = cabecalho->secoes[SECAO_LISTAS].quantidade;
+        const TrigramaSnap *trigramas = secao<TrigramaSnap>(SECAO_TRIGRAMAS);
+        for (size_t i = 0; i < cabecalho->secoes[SECAO_TRIGRAMAS].quantidade; i++) {
+            if (!cabe(trigramas[i].inicio, trigramas[i].tamanho, 1, n_listas)) {
+                throw runtime_error("snapshot corrompido: lista de trigrama fora da seção");
+            }
+        }
+        const int32_t *listas = secao<int32_t>(SECAO_LISTAS);
+        for (size_t i = 0; i < n_listas; i++) {
+            if (listas[i] < 0 || (size_t)listas[i] >= n_produtos()) {
+                throw runtime_error("snapshot corrompido: posição de produto fora da seção");
+            }
+        }
+    }
+
+    public:
+    ImagemSnapshot() {
+    }
+
+    ImagemSnapshot(const ImagemSnapshot &) = delete;
+    ImagemSnapshot &operator=(const ImagemSnapshot &) = delete;
+
+    ~ImagemSnapshot() {
+        fechar();
+    }
+
+    void fechar() {
+        if (base) {
+            munmap((void *)base, tamanho);
+        }
+        base = nullptr;
+        cabecalho = nullptr;
+        tamanho = 0;
+    }
+
+    /**
+     * Mapeia o arquivo e confere o cabeçalho, os limites das seções e todo deslocamento
+     * ou faixa gravado nelas (textos, produtos das lojas, listas do índice); nada é
+     * copiado nem convertido.
+     * @return false se o arquivo não existe ou não é um snapshot desta versão
+     * @throws runtime_error se é um snapshot desta versão, mas truncado ou corrompido
+     */
+    bool abrir(const string &caminho) {
+        int fd = ::open(caminho.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoSnapshot)) {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        base = (const char *)p;
+        tamanho = st.st_size;
+        cabecalho = (const CabecalhoSnapshot *)base;
+        bool valido = memcmp(cabecalho->magica, MAGICA_SNAPSHOT, sizeof MAGICA_SNAPSHOT) == 0
+            && cabecalho->versao == VERSAO_SNAPSHOT && cabecalho->n_secoes == N_SECOES;
+        if (!valido) {
+            fechar();
+            return false;
+        }
+        try {
+            validar();
+        } catch (...) {
+            fechar();
+            throw;
+        }
+        return true;
+    }
+
+    uint64_t lsn_log() const {
+        return cabecalho->lsn_log;
+    }
+
+    size_t n_usuarios() const {
+        return cabecalho->secoes[SECAO_USUARIOS].quantidade;
+    }
+
+    size_t n_lojas() const {
+        return cabecalho->secoes[SECAO_LOJAS].quantidade;
+    }
+
+    size_t n_produtos() const {
+        return cabecalho->secoes[SECAO_PRODUTOS].quantidade;
+    }
+
+    size_t n_vendas() const {
+        return cabecalho->secoes[SECAO_VENDAS].quantidade;
+    }
+
+    const UsuarioSnap &usuario(size_t i) const {
+        return secao<UsuarioSnap>(SECAO_USUARIOS)[i];
+    }
+
+    const LojaSnap &loja(size_t i) const {
+        return secao<LojaSnap>(SECAO_LOJAS)[i];
+    }
+
+    const ProdutoSnap &produto(size_t i) const {
+        return secao<ProdutoSnap>(SECAO_PRODUTOS)[i];
+    }
+
+    const Venda &venda(size_t i) const {
+        return secao<Venda>(SECAO_VENDAS)[i];
+    }
+
+    string_view texto(const Texto &t) const {
+        return string_view(secao<char>(SECAO_TEXTOS) + t.deslocamento, t.tamanho);
+    }
+
+    /**
+     * Lojas do snapshot, em ordem de id.
+     */
+    vector<const LojaSnap *> listar_lojas() const {
+        vector<const LojaSnap *> lojas;
+        lojas.reserve(n_lojas());
+        for (size_t i = 0; i < n_lojas(); i++) {
+            lojas.push_back(&loja(i));
+        }
+        return lojas;
+    }
+
+    /**
+     * Mesmo resultado e ordem de Marketplace::buscar_produtos, usando o índice gravado.
+     * @param loja_id Restringe a busca a essa loja; 0 para todas
+     */
+    vector<const ProdutoSnap *> buscar_produtos(string_view nome_parcial, int loja_id = 0) const {
+        vector<const ProdutoSnap *> encontrados;
+        size_t inicio = 0, fim = n_produtos();
+        if (loja_id != 0) {
+            const LojaSnap *lojas = secao<LojaSnap>(SECAO_LOJAS);
+            const LojaSnap *l = lower_bound(lojas, lojas + n_lojas(), loja_id,
+                                            [](const LojaSnap &a, int id) { return a.id < id; });
+            if (l == lojas + n_lojas() || l->id != loja_id) {
+                return encontrados;
+            }
+            inicio = l->primeiro_produto;
+            fim = inicio + l->n_produtos;
+        }
+        auto confere = [&](size_t i) {
+            if (texto(produto(i).nome).find(nome_parcial) != string_view::npos) {
+                encontrados.push_back(&produto(i));
+            }
+        };
+        if (nome_parcial.size() < IndiceTrigramas::TAMANHO_MINIMO) {
+            for (size_t i = inicio; i < fim; i++) {
+                confere(i);
+            }
+            return encontrados;
+        }
+        vector<uint32_t> tris;
+        IndiceTrigramas::trigramas(nome_parcial.data(), nome_parcial.size(), tris);
+        const TrigramaSnap *trigramas = secao<TrigramaSnap>(SECAO_TRIGRAMAS);
+        const TrigramaSnap *fim_trigramas = trigramas + cabecalho->secoes[SECAO_TRIGRAMAS].quantidade;
+        const int32_t *listas = secao<int32_t>(SECAO_LISTAS);
+        vector<pair<const int *, const int *>> usadas;
+        for (uint32_t t : tris) {
+            const TrigramaSnap *it = lower_bound(trigramas, fim_trigramas, t,
+                                                 [](const TrigramaSnap &a, uint32_t t) { return a.trigrama < t; });
+            if (it == fim_trigramas || it->trigrama != t) {
+                return encontrados;
+            }
+            const int *lista = listas + it->inicio;
+            // Só a faixa de posições da loja pedida
+            usadas.push_back(make_pair(lower_bound(lista, lista + it->tamanho, (int)inicio),
+                                       lower_bound(lista, lista + it->tamanho, (int)fim)));
+        }
+        vector<int> candidatos;
+        IndiceTrigramas::intersectar(usadas, candidatos);
+        for (int i : candidatos) {
+            confere(i);
+        }
+        return encontrados;
+    }
+};
+
+#endif
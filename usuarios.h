@@ -0,0 +1,163 @@
+/**
+ * @file usuarios.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Cadastro de usuários do Marketplace indexado por id e por email
+ *
+ */
+
+#ifndef USUARIOS_H
+#define USUARIOS_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "nomes.h"
+
+using namespace std;
+
+// Hash SHA-256 da senha em forma binária
+typedef array<uint8_t, 32> HashSenha;
+
+/**
+ * Compara dois hashes olhando todos os bytes, sem parar na primeira diferença,
+ * para que o tempo da comparação não revele quanto do hash confere.
+ */
+inline bool hashes_iguais(const HashSenha &a, const HashSenha &b) {
+    uint8_t diferenca = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        diferenca |= a[i] ^ b[i];
+    }
+    return diferenca == 0;
+}
+
+/**
+ * Lê um hash gravado como texto: os 32 bytes binários ou, em logs e snapshots
+ * antigos, os 64 caracteres hexadecimais.
+ * @return false caso o texto não seja um hash
+ */
+inline bool hash_de_texto(string_view texto, HashSenha &hash) {
+    if (texto.size() == hash.size()) {
+        memcpy(hash.data(), texto.data(), hash.size());
+        return true;
+    }
+    if (texto.size() != hash.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < texto.size(); i++) {
+        char c = texto[i];
+        int valor;
+        if (c >= '0' && c <= '9') valor = c - '0';
+        else if (c >= 'a' && c <= 'f') valor = c - 'a' + 10;
+        else return false;
+        if (i % 2 == 0) hash[i / 2] = valor << 4;
+        else hash[i / 2] |= valor;
+    }
+    return true;
+}
+
+// Os bytes do hash como string_view, para gravar em log ou snapshot
+inline string_view hash_como_texto(const HashSenha &hash) {
+    return string_view((const char *)hash.data(), hash.size());
+}
+
+// Um cadastro da importação em lote (Marketplace::me_cadastrar com vetor)
+class Cadastro {
+    public:
+    string nome;
+    string email;
+    string senha;
+};
+
+class Usuario {
+    public:
+    int id = 0; // número incremental
+    Nome email; // Texto guardado no PoolNomes da TabelaUsuarios
+    Nome nome;
+    HashSenha senha_hash{}; // SHA-256 da senha
+};
+
+/**
+ * Tabela densa de usuários: o usuário de id N fica na posição N - 1,
+ * e o índice por email guarda apenas o id. Emails e nomes ficam num PoolNomes
+ * (nomes repetidos são guardados uma vez), e a chave do índice aponta para o mesmo texto.
+ */
+class TabelaUsuarios {
+    private:
+    PoolNomes textos;
+    vector<Usuario> por_id_; // Posição: id - 1
+    unordered_map<string_view, int> ids_por_email; // Chave: email (em textos), Valor: id do usuário
+
+    public:
+    /**
+     * Usuário devolvido nas buscas que não encontram nada (id == 0).
+     */
+    static const Usuario &inexistente() {
+        static const Usuario nenhum;
+        return nenhum;
+    }
+
+    void reservar(size_t n) {
+        por_id_.reserve(n);
+        ids_por_email.reserve(n);
+    }
+
+    /**
+     * Cadastra um usuário. O e-mail deve ser único.
+     * @return O id do novo usuário, ou 0 caso o e-mail já esteja cadastrado
+     */
+    int cadastrar(string_view nome, string_view email, const HashSenha &senha_hash) {
+        int id = por_id_.size() + 1; //podemos fazer assim pois não existe remoção
+        if (ids_por_email.count(email)) {
+            return 0;
+        }
+        Usuario novo_usuario;
+        novo_usuario.id = id;
+        novo_usuario.email = textos.guardar(email);
+        novo_usuario.nome = textos.internar(nome);
+        ids_por_email.emplace(novo_usuario.email.vista(), id);
+        novo_usuario.senha_hash = senha_hash;
+        por_id_.push_back(move(novo_usuario));
+        return id;
+    }
+
+    /**
+     * @return O usuário com esse id, ou inexistente() caso não exista
+     */
+    const Usuario &por_id(int id) const {
+        if (id <= 0 || id > (int)por_id_.size()) {
+            return inexistente();
+        }
+        return por_id_[id - 1];
+    }
+
+    /**
+     * @return O usuário com esse email, ou inexistente() caso não exista
+     */
+    const Usuario &por_email(string_view email) const {
+        auto it = ids_por_email.find(email);
+        if (it == ids_por_email.end()) {
+            return inexistente();
+        }
+        return por_id_[it->second - 1];
+    }
+
+    size_t size() const {
+        return por_id_.size();
+    }
+
+    vector<Usuario>::const_iterator begin() const {
+        return por_id_.begin();
+    }
+
+    vector<Usuario>::const_iterator end() const {
+        return por_id_.end();
+    }
+};
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file utils.cpp
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Tokens, strings aleatórias e hashes de senha
+ *
+ */
+
+#include "utils.h"
+
+using namespace std;
+
+string genRandomString(int length)
+{
+    string str(length, '\0');
+    const int limite = 256 - 256 % stringLength;
+    uint8_t bytes[64];
+    int i = 0;
+    while (i < length) {
+        BytesAleatorios::da_thread().gerar(bytes, sizeof bytes);
+        for (size_t j = 0; j < sizeof bytes && i < length; j++) {
+            if (bytes[j] < limite) {
+                str[i++] = alphanum[bytes[j] % stringLength];
+            }
+        }
+    }
+    return str;
+}
+
+Token genRandomToken()
+{
+    Token token;
+    BytesAleatorios::da_thread().gerar(token.data(), token.size());
+    return token;
+}
+
+HashSenha geraHash(const string &str) {
+    HashSenha hash;
+    picosha2::hash256(str.begin(), str.end(), hash.begin(), hash.end());
+    return hash;
+}
+
+vector<HashSenha> geraHashes(const vector<string> &strs) {
+    vector<HashSenha> hashes(strs.size());
+    if (!strs.empty()) {
+        picosha2::hash256_batch(strs.data(), strs.size(), hashes[0].data());
+    }
+    return hashes;
+}
+
+bool testa(bool condicao, string mensagem) {
+    if (condicao) {
+        cout << "PASSOU: " << mensagem << endl;
+        return true;
+    } else {
+        cout << "!ERRO: " << mensagem << endl;
+        return false;
+    }
+}
@@ -1,11 +1,21 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <pthread.h>
+#include <stdexcept>
 #include <string>
-#include <cstdlib>
-#include <ctime>
+#include <sys/random.h>
+#include <unistd.h>
+#include <vector>
 #include "picosha2.h"
+#include "sessoes.h"
+#include "usuarios.h"
 
 using namespace std;
 
@@ -15,42 +25,140 @@ static const char alphanum[] =
 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 "abcdefghijklmnopqrstuvwxyz";
 
-int stringLength = sizeof(alphanum) - 1;
-    
-char genRandom()
-{
-    return alphanum[rand() % stringLength];
-}
+static const int stringLength = sizeof(alphanum) - 1;
 
-string genRandomString(int length)
-{
-    string str;
+/**
+ * Gerador de bytes aleatórios criptográfico: ChaCha20 (RFC 7539) com chave tirada do
+ * gerador do sistema (getrandom). Gera 4 KB por vez e troca a chave pelos primeiros
+ * 32 bytes de cada bloco gerado e apaga do buffer os bytes já entregues, então eles não
+ * podem ser reconstruídos a partir do estado atual. Cada thread tem o seu gerador (sem trava e sem estado
+ * global), e um processo filho criado com fork pega uma chave nova para não repetir
+ * os bytes do pai.
+ */
+class BytesAleatorios {
+    private:
+    static const size_t TAMANHO = 4096;
+    uint32_t chave[8];
+    uint32_t nonce[3];
+    uint8_t buffer[TAMANHO];
+    size_t usados = TAMANHO;
+    unsigned geracao = 0; // geracao_fork() quando a chave foi sorteada; 0: ainda não sorteada
 
-    static int sranded = 0;
-    
-    if (sranded == 0) {
-        srand(time(0));
-        sranded = 1;
+    static uint32_t rotl(uint32_t x, int n) {
+        return (x << n) | (x >> (32 - n));
     }
 
-    for (int i = 0; i < length; i++) {
-        str += genRandom();
+    static void quarto(uint32_t *x, int a, int b, int c, int d) {
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
     }
-    return str;
-}
 
-string geraHash(string str) {
-    return picosha2::hash256_hex_string(str);
-}
+    // Um bloco de 64 bytes do ChaCha20
+    void bloco(uint32_t contador, uint8_t *saida) const {
+        uint32_t entrada[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+        memcpy(entrada + 4, chave, sizeof chave);
+        entrada[12] = contador;
+        memcpy(entrada + 13, nonce, sizeof nonce);
+        uint32_t x[16];
+        memcpy(x, entrada, sizeof x);
+        for (int i = 0; i < 10; i++) {
+            quarto(x, 0, 4, 8, 12); quarto(x, 1, 5, 9, 13); quarto(x, 2, 6, 10, 14); quarto(x, 3, 7, 11, 15);
+            quarto(x, 0, 5, 10, 15); quarto(x, 1, 6, 11, 12); quarto(x, 2, 7, 8, 13); quarto(x, 3, 4, 9, 14);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] += entrada[i];
+        }
+        memcpy(saida, x, sizeof x);
+    }
+
+    void semear() {
+        uint8_t semente[sizeof chave + sizeof nonce];
+        size_t feito = 0;
+        while (feito < sizeof semente) {
+            ssize_t n = getrandom(semente + feito, sizeof semente - feito, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw runtime_error("getrandom falhou");
+            }
+            feito += n;
+        }
+        memcpy(chave, semente, sizeof chave);
+        memcpy(nonce, semente + sizeof chave, sizeof nonce);
+        geracao = geracao_fork();
+    }
+
+    // Começa em 1 e é incrementada no processo filho a cada fork (pthread_atfork)
+    static unsigned geracao_fork() {
+        static atomic<unsigned> geracao{1};
+        static bool registrado = [] {
+            pthread_atfork(nullptr, nullptr, [] { geracao.fetch_add(1, memory_order_relaxed); });
+            return true;
+        }();
+        (void)registrado;
+        return geracao.load(memory_order_relaxed);
+    }
+
+    void encher() {
+        if (geracao != geracao_fork()) {
+            semear();
+        }
+        for (size_t i = 0; i < TAMANHO / 64; i++) {
+            bloco(i, buffer + i * 64);
+        }
+        // Troca de chave: os primeiros 32 bytes viram a próxima chave e não são entregues
+        memcpy(chave, buffer, sizeof chave);
+        memset(buffer, 0, sizeof chave);
+        usados = sizeof chave;
+    }
 
-bool testa(bool condicao, string mensagem) {
-    if (condicao) {
-        cout << "PASSOU: " << mensagem << endl;
-        return true;
-    } else {
-        cout << "!ERRO: " << mensagem << endl;
-        return false;
+    public:
+    static BytesAleatorios &da_thread() {
+        static thread_local BytesAleatorios gerador;
+        return gerador;
     }
-}
+
+    /**
+     * Copia n bytes aleatórios para destino (pedidos maiores que o buffer usam vários blocos).
+     */
+    void gerar(uint8_t *destino, size_t n) {
+        if (geracao != geracao_fork()) {
+            encher();
+        }
+        while (n > 0) {
+            if (usados == TAMANHO) {
+                encher();
+            }
+            size_t parte = min(n, TAMANHO - usados);
+            memcpy(destino, buffer + usados, parte);
+            memset(buffer + usados, 0, parte); // Entregues não ficam no estado
+            usados += parte;
+            destino += parte;
+            n -= parte;
+        }
+    }
+};
+
+/**
+ * String aleatória com caracteres de alphanum, sem viés (bytes fora do múltiplo do
+ * alfabeto são descartados) e sem alocar por caractere.
+ */
+string genRandomString(int length);
+
+/**
+ * Token de acesso de 128 bits do gerador criptográfico do sistema.
+ * Pode ser chamado por várias threads ao mesmo tempo.
+ */
+Token genRandomToken();
+
+HashSenha geraHash(const string &str);
+
+/**
+ * Hash de várias senhas de uma vez (SHA-256 em várias pistas SIMD quando disponível).
+ */
+vector<HashSenha> geraHashes(const vector<string> &strs);
+
+bool testa(bool condicao, string mensagem);
 
 #endif
\ No newline at end of file
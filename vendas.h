@@ -0,0 +1,339 @@
+/**
+ * @file vendas.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Registro das vendas do Marketplace
+ *
+ */
+
+#ifndef VENDAS_H
+#define VENDAS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class Venda {
+    public:
+    int id; // número incremental
+    int comprador_id; // Id do Usuário que fez a compra
+    int loja_id; // Id da Loja que o produto foi comprado
+    int produto_id; // Id do produto comprado
+    int quantidade; // Quantos produtos foram comprados
+    float preco_unitario; // Qual era o preço do produto no momento da venda
+    int64_t instante; // Quando a venda foi feita, em milissegundos desde 1970 (0: desconhecido)
+};
+
+// Instante atual para Venda::instante
+inline int64_t instante_atual_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Totais de um conjunto de vendas. A receita é somada em centavos para não
+ * acumular erro de arredondamento.
+ */
+class ResumoVendas {
+    public:
+    long long receita_centavos = 0; // Soma de preco_unitario * quantidade
+    long long unidades = 0; // Soma das quantidades
+    long long pedidos = 0; // Quantidade de vendas (uma por produto comprado)
+};
+
+/**
+ * Totais atualizados a cada venda, indexados por um id (de loja, produto, comprador
+ * ou hora). Guardados em blocos de tamanho fixo criados sob demanda com
+ * compare-and-swap, como em RegistroVendas: somar não trava e um id novo não move
+ * os totais já existentes.
+ */
+class TabelaResumos {
+    private:
+    static const size_t TAMANHO_BLOCO = 4096;
+    static const size_t MAX_BLOCOS = 1 << 16;
+
+    struct Totais {
+        atomic<long long> receita_centavos{0};
+        atomic<long long> unidades{0};
+        atomic<long long> pedidos{0};
+    };
+
+    atomic<Totais *> *blocos;
+
+    Totais *bloco(size_t b) {
+        Totais *atual = blocos[b].load(memory_order_acquire);
+        if (atual == nullptr) {
+            Totais *novo = new Totais[TAMANHO_BLOCO];
+            if (blocos[b].compare_exchange_strong(atual, novo, memory_order_acq_rel)) {
+                atual = novo;
+            } else {
+                delete[] novo;
+            }
+        }
+        return atual;
+    }
+
+    public:
+    TabelaResumos() : blocos(new atomic<Totais *>[MAX_BLOCOS]()) {
+    }
+
+    TabelaResumos(const TabelaResumos &) = delete;
+    TabelaResumos &operator=(const TabelaResumos &) = delete;
+
+    ~TabelaResumos() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            delete[] blocos[b].load();
+        }
+        delete[] blocos;
+    }
+
+    /**
+     * Soma uma venda aos totais do id. Ids negativos ou grandes demais são ignorados.
+     */
+    void somar(long long id, long long receita_centavos, long long unidades) {
+        if (id < 0 || id >= (long long)(TAMANHO_BLOCO * MAX_BLOCOS)) {
+            return;
+        }
+        Totais &t = bloco(id / TAMANHO_BLOCO)[id % TAMANHO_BLOCO];
+        t.receita_centavos.fetch_add(receita_centavos, memory_order_relaxed);
+        t.unidades.fetch_add(unidades, memory_order_relaxed);
+        t.pedidos.fetch_add(1, memory_order_relaxed);
+    }
+
+    ResumoVendas ler(long long id) const {
+        ResumoVendas resumo;
+        if (id < 0 || id >= (long long)(TAMANHO_BLOCO * MAX_BLOCOS)) {
+            return resumo;
+        }
+        Totais *b = blocos[id / TAMANHO_BLOCO].load(memory_order_acquire);
+        if (b) {
+            Totais &t = b[id % TAMANHO_BLOCO];
+            resumo.receita_centavos = t.receita_centavos.load(memory_order_relaxed);
+            resumo.unidades = t.unidades.load(memory_order_relaxed);
+            resumo.pedidos = t.pedidos.load(memory_order_relaxed);
+        }
+        return resumo;
+    }
+};
+
+/**
+ * Totais das vendas por loja, por produto, por comprador e por hora, mantidos a cada
+ * venda registrada; consultá-los custa O(1) (O(horas) para um intervalo de tempo).
+ */
+class AgregadosVendas {
+    private:
+    TabelaResumos lojas;
+    TabelaResumos produtos;
+    TabelaResumos compradores;
+    TabelaResumos horas; // Índice: horas desde 1970
+    atomic<long long> hora_minima{-1}, hora_maxima{-1}; // Horas com vendas (-1: nenhuma)
+
+    public:
+    static const int64_t MS_POR_HORA = 60LL * 60 * 1000;
+
+    void somar(const Venda &venda) {
+        long long receita = llround((double)venda.preco_unitario * 100) * venda.quantidade;
+        lojas.somar(venda.loja_id, receita, venda.quantidade);
+        produtos.somar(venda.produto_id, receita, venda.quantidade);
+        compradores.somar(venda.comprador_id, receita, venda.quantidade);
+        if (venda.instante > 0) {
+            long long hora = venda.instante / MS_POR_HORA;
+            horas.somar(hora, receita, venda.quantidade);
+            long long atual = hora_minima.load(memory_order_relaxed);
+            while ((atual < 0 || hora < atual) && !hora_minima.compare_exchange_weak(atual, hora)) {
+            }
+            atual = hora_maxima.load(memory_order_relaxed);
+            while (hora > atual && !hora_maxima.compare_exchange_weak(atual, hora)) {
+            }
+        }
+    }
+
+    ResumoVendas por_loja(int loja_id) const {
+        return lojas.ler(loja_id);
+    }
+
+    ResumoVendas por_produto(int produto_id) const {
+        return produtos.ler(produto_id);
+    }
+
+    ResumoVendas por_comprador(int comprador_id) const {
+        return compradores.ler(comprador_id);
+    }
+
+    /**
+     * Totais de cada hora com vendas no intervalo [de_ms, ate_ms), em ordem.
+     * @return Pares <início da hora em ms desde 1970, totais da hora>
+     */
+    vector<pair<int64_t, ResumoVendas>> por_hora(int64_t de_ms, int64_t ate_ms) const {
+        vector<pair<int64_t, ResumoVendas>> resultado;
+        long long minima = hora_minima.load(memory_order_relaxed);
+        if (minima < 0 || ate_ms <= de_ms) {
+            return resultado;
+        }
+        long long primeira = max<long long>(de_ms / MS_POR_HORA, minima);
+        long long ultima = min<long long>((ate_ms - 1) / MS_POR_HORA, hora_maxima.load(memory_order_relaxed));
+        for (long long hora = primeira; hora <= ultima; hora++) {
+            ResumoVendas resumo = horas.ler(hora);
+            if (resumo.pedidos > 0) {
+                resultado.push_back(make_pair(hora * MS_POR_HORA, resumo));
+            }
+        }
+        return resultado;
+    }
+};
+
+/**
+ * Lista de vendas só de inserção, sem travas, com os totais de AgregadosVendas
+ * atualizados a cada inserção. A venda de id N fica na posição N,
+ * dentro de blocos de tamanho fixo que nunca mudam de lugar; quem insere reserva
+ * o id com um incremento atômico e cria o bloco com compare-and-swap se preciso.
+ */
+class RegistroVendas {
+    private:
+    static const size_t TAMANHO_BLOCO = 4096;
+    static const size_t MAX_BLOCOS = 1 << 16; // Até ~268 milhões de vendas
+
+    struct Posicao {
+        Venda venda;
+        atomic<bool> pronta{false};
+    };
+
+    atomic<Posicao *> *blocos;
+    atomic<int> proximo_id{0};
+    AgregadosVendas agregados_;
+
+    // Reserva n ids consecutivos, ou -1 se passariam de MAX_VENDAS (proximo_id nunca passa)
+    int reservar(size_t n) {
+        int atual = proximo_id.load(memory_order_relaxed);
+        do {
+            if ((size_t)atual + n > MAX_VENDAS) {
+                return -1;
+            }
+        } while (!proximo_id.compare_exchange_weak(atual, atual + (int)n, memory_order_relaxed));
+        return atual;
+    }
+
+    Posicao *bloco(size_t b) {
+        Posicao *atual = blocos[b].load(memory_order_acquire);
+        if (atual == nullptr) {
+            Posicao *novo = new Posicao[TAMANHO_BLOCO];
+            if (blocos[b].compare_exchange_strong(atual, novo, memory_order_acq_rel)) {
+                atual = novo;
+            } else {
+                delete[] novo; // Outra thread criou o bloco antes
+            }
+        }
+        return atual;
+    }
+
+    public:
+    static const size_t MAX_VENDAS = TAMANHO_BLOCO * MAX_BLOCOS;
+
+    RegistroVendas() : blocos(new atomic<Posicao *>[MAX_BLOCOS]()) {
+    }
+
+    RegistroVendas(const RegistroVendas &) = delete;
+    RegistroVendas &operator=(const RegistroVendas &) = delete;
+
+    ~RegistroVendas() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            delete[] blocos[b].load();
+        }
+        delete[] blocos;
+    }
+
+    /**
+     * Insere a venda, preenchendo venda.id.
+     * @return O id da venda, ou -1 (e nada é inserido) se o registro chegou a MAX_VENDAS
+     */
+    int anexar(Venda &venda) {
+        venda.id = reservar(1);
+        if (venda.id < 0) {
+            return -1;
+        }
+        Posicao &p = bloco(venda.id / TAMANHO_BLOCO)[venda.id % TAMANHO_BLOCO];
+        p.venda = venda;
+        p.pronta.store(true, memory_order_release);
+        agregados_.somar(venda);
+        return venda.id;
+    }
+
+    /**
+     * Insere várias vendas com ids consecutivos usando um único incremento atômico,
+     * preenchendo o id de cada uma.
+     * @return O id da primeira venda, ou -1 (e nada é inserido) se o lote não cabe até MAX_VENDAS
+     */
+    int anexar_lote(vector<Venda> &lote) {
+        int primeiro = reservar(lote.size());
+        if (primeiro < 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < lote.size(); i++) {
+            int id = primeiro + i;
+            lote[i].id = id;
+            Posicao &p = bloco(id / TAMANHO_BLOCO)[id % TAMANHO_BLOCO];
+            p.venda = lote[i];
+            p.pronta.store(true, memory_order_release);
+            agregados_.somar(lote[i]);
+        }
+        return primeiro;
+    }
+
+    /**
+     * Coloca de volta uma venda já com id (reprodução do log). Não é seguro com outras
+     * threads inserindo ao mesmo tempo.
+     * @return false (e nada é inserido) se o id está fora de [0, MAX_VENDAS)
+     */
+    bool restaurar(const Venda &venda) {
+        if (venda.id < 0 || (size_t)venda.id >= MAX_VENDAS) {
+            return false;
+        }
+        Posicao &p = bloco(venda.id / TAMANHO_BLOCO)[venda.id % TAMANHO_BLOCO];
+        p.venda = venda;
+        p.pronta.store(true, memory_order_release);
+        agregados_.somar(venda);
+        if (venda.id >= proximo_id.load(memory_order_relaxed)) {
+            proximo_id.store(venda.id + 1, memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * Totais por loja, produto, comprador e hora de todas as vendas inseridas.
+     */
+    const AgregadosVendas &agregados() const {
+        return agregados_;
+    }
+
+    /**
+     * Quantidade de ids já reservados (inclui vendas ainda sendo escritas).
+     */
+    size_t size() const {
+        return proximo_id.load(memory_order_acquire);
+    }
+
+    /**
+     * Percorre as vendas já completamente escritas, em ordem de id, chamando f(venda).
+     * @param ate Só as vendas com id menor que esse
+     */
+    template <typename F>
+    void para_cada(F f, size_t ate = SIZE_MAX) const {
+        size_t n = min(size(), ate);
+        for (size_t id = 0; id < n; id++) {
+            Posicao *b = blocos[id / TAMANHO_BLOCO].load(memory_order_acquire);
+            if (b && b[id % TAMANHO_BLOCO].pronta.load(memory_order_acquire)) {
+                f(b[id % TAMANHO_BLOCO].venda);
+            }
+        }
+    }
+};
+
+#endif
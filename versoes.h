@@ -0,0 +1,214 @@
+/**
+ * @file versoes.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Versões antigas do catálogo para as leituras fixadas (VistaCatalogo) e as
+ * épocas que dizem quando elas podem ser liberadas
+ *
+ * Uma leitura longa fixa a época atual s e a época avança para s + 1. Cada produto guarda a
+ * época da sua última escrita; a primeira escrita depois de uma fixação guarda antes o
+ * estado anterior (loja e estoque, com a época antiga) no histórico do produto. Quem lê
+ * com a época s usa o estado atual se a época dele for <= s, senão o primeiro do histórico
+ * com época <= s. As versões que nenhuma leitura fixada alcança mais são liberadas ao
+ * soltar uma leitura (reclamação por épocas).
+ */
+
+#ifndef VERSOES_H
+#define VERSOES_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+// Estado de um produto antes de uma escrita; o mais novo aponta para o anterior
+class NoVersao {
+    public:
+    int loja_id;
+    int quantidade;
+    uint32_t epoca; // Época em que esse estado foi escrito
+    atomic<NoVersao *> anterior{nullptr};
+};
+
+/**
+ * A época global e as épocas fixadas pelas leituras. A época só avança ao fixar, com a
+ * trava exclusiva do catálogo: uma escrita (com a trava compartilhada) vê a mesma época
+ * do começo ao fim.
+ */
+class EpocasLeitura {
+    private:
+    atomic<uint32_t> atual{1};
+    atomic<int> n_fixadas{0};
+    multiset<uint32_t> fixadas; // Com trava
+
+    public:
+    mutex trava; // Ordena fixações e coletas; as escritas nunca pegam essa trava
+
+    uint32_t epoca() const {
+        return atual.load(memory_order_relaxed);
+    }
+
+    // Sem leituras fixadas as escritas não precisam guardar versões
+    bool ha_leitores() const {
+        return n_fixadas.load(memory_order_relaxed) > 0;
+    }
+
+    /**
+     * Fixa a época atual e passa para a próxima. Com trava e com a trava exclusiva do catálogo.
+     * @return A época fixada
+     */
+    uint32_t fixar() {
+        uint32_t s = atual.load(memory_order_relaxed);
+        atual.store(s + 1, memory_order_relaxed);
+        fixadas.insert(s);
+        n_fixadas.fetch_add(1, memory_order_relaxed);
+        return s;
+    }
+
+    // Com trava
+    void soltar(uint32_t s) {
+        fixadas.erase(fixadas.find(s));
+        n_fixadas.fetch_sub(1, memory_order_relaxed);
+    }
+
+    /**
+     * A menor época fixada, ou 0 se não há leituras. Com trava.
+     */
+    uint32_t menor() const {
+        return fixadas.empty() ? 0 : *fixadas.begin();
+    }
+};
+
+/**
+ * Histórico de versões por id do produto. Só guarda algo enquanto há leituras fixadas;
+ * os blocos de cabeças são criados sob demanda.
+ */
+class HistoricoVersoes {
+    private:
+    static const size_t TAMANHO_BLOCO = 4096;
+    static const size_t MAX_BLOCOS = 1 << 16;
+
+    atomic<atomic<NoVersao *> *> *blocos;
+    mutex trava_sujos;
+    vector<int> sujos; // Ids com histórico, para a coleta não percorrer o catálogo
+
+    atomic<NoVersao *> *cabeca(int id) const {
+        atomic<NoVersao *> *bloco = blocos[id / TAMANHO_BLOCO].load(memory_order_acquire);
+        return bloco ? &bloco[id % TAMANHO_BLOCO] : nullptr;
+    }
+
+    static void liberar(NoVersao *no) {
+        while (no) {
+            NoVersao *anterior = no->anterior.load(memory_order_relaxed);
+            delete no;
+            no = anterior;
+        }
+    }
+
+    public:
+    HistoricoVersoes() : blocos(new atomic<atomic<NoVersao *> *>[MAX_BLOCOS]()) {
+    }
+
+    HistoricoVersoes(const HistoricoVersoes &) = delete;
+    HistoricoVersoes &operator=(const HistoricoVersoes &) = delete;
+
+    ~HistoricoVersoes() {
+        for (size_t b = 0; b < MAX_BLOCOS; b++) {
+            atomic<NoVersao *> *bloco = blocos[b].load();
+            if (bloco) {
+                for (size_t i = 0; i < TAMANHO_BLOCO; i++) {
+                    liberar(bloco[i].load());
+                }
+                delete[] bloco;
+            }
+        }
+        delete[] blocos;
+    }
+
+    /**
+     * Guarda o estado do produto escrito na época epoca. Só uma thread por produto de
+     * cada vez (quem reservou a época do produto, ver ColunasProdutos).
+     */
+    void guardar(int id, int loja_id, int quantidade, uint32_t epoca) {
+        atomic<NoVersao *> *c = cabeca(id);
+        if (c == nullptr) {
+            atomic<NoVersao *> *novo = new atomic<NoVersao *>[TAMANHO_BLOCO]();
+            atomic<NoVersao *> *vazio = nullptr;
+            if (!blocos[id / TAMANHO_BLOCO].compare_exchange_strong(vazio, novo, memory_order_acq_rel)) {
+                delete[] novo; // Outra thread criou o bloco antes
+            }
+            c = cabeca(id);
+        }
+        NoVersao *no = new NoVersao();
+        no->loja_id = loja_id;
+        no->quantidade = quantidade;
+        no->epoca = epoca;
+        // CAS porque a coleta pode esvaziar a lista ao mesmo tempo
+        NoVersao *topo = c->load(memory_order_acquire);
+        do {
+            no->anterior.store(topo, memory_order_relaxed);
+        } while (!c->compare_exchange_weak(topo, no, memory_order_release, memory_order_acquire));
+        if (topo == nullptr) {
+            lock_guard<mutex> trava(trava_sujos);
+            sujos.push_back(id);
+        }
+    }
+
+    /**
+     * O estado mais novo com época <= epoca. Só com epoca fixada e depois de ver a época
+     * do produto passar dela (então o estado procurado já foi guardado).
+     */
+    void ler(int id, uint32_t epoca, int &loja_id, int &quantidade) const {
+        atomic<NoVersao *> *c = cabeca(id);
+        NoVersao *no = c ? c->load(memory_order_acquire) : nullptr;
+        while (no && no->epoca > epoca) {
+            no = no->anterior.load(memory_order_acquire);
+        }
+        loja_id = no ? no->loja_id : 0;
+        quantidade = no ? no->quantidade : 0;
+    }
+
+    /**
+     * Libera as versões que nenhuma leitura alcança: sem leituras, todas; senão as mais
+     * antigas que a usada pela menor época fixada. Com a trava de EpocasLeitura.
+     * @param menor A menor época fixada, ou 0
+     */
+    void coletar(uint32_t menor) {
+        vector<int> ids;
+        {
+            lock_guard<mutex> trava(trava_sujos);
+            ids.swap(sujos);
+        }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        vector<int> restantes;
+        for (int id : ids) {
+            atomic<NoVersao *> *c = cabeca(id);
+            if (menor == 0) {
+                // guardar pode repor uma cabeça depois; nesse caso ele marca o id de novo
+                liberar(c->exchange(nullptr, memory_order_acq_rel));
+                continue;
+            }
+            NoVersao *no = c->load(memory_order_acquire);
+            while (no && no->epoca > menor) {
+                no = no->anterior.load(memory_order_acquire);
+            }
+            if (no) {
+                liberar(no->anterior.exchange(nullptr, memory_order_acq_rel));
+            }
+            restantes.push_back(id);
+        }
+        if (!restantes.empty()) {
+            lock_guard<mutex> trava(trava_sujos);
+            sujos.insert(sujos.end(), restantes.begin(), restantes.end());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,399 @@
+/**
+ * @file wal.h
+ * @version 0.1
+ * @date 2022-01-27
+ *
+ * @brief Log de escrita antecipada (write-ahead log) do Marketplace
+ *
+ * Cada operação que altera o Marketplace vira um registro binário anexado ao fim
+ * do arquivo; ao reiniciar, os registros são reaplicados em ordem para reconstruir
+ * o estado em memória.
+ *
+ * Formato de um registro: [tamanho u32][crc32 u32][tipo u8][dados...], onde tamanho
+ * e crc cobrem tipo + dados. Inteiros são little-endian; strings são [u32 tamanho][bytes].
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+enum class TipoRegistro : uint8_t {
+    CADASTRO = 1,      // nome, email, senha_hash (32 bytes; 64 em hexadecimal nos logs antigos)
+    LOJA = 2,          // loja_id, usuario_id, nome
+    PRODUTO = 3,       // produto_id, loja_id, nome, preco
+    ESTOQUE = 4,       // produto_id, quantidade
+    TRANSFERENCIA = 5, // produto_id, loja_origem_id, loja_destino_id
+    VENDAS = 6,        // n, e n vezes: id, comprador_id, loja_id, produto_id, quantidade, preco_unitario
+    VENDAS_DATADAS = 7, // n, e n vezes: os campos de VENDAS e instante (i64)
+    PRODUTOS = 8,      // n, e n vezes: produto_id, loja_id, nome, preco, quantidade (importação)
+};
+
+/**
+ * Quando o log chama fsync (em todas, os registros esperam até intervalo no buffer em memória
+ * antes do write(), e uma queda do processo perde o que ainda estava no buffer):
+ *  - NUNCA: só write(); o que já foi escrito sobrevive à queda do processo, não à do sistema.
+ *  - PERIODICA: fsync a cada intervalo; pode perder o último intervalo numa queda do sistema.
+ *  - SEMPRE: a operação só retorna depois do fsync (várias operações dividem o mesmo fsync).
+ */
+enum class PoliticaFsync { NUNCA, PERIODICA, SEMPRE };
+
+inline uint32_t crc32(const char *dados, size_t n) {
+    static uint32_t tabela[256];
+    static bool pronta = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            tabela[i] = c;
+        }
+        return true;
+    }();
+    (void)pronta;
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < n; i++) {
+        c = tabela[(c ^ (unsigned char)dados[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+/**
+ * Monta o conteúdo (tipo + dados) de um registro.
+ */
+class Registro {
+    public:
+    string dados;
+
+    explicit Registro(TipoRegistro tipo) {
+        dados.push_back((char)tipo);
+    }
+
+    Registro &i32(int32_t v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    Registro &i64(int64_t v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    Registro &f32(float v) {
+        dados.append((const char *)&v, sizeof v);
+        return *this;
+    }
+
+    Registro &str(string_view v) {
+        i32(v.size());
+        dados.append(v);
+        return *this;
+    }
+};
+
+/**
+ * Lê os campos de um registro na mesma ordem em que foram escritos.
+ */
+class LeitorRegistro {
+    private:
+    const char *p;
+    const char *fim;
+
+    public:
+    LeitorRegistro(const char *dados, size_t n) : p(dados), fim(dados + n) {
+    }
+
+    TipoRegistro tipo() {
+        return (TipoRegistro)*p++;
+    }
+
+    int32_t i32() {
+        int32_t v = 0;
+        if (p + sizeof v <= fim) memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+
+    int64_t i64() {
+        int64_t v = 0;
+        if (p + sizeof v <= fim) memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+
+    float f32() {
+        float v = 0;
+        if (p + sizeof v <= fim) memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+
+    string str() {
+        size_t n = i32();
+        if (p + n > fim) n = p < fim ? fim - p : 0;
+        string v(p, n);
+        p += n;
+        return v;
+    }
+};
+
+/**
+ * Arquivo de log com commit em grupo: as threads só copiam o registro para um buffer
+ * em memória e uma thread de escrita grava o buffer acumulado com um único write()
+ * (e um único fsync, conforme a PoliticaFsync).
+ */
+class LogEscrita {
+    private:
+    int fd;
+    PoliticaFsync politica;
+    chrono::milliseconds intervalo;
+
+    mutex trava;
+    condition_variable tem_dados;
+    condition_variable gravou;
+    string buffer;
+    uint64_t lsn_anexado = 0; // Tamanho do log contando o buffer (posição do fim no arquivo)
+    uint64_t lsn_gravado = 0; // Tamanho já gravado (e sincronizado, se a política pede)
+    atomic<bool> falhou{false}; // Um write ou fsync falhou: nada depois de lsn_gravado é confirmado
+    bool parar = false;
+    thread escritor;
+
+    bool gravar_tudo(const string &bloco) {
+        size_t feito = 0;
+        while (feito < bloco.size()) {
+            ssize_t n = ::write(fd, bloco.data() + feito, bloco.size() - feito);
+            if (n < 0 && errno != EINTR) {
+                return false;
+            }
+            if (n > 0) {
+                feito += n;
+            }
+        }
+        return true;
+    }
+
+    bool sincronizar_arquivo() {
+        int r;
+        while ((r = ::fdatasync(fd)) != 0 && errno == EINTR) {
+        }
+        return r == 0;
+    }
+
+    void laco_escritor() {
+        auto ultimo_fsync = chrono::steady_clock::now();
+        string bloco;
+        unique_lock<mutex> l(trava);
+        while (true) {
+            tem_dados.wait_for(l, intervalo, [this] { return parar || !buffer.empty(); });
+            if (buffer.empty() && parar) {
+                break;
+            }
+            bloco.swap(buffer);
+            uint64_t lsn = lsn_anexado;
+            if (falhou) {
+                // Depois de uma falha o arquivo pode ter um registro pela metade: não grava mais
+                bloco.clear();
+                continue;
+            }
+            l.unlock();
+            bool ok = gravar_tudo(bloco);
+            bloco.clear();
+            auto agora = chrono::steady_clock::now();
+            if (ok && (politica == PoliticaFsync::SEMPRE
+                       || (politica == PoliticaFsync::PERIODICA && agora - ultimo_fsync >= intervalo))) {
+                ok = sincronizar_arquivo();
+                ultimo_fsync = agora;
+            }
+            l.lock();
+            if (ok) {
+                lsn_gravado = lsn;
+            } else {
+                falhou = true;
+            }
+            gravou.notify_all();
+        }
+        if (politica != PoliticaFsync::NUNCA && !falhou) {
+            sincronizar_arquivo();
+        }
+    }
+
+    public:
+    /**
+     * Abre (ou cria) o log para anexar novos registros.
+     * @param intervalo Tempo máximo que um registro espera no buffer, e o período do fsync em PERIODICA
+     */
+    LogEscrita(const string &caminho, PoliticaFsync politica = PoliticaFsync::PERIODICA,
+               chrono::milliseconds intervalo = chrono::milliseconds(10))
+        : politica(politica), intervalo(intervalo) {
+        fd = ::open(caminho.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            throw runtime_error("não foi possível abrir o log " + caminho);
+        }
+        lsn_anexado = lsn_gravado = ::lseek(fd, 0, SEEK_END);
+        escritor = thread([this] { laco_escritor(); });
+    }
+
+    LogEscrita(const LogEscrita &) = delete;
+    LogEscrita &operator=(const LogEscrita &) = delete;
+
+    ~LogEscrita() {
+        {
+            lock_guard<mutex> l(trava);
+            parar = true;
+        }
+        tem_dados.notify_one();
+        escritor.join();
+        ::close(fd);
+    }
+
+    /**
+     * Anexa o registro ao buffer. Não espera a gravação.
+     * @return Posição (lsn) do fim do registro no log, para usar em esperar()
+     */
+    uint64_t anexar(const Registro &registro) {
+        uint32_t tamanho = registro.dados.size();
+        uint32_t crc = crc32(registro.dados.data(), tamanho);
+        lock_guard<mutex> l(trava);
+        buffer.append((const char *)&tamanho, sizeof tamanho);
+        buffer.append((const char *)&crc, sizeof crc);
+        buffer.append(registro.dados);
+        lsn_anexado += sizeof tamanho + sizeof crc + tamanho;
+        if (politica == PoliticaFsync::SEMPRE) {
+            tem_dados.notify_one();
+        }
+        return lsn_anexado;
+    }
+
+    /**
+     * Posição do fim do último registro anexado. Um snapshot tirado agora
+     * corresponde ao log até essa posição.
+     */
+    uint64_t lsn_atual() {
+        lock_guard<mutex> l(trava);
+        return lsn_anexado;
+    }
+
+    /**
+     * Em qualquer política, grava o buffer até lsn e chama fsync, por exemplo antes de um
+     * snapshot que diz corresponder ao log até lsn.
+     * @return false se a gravação ou o fsync falharam
+     */
+    bool sincronizar(uint64_t lsn) {
+        {
+            unique_lock<mutex> l(trava);
+            tem_dados.notify_one();
+            gravou.wait(l, [&] { return lsn_gravado >= lsn || falhou; });
+            if (lsn_gravado < lsn) {
+                return false;
+            }
+        }
+        if (!sincronizar_arquivo()) {
+            lock_guard<mutex> l(trava);
+            falhou = true;
+            gravou.notify_all();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * True depois que uma gravação do log falhou. Daí em diante os registros anexados são
+     * descartados, então quem escreve deve recusar as operações antes de aplicá-las.
+     */
+    bool com_falha() const {
+        return falhou;
+    }
+
+    /**
+     * Com PoliticaFsync::SEMPRE, bloqueia até o registro terminado em lsn estar no disco.
+     * Nas outras políticas retorna imediatamente.
+     * @return false se uma gravação do log falhou antes de o registro chegar ao disco
+     * (nas outras políticas: se alguma gravação já falhou)
+     */
+    bool esperar(uint64_t lsn) {
+        unique_lock<mutex> l(trava);
+        if (politica != PoliticaFsync::SEMPRE) {
+            return !falhou;
+        }
+        gravou.wait(l, [&] { return lsn_gravado >= lsn || falhou; });
+        return lsn_gravado >= lsn;
+    }
+
+    /**
+     * Lê todos os registros íntegros do log chamando f(LeitorRegistro&) para cada um.
+     * Um fim de arquivo incompleto ou corrompido (queda no meio de uma gravação)
+     * é descartado e o arquivo é truncado no último registro válido.
+     * @param a_partir_de Posição do primeiro registro a ler (lsn de um snapshot), 0 para o log inteiro
+     * @return Quantidade de registros lidos
+     * @throws runtime_error se o log é mais curto que a_partir_de: o fim que o snapshot diz
+     * incluir se perdeu, e anexar ao log abaixo dessa posição faria a próxima partida pular registros
+     */
+    template <typename F>
+    static size_t reproduzir(const string &caminho, F f, uint64_t a_partir_de = 0) {
+        int fd = ::open(caminho.c_str(), O_RDWR);
+        off_t fim = fd < 0 ? 0 : ::lseek(fd, 0, SEEK_END);
+        if (fim < (off_t)a_partir_de) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw runtime_error("o log " + caminho + " é mais curto que a posição do snapshot");
+        }
+        if (fd < 0) {
+            return 0; // Log ainda não existe
+        }
+        if (fim == (off_t)a_partir_de) {
+            ::close(fd);
+            return 0; // Nada depois do snapshot
+        }
+        ::lseek(fd, a_partir_de, SEEK_SET);
+        string conteudo;
+        char pedaco[1 << 16];
+        ssize_t n;
+        while ((n = ::read(fd, pedaco, sizeof pedaco)) > 0) {
+            conteudo.append(pedaco, n);
+        }
+        size_t pos = 0, lidos = 0;
+        while (pos + 8 <= conteudo.size()) {
+            uint32_t tamanho, crc;
+            memcpy(&tamanho, conteudo.data() + pos, 4);
+            memcpy(&crc, conteudo.data() + pos + 4, 4);
+            if (tamanho == 0 || pos + 8 + tamanho > conteudo.size()
+                || crc32(conteudo.data() + pos + 8, tamanho) != crc) {
+                break;
+            }
+            LeitorRegistro leitor(conteudo.data() + pos + 8, tamanho);
+            try {
+                f(leitor);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+            pos += 8 + tamanho;
+            lidos++;
+        }
+        if (pos < conteudo.size()) {
+            if (::ftruncate(fd, a_partir_de + pos) != 0) {
+                ::close(fd);
+                throw runtime_error("não foi possível truncar o log " + caminho);
+            }
+        }
+        ::close(fd);
+        return lidos;
+    }
+};
+
+#endif